@@ -0,0 +1,97 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "typedefs.h"
+#include "search.h"
+#include "ch.h"
+#include "batch.h"
+
+typedef struct batch_t
+{
+    graph_t *graph;
+    query_t *queries;
+    size_t num_queries;
+    landmarks_t *landmarks;
+    ch_t *ch;
+    size_t next_query; // first query not yet claimed by a worker
+} batch_t;
+
+static void * BatchThreadMain(void *args);
+
+void RunQueryBatch(graph_t *graph, query_t *queries, size_t num_queries, size_t num_threads,
+                   landmarks_t *landmarks, ch_t *ch)
+{
+    batch_t batch = { graph, queries, num_queries, landmarks, ch, 0 };
+
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(threads, "threads");
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        if (0 != pthread_create(threads+i, NULL, BatchThreadMain, (void *)&batch))
+        {
+            fprintf(stderr, "Error creating a thread: %zu.\n", i);
+            exit(1);
+        }
+    }
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
+
+static void * BatchThreadMain(void *args)
+{
+    batch_t *batch = (batch_t *)args;
+    search_state_t *state = CreateSearchState(batch->graph->node_count);
+    search_state_t *backward = batch->ch != NULL ? CreateSearchState(batch->graph->node_count) : NULL;
+    landmark_query_t landmark_query = { batch->landmarks, 0 };
+    heuristic_t heuristic = { LandmarkHeuristic, &landmark_query };
+
+    while (true)
+    {
+        size_t first = __atomic_fetch_add(&batch->next_query, QUERY_CHUNK, __ATOMIC_RELAXED);
+        if (first >= batch->num_queries)
+        {
+            break;
+        }
+
+        size_t last = first + QUERY_CHUNK < batch->num_queries ? first + QUERY_CHUNK : batch->num_queries;
+
+        for (size_t i = first; i < last; i++)
+        {
+            query_t *query = batch->queries + i;
+
+            if (batch->ch != NULL)
+            {
+                query->length = ContractionHierarchyQuery(batch->ch, state, backward, query->source, query->target);
+            }
+            else if (batch->landmarks != NULL)
+            {
+                landmark_query.target = query->target;
+                query->length = AStarSearch(batch->graph, state, query->source, query->target, &heuristic);
+            }
+            else
+            {
+                query->length = DijkstraSearch(batch->graph, state, query->source, query->target);
+            }
+        }
+    }
+
+    DestroySearchState(backward);
+    DestroySearchState(state);
+
+    return NULL;
+}
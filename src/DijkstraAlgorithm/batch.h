@@ -0,0 +1,26 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "search.h"
+#include "ch.h"
+
+#define QUERY_CHUNK 16 // queries a worker claims at once
+
+typedef struct query_t
+{
+    unsigned int source;
+    unsigned int target;
+    int length; // result, UNREACHED if there is no path
+} query_t;
+
+// Answers every query over the shared, read-only graph using a pool of
+// num_threads workers. Each worker owns one reusable search state, so no
+// per-query allocation or O(V) reset takes place. The contraction hierarchy
+// query is used when ch is given, A* with the landmark heuristic when
+// landmarks are given, plain Dijkstra otherwise.
+void RunQueryBatch(graph_t *graph, query_t *queries, size_t num_queries, size_t num_threads,
+                   landmarks_t *landmarks, ch_t *ch);
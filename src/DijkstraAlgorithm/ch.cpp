@@ -0,0 +1,674 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "typedefs.h"
+#include "search.h"
+#include "ch.h"
+
+typedef struct ch_edge_t
+{
+    unsigned int target;
+    int weight;
+} ch_edge_t;
+
+typedef struct ch_edge_list_t
+{
+    ch_edge_t *edges;
+    size_t count;
+    size_t capacity;
+} ch_edge_list_t;
+
+typedef struct ch_shortcut_t
+{
+    unsigned int from;
+    unsigned int to;
+    int weight;
+} ch_shortcut_t;
+
+typedef struct ch_shortcut_list_t
+{
+    ch_shortcut_t *items;
+    size_t count;
+    size_t capacity;
+} ch_shortcut_list_t;
+
+typedef enum ch_node_state_t
+{
+    NODE_REMAINING,
+    NODE_SELECTED,  // part of the independent set contracted this round
+    NODE_CONTRACTED
+} ch_node_state_t;
+
+typedef struct ch_builder_t
+{
+    graph_t *graph;
+    size_t num_threads;
+    ch_edge_list_t *adjacency; // remaining graph, only edges between remaining nodes
+    ch_edge_list_t *upward;    // edges to later contracted nodes, filled on contraction
+    unsigned char *state;
+    int *priority;
+    int *contracted_neighbours;
+    int *level;                   // hierarchy depth below the node
+    bool *dirty;                  // priority needs to be recomputed
+    ch_shortcut_list_t *buckets;  // [contracting thread][owner thread]
+    unsigned int priority_hop_limit;
+    size_t contracted_count;
+    size_t shortcut_count;
+    size_t rounds;
+    pthread_barrier_t barrier;
+} ch_builder_t;
+
+typedef struct ch_worker_t
+{
+    ch_builder_t *builder;
+    size_t tid;
+    search_state_t *state;
+    unsigned int *target_mark; // nodes a witness search still has to settle
+    unsigned int target_epoch;
+    unsigned int *hops;        // edges on the path to each node reached by the witness search
+} ch_worker_t;
+
+static void * ContractionThreadMain(void *args);
+static size_t ContractNode(ch_worker_t *worker, unsigned int node, size_t limit, unsigned int hop_limit, bool emit);
+static void WitnessSearch(ch_worker_t *worker, unsigned int source, unsigned int skip, int max_dist,
+                          size_t targets, size_t limit, unsigned int hop_limit, bool skip_selected);
+static void ApplyRound(ch_builder_t *builder, size_t tid);
+static void AddEdge(ch_edge_list_t *list, unsigned int target, int weight);
+static void PushShortcut(ch_shortcut_list_t *list, unsigned int from, unsigned int to, int weight);
+static graph_t * BuildUpwardGraph(ch_builder_t *builder);
+
+static inline unsigned int TieBreak(unsigned int node)
+{
+    return node * 2654435761u;
+}
+
+// Strict order on (priority, hash, id) used to pick independent sets.
+static inline bool Precedes(ch_builder_t *builder, unsigned int a, unsigned int b)
+{
+    if (builder->priority[a] != builder->priority[b])
+    {
+        return builder->priority[a] < builder->priority[b];
+    }
+    if (TieBreak(a) != TieBreak(b))
+    {
+        return TieBreak(a) < TieBreak(b);
+    }
+    return a < b;
+}
+
+ch_t * BuildContractionHierarchy(graph_t *graph, size_t num_threads)
+{
+    size_t node_count = graph->node_count;
+
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+
+    ch_builder_t builder = {};
+    builder.graph = graph;
+    builder.num_threads = num_threads;
+    builder.priority_hop_limit = PRIORITY_HOP_LIMIT;
+    if (graph->edge_count > DENSE_DEGREE * node_count)
+    {
+        // Each round contracts few nodes and dirties nearly all the others,
+        // so the priorities are estimated from one-edge witnesses.
+        fprintf(stderr, "Average degree %.1f: contraction hierarchies suit sparse graphs, contraction will be slow.\n",
+                (double)graph->edge_count / node_count);
+        builder.priority_hop_limit = DENSE_PRIORITY_HOP_LIMIT;
+    }
+    builder.adjacency = (ch_edge_list_t *)calloc(node_count, sizeof(ch_edge_list_t));
+    builder.upward = (ch_edge_list_t *)calloc(node_count, sizeof(ch_edge_list_t));
+    builder.state = (unsigned char *)calloc(node_count, sizeof(unsigned char));
+    builder.priority = (int *)calloc(node_count, sizeof(int));
+    builder.contracted_neighbours = (int *)calloc(node_count, sizeof(int));
+    builder.level = (int *)calloc(node_count, sizeof(int));
+    builder.dirty = (bool *)malloc(node_count * sizeof(bool));
+    builder.buckets = (ch_shortcut_list_t *)calloc(num_threads * num_threads, sizeof(ch_shortcut_list_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.adjacency, "builder.adjacency");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.upward, "builder.upward");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.state, "builder.state");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.priority, "builder.priority");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.contracted_neighbours, "builder.contracted_neighbours");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.level, "builder.level");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.dirty, "builder.dirty");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(builder.buckets, "builder.buckets");
+
+    pthread_barrier_init(&builder.barrier, NULL, (unsigned int)num_threads);
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+    ch_worker_t *workers = (ch_worker_t *)calloc(num_threads, sizeof(ch_worker_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(workers, "workers");
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        workers[i].builder = &builder;
+        workers[i].tid = i;
+
+        if (0 != pthread_create(threads+i, NULL, ContractionThreadMain, (void *)(workers+i)))
+        {
+            fprintf(stderr, "Error creating a thread: %zu.\n", i);
+            exit(1);
+        }
+    }
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    ch_t *ch = (ch_t *)calloc(1, sizeof(ch_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(ch, "ch");
+    ch->upward = BuildUpwardGraph(&builder);
+    ch->shortcut_count = builder.shortcut_count;
+    ch->rounds = builder.rounds;
+
+    for (size_t i = 0; i < node_count; i++)
+    {
+        free(builder.adjacency[i].edges);
+        free(builder.upward[i].edges);
+    }
+    for (size_t i = 0; i < num_threads * num_threads; i++)
+    {
+        free(builder.buckets[i].items);
+    }
+
+    pthread_barrier_destroy(&builder.barrier);
+    free(workers);
+    free(threads);
+    free(builder.buckets);
+    free(builder.dirty);
+    free(builder.level);
+    free(builder.contracted_neighbours);
+    free(builder.priority);
+    free(builder.state);
+    free(builder.upward);
+    free(builder.adjacency);
+
+    return ch;
+}
+
+static void * ContractionThreadMain(void *args)
+{
+    ch_worker_t *worker = (ch_worker_t *)args;
+    ch_builder_t *builder = worker->builder;
+    graph_t *graph = builder->graph;
+    size_t tid = worker->tid;
+    size_t num_threads = builder->num_threads;
+    size_t node_count = graph->node_count;
+
+    worker->state = CreateSearchState(node_count);
+    worker->target_mark = (unsigned int *)calloc(node_count, sizeof(unsigned int));
+    worker->hops = (unsigned int *)malloc(node_count * sizeof(unsigned int));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(worker->target_mark, "worker->target_mark");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(worker->hops, "worker->hops");
+
+    // Each thread owns the nodes v with v % num_threads == tid: it is the only
+    // one to write their adjacency, priority and state.
+    for (size_t v = tid; v < node_count; v += num_threads)
+    {
+        ch_edge_list_t *list = builder->adjacency + v;
+
+        for (size_t e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++)
+        {
+            unsigned int target = graph->edge_targets[e];
+            if (target == v)
+            {
+                continue;
+            }
+
+            bool merged = false;
+            for (size_t k = 0; k < list->count; k++)
+            {
+                if (list->edges[k].target == target)
+                {
+                    if (graph->edge_weights[e] < list->edges[k].weight)
+                    {
+                        list->edges[k].weight = graph->edge_weights[e];
+                    }
+                    merged = true;
+                    break;
+                }
+            }
+
+            if (!merged)
+            {
+                AddEdge(list, target, graph->edge_weights[e]);
+            }
+        }
+
+        builder->dirty[v] = true;
+    }
+
+    pthread_barrier_wait(&builder->barrier);
+
+    while (true)
+    {
+        // Priorities of nodes next to the last independent set changed.
+        for (size_t v = tid; v < node_count; v += num_threads)
+        {
+            if (builder->state[v] == NODE_SELECTED)
+            {
+                builder->state[v] = NODE_CONTRACTED;
+                free(builder->adjacency[v].edges);
+                builder->adjacency[v].edges = NULL;
+                builder->adjacency[v].count = 0;
+            }
+            else if (builder->state[v] == NODE_REMAINING && builder->dirty[v])
+            {
+                int shortcuts = (int)ContractNode(worker, (unsigned int)v, PRIORITY_SETTLE_LIMIT,
+                                                  builder->priority_hop_limit, false);
+                builder->priority[v] = shortcuts - (int)builder->adjacency[v].count +
+                                       builder->contracted_neighbours[v] + builder->level[v];
+                builder->dirty[v] = false;
+            }
+        }
+
+        pthread_barrier_wait(&builder->barrier);
+
+        for (size_t v = tid; v < node_count; v += num_threads)
+        {
+            if (builder->state[v] != NODE_REMAINING)
+            {
+                continue;
+            }
+
+            bool local_minimum = true;
+            ch_edge_list_t *list = builder->adjacency + v;
+            for (size_t k = 0; k < list->count && local_minimum; k++)
+            {
+                local_minimum = Precedes(builder, (unsigned int)v, list->edges[k].target);
+            }
+
+            if (local_minimum)
+            {
+                builder->state[v] = NODE_SELECTED;
+            }
+        }
+
+        pthread_barrier_wait(&builder->barrier);
+
+        size_t contracted = 0;
+        for (size_t v = tid; v < node_count; v += num_threads)
+        {
+            if (builder->state[v] != NODE_SELECTED)
+            {
+                continue;
+            }
+
+            size_t shortcuts = ContractNode(worker, (unsigned int)v, WITNESS_SETTLE_LIMIT, WITNESS_HOP_LIMIT, true);
+            __atomic_fetch_add(&builder->shortcut_count, shortcuts, __ATOMIC_RELAXED);
+
+            // All remaining neighbours are contracted later, these become the
+            // upward edges of the hierarchy.
+            ch_edge_list_t *list = builder->adjacency + v;
+            for (size_t k = 0; k < list->count; k++)
+            {
+                AddEdge(builder->upward + v, list->edges[k].target, list->edges[k].weight);
+            }
+
+            contracted++;
+        }
+        __atomic_fetch_add(&builder->contracted_count, contracted, __ATOMIC_RELAXED);
+
+        pthread_barrier_wait(&builder->barrier);
+
+        ApplyRound(builder, tid);
+
+        if (tid == 0)
+        {
+            builder->rounds++;
+        }
+
+        pthread_barrier_wait(&builder->barrier);
+
+        if (__atomic_load_n(&builder->contracted_count, __ATOMIC_RELAXED) == node_count)
+        {
+            break;
+        }
+    }
+
+    free(worker->hops);
+    free(worker->target_mark);
+    DestroySearchState(worker->state);
+
+    return NULL;
+}
+
+// Counts (and with emit, records) the shortcuts contracting the node needs:
+// one for every pair of neighbours whose path through the node has no
+// witness path avoiding it. A witness search that gives up early only adds
+// shortcuts, the hierarchy stays exact.
+static size_t ContractNode(ch_worker_t *worker, unsigned int node, size_t limit, unsigned int hop_limit, bool emit)
+{
+    ch_builder_t *builder = worker->builder;
+    search_state_t *state = worker->state;
+    ch_edge_list_t *list = builder->adjacency + node;
+    size_t num_threads = builder->num_threads;
+    size_t tid = worker->tid;
+    size_t shortcuts = 0;
+
+    for (size_t i = 0; i + 1 < list->count; i++)
+    {
+        unsigned int from = list->edges[i].target;
+        int from_weight = list->edges[i].weight;
+
+        // The search may stop once every later neighbour is settled or the
+        // longest path through the node is exceeded.
+        int max_weight = 0;
+        worker->target_epoch++;
+        for (size_t j = i + 1; j < list->count; j++)
+        {
+            worker->target_mark[list->edges[j].target] = worker->target_epoch;
+            if (list->edges[j].weight > max_weight)
+            {
+                max_weight = list->edges[j].weight;
+            }
+        }
+
+        // Nodes contracted in the same round are ignored as well, so witnesses
+        // stay valid once the whole independent set is gone.
+        WitnessSearch(worker, from, node, from_weight + max_weight, list->count - i - 1, limit, hop_limit, emit);
+
+        for (size_t j = i + 1; j < list->count; j++)
+        {
+            unsigned int to = list->edges[j].target;
+            int via = from_weight + list->edges[j].weight;
+            int witness = GetDist(state, to);
+
+            if (witness != UNREACHED && witness <= via)
+            {
+                continue;
+            }
+
+            shortcuts++;
+
+            if (emit)
+            {
+                PushShortcut(builder->buckets + tid * num_threads + from % num_threads, from, to, via);
+                PushShortcut(builder->buckets + tid * num_threads + to % num_threads, to, from, via);
+            }
+        }
+    }
+
+    return shortcuts;
+}
+
+static void WitnessSearch(ch_worker_t *worker, unsigned int source, unsigned int skip, int max_dist,
+                          size_t targets, size_t limit, unsigned int hop_limit, bool skip_selected)
+{
+    ch_builder_t *builder = worker->builder;
+    search_state_t *state = worker->state;
+
+    ResetSearchState(state);
+    SetDist(state, source, 0);
+    worker->hops[source] = 0;
+    HeapPush(state->heap, 0, source);
+
+    while (!HeapEmpty(state->heap) && state->settled_count < limit)
+    {
+        heap_item_t item = HeapPop(state->heap);
+        unsigned int u = item.node;
+
+        if (IsSettled(state, u))
+        {
+            continue;
+        }
+        if (item.key > max_dist)
+        {
+            break;
+        }
+
+        MarkSettled(state, u);
+
+        if (worker->target_mark[u] == worker->target_epoch && --targets == 0)
+        {
+            break;
+        }
+
+        // Nodes of a dense graph are all a few hops apart, paths longer than
+        // hop_limit edges are not followed. A node at the limit is not
+        // queued, its tentative distance is already a witness length.
+        unsigned int hops = worker->hops[u] + 1;
+
+        ch_edge_list_t *list = builder->adjacency + u;
+        for (size_t k = 0; k < list->count; k++)
+        {
+            unsigned int v = list->edges[k].target;
+            if (v == skip || (skip_selected && builder->state[v] == NODE_SELECTED) || IsSettled(state, v))
+            {
+                continue;
+            }
+
+            int dist_to_node = item.key + list->edges[k].weight;
+            int dist_v = GetDist(state, v);
+            if (dist_v == UNREACHED || dist_to_node < dist_v)
+            {
+                SetDist(state, v, dist_to_node);
+                if (hops < hop_limit)
+                {
+                    worker->hops[v] = hops;
+                    HeapPush(state->heap, dist_to_node, v);
+                }
+            }
+        }
+    }
+}
+
+// Removes the contracted independent set from the owned nodes' adjacency and
+// inserts the shortcuts addressed to them.
+static void ApplyRound(ch_builder_t *builder, size_t tid)
+{
+    size_t num_threads = builder->num_threads;
+    size_t node_count = builder->graph->node_count;
+
+    for (size_t v = tid; v < node_count; v += num_threads)
+    {
+        if (builder->state[v] != NODE_REMAINING)
+        {
+            continue;
+        }
+
+        ch_edge_list_t *list = builder->adjacency + v;
+        size_t kept = 0;
+        for (size_t k = 0; k < list->count; k++)
+        {
+            unsigned int target = list->edges[k].target;
+            if (builder->state[target] == NODE_SELECTED)
+            {
+                if (builder->level[target] + 1 > builder->level[v])
+                {
+                    builder->level[v] = builder->level[target] + 1;
+                }
+                builder->contracted_neighbours[v]++;
+                builder->dirty[v] = true;
+                continue;
+            }
+
+            list->edges[kept++] = list->edges[k];
+        }
+        list->count = kept;
+    }
+
+    for (size_t source = 0; source < num_threads; source++)
+    {
+        ch_shortcut_list_t *bucket = builder->buckets + source * num_threads + tid;
+
+        for (size_t i = 0; i < bucket->count; i++)
+        {
+            ch_shortcut_t *shortcut = bucket->items + i;
+            ch_edge_list_t *list = builder->adjacency + shortcut->from;
+            bool merged = false;
+
+            for (size_t k = 0; k < list->count; k++)
+            {
+                if (list->edges[k].target == shortcut->to)
+                {
+                    if (shortcut->weight < list->edges[k].weight)
+                    {
+                        list->edges[k].weight = shortcut->weight;
+                    }
+                    merged = true;
+                    break;
+                }
+            }
+
+            if (!merged)
+            {
+                AddEdge(list, shortcut->to, shortcut->weight);
+            }
+
+            builder->dirty[shortcut->from] = true;
+        }
+
+        bucket->count = 0;
+    }
+}
+
+static void AddEdge(ch_edge_list_t *list, unsigned int target, int weight)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity > 0 ? 2 * list->capacity : 4;
+        list->edges = (ch_edge_t *)realloc(list->edges, list->capacity * sizeof(ch_edge_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(list->edges, "list->edges");
+    }
+
+    list->edges[list->count].target = target;
+    list->edges[list->count].weight = weight;
+    list->count++;
+}
+
+static void PushShortcut(ch_shortcut_list_t *list, unsigned int from, unsigned int to, int weight)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity > 0 ? 2 * list->capacity : 64;
+        list->items = (ch_shortcut_t *)realloc(list->items, list->capacity * sizeof(ch_shortcut_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(list->items, "list->items");
+    }
+
+    list->items[list->count].from = from;
+    list->items[list->count].to = to;
+    list->items[list->count].weight = weight;
+    list->count++;
+}
+
+static graph_t * BuildUpwardGraph(ch_builder_t *builder)
+{
+    size_t node_count = builder->graph->node_count;
+
+    graph_t *upward = (graph_t *)calloc(1, sizeof(graph_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(upward, "upward");
+    upward->node_count = node_count;
+    upward->edge_offsets = (size_t *)malloc((node_count + 1) * sizeof(size_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(upward->edge_offsets, "upward->edge_offsets");
+
+    upward->edge_offsets[0] = 0;
+    for (size_t v = 0; v < node_count; v++)
+    {
+        upward->edge_offsets[v + 1] = upward->edge_offsets[v] + builder->upward[v].count;
+    }
+
+    upward->edge_count = upward->edge_offsets[node_count];
+    upward->edge_targets = (unsigned int *)malloc(upward->edge_count * sizeof(unsigned int) + 1);
+    upward->edge_weights = (int *)malloc(upward->edge_count * sizeof(int) + 1);
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(upward->edge_targets, "upward->edge_targets");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(upward->edge_weights, "upward->edge_weights");
+
+    for (size_t v = 0; v < node_count; v++)
+    {
+        size_t e = upward->edge_offsets[v];
+        for (size_t k = 0; k < builder->upward[v].count; k++, e++)
+        {
+            upward->edge_targets[e] = builder->upward[v].edges[k].target;
+            upward->edge_weights[e] = builder->upward[v].edges[k].weight;
+        }
+    }
+
+    return upward;
+}
+
+void DestroyContractionHierarchy(ch_t *ch)
+{
+    if (ch == NULL)
+    {
+        return;
+    }
+
+    free(ch->upward->edge_weights);
+    free(ch->upward->edge_targets);
+    free(ch->upward->edge_offsets);
+    free(ch->upward);
+    free(ch);
+}
+
+// Forward and backward searches both climb the upward graph, alternating one
+// settled node at a time. A direction stops once its smallest key reaches the
+// best meeting length found so far.
+int ContractionHierarchyQuery(ch_t *ch, search_state_t *forward, search_state_t *backward,
+                              unsigned int source, unsigned int target)
+{
+    graph_t *upward = ch->upward;
+    search_state_t *states[2] = { forward, backward };
+    int best = UNREACHED;
+
+    ResetSearchState(forward);
+    ResetSearchState(backward);
+    SetDist(forward, source, 0);
+    HeapPush(forward->heap, 0, source);
+    SetDist(backward, target, 0);
+    HeapPush(backward->heap, 0, target);
+
+    bool active[2] = { true, true };
+    for (int side = 0; active[0] || active[1]; side = 1 - side)
+    {
+        if (!active[side])
+        {
+            continue;
+        }
+
+        search_state_t *state = states[side];
+        search_state_t *other = states[1 - side];
+
+        if (HeapEmpty(state->heap) || (best != UNREACHED && HeapTopKey(state->heap) >= best))
+        {
+            active[side] = false;
+            continue;
+        }
+
+        heap_item_t item = HeapPop(state->heap);
+        unsigned int u = item.node;
+        if (IsSettled(state, u))
+        {
+            continue;
+        }
+
+        MarkSettled(state, u);
+
+        int other_dist = GetDist(other, u);
+        if (other_dist != UNREACHED && (best == UNREACHED || item.key + other_dist < best))
+        {
+            best = item.key + other_dist;
+        }
+
+        for (size_t e = upward->edge_offsets[u]; e < upward->edge_offsets[u + 1]; e++)
+        {
+            unsigned int v = upward->edge_targets[e];
+            int dist_to_node = item.key + upward->edge_weights[e];
+            int dist_v = GetDist(state, v);
+
+            if (dist_v == UNREACHED || dist_to_node < dist_v)
+            {
+                SetDist(state, v, dist_to_node);
+                HeapPush(state->heap, dist_to_node, v);
+            }
+        }
+    }
+
+    return best;
+}
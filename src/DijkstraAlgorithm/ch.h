@@ -0,0 +1,34 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "search.h"
+
+#define WITNESS_SETTLE_LIMIT 500   // nodes a witness search may settle while contracting
+#define PRIORITY_SETTLE_LIMIT 100  // nodes a witness search may settle while ordering
+#define WITNESS_HOP_LIMIT 5        // edges on a witness path while contracting
+#define PRIORITY_HOP_LIMIT 2       // edges on a witness path while ordering
+#define DENSE_PRIORITY_HOP_LIMIT 1 // the same on graphs of average degree above DENSE_DEGREE
+#define DENSE_DEGREE 8
+
+// Contraction hierarchy of an undirected graph. Every node keeps only the
+// edges (original or shortcut) to nodes contracted after it, so one upward
+// graph serves both the forward and the backward search.
+typedef struct ch_t
+{
+    graph_t *upward;
+    size_t shortcut_count;
+    size_t rounds; // independent sets contracted
+} ch_t;
+
+// Contracts the graph with num_threads threads. Each round the nodes whose
+// priority (edge difference plus contracted neighbours) is a local minimum
+// form an independent set and are contracted in parallel.
+ch_t * BuildContractionHierarchy(graph_t *graph, size_t num_threads);
+void DestroyContractionHierarchy(ch_t *ch);
+
+int ContractionHierarchyQuery(ch_t *ch, search_state_t *forward, search_state_t *backward,
+                              unsigned int source, unsigned int target);
@@ -7,26 +7,37 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <limits.h>
+#include <time.h>
 #include <pthread.h>
 #include "typedefs.h"
+#include "search.h"
+#include "batch.h"
+#include "graph_io.h"
+#include "ch.h"
 
 #define RAND_SEED 46540 // graph generation seed
-#define INFINITY -1
+#define DEFAULT_BATCH_QUERIES 1000
+#define NO_NODE UINT_MAX
 
 graph_t *graph;
 size_t num_threads;
 size_t path_length;
-node_t *initial_node;
-node_t *target_node;
+unsigned int initial_node;
+unsigned int target_node = NO_NODE;
+search_state_t *traverse_state; // state of the parallel (single query) traversal
 bool threads_initialized = false;
 
 void Traverse(pthread_t *);
 void * ThreadMain(void*);
-node_t *GetNeighbour(node_t *, int);
 graph_t * GenerateGraph(size_t);
-void DestroyGraph(graph_t *);
 void PrintGraph(graph_t *);
 void InitializeStartEndNodes(graph_t *);
+void RunParallelQuery(graph_t *);
+void RunBidirectionalQuery(graph_t *);
+void RunAStarQuery(graph_t *, size_t);
+void RunBatchQueries(graph_t *, size_t, size_t, bool);
+double ElapsedSeconds(struct timespec *);
 
 static bool shortest_path_found = false;
 static pthread_cond_t traverser_wait_condition = PTHREAD_COND_INITIALIZER;
@@ -42,23 +53,87 @@ int main(int argc, char *argv[])
     if (argc < 3)
     {
         fprintf(stderr, "Required arguments:\n \
-                        num_nodes - number of graph nodes.\n \
-                        num_threads - number of worker threads.");
+                        num_nodes - number of graph nodes, or a graph file to load\n \
+                                    (.gr - DIMACS, .bin - binary graph, otherwise an edge list).\n \
+                        num_threads - number of worker threads.\n \
+                        mode - optional: parallel (default), bidirectional, astar, batch, ch or save.\n \
+                        landmarks - optional: number of A* landmarks (0 - no heuristic),\n \
+                                    in save mode the binary graph file to write.\n \
+                        queries - optional: number of batch and ch mode queries.");
         return -1;
     }
 
-    int num_nodes = atoi(argv[1]);
     num_threads = atoi(argv[2]);
+    const char *mode = argc > 3 ? argv[3] : "parallel";
+    size_t num_landmarks = argc > 4 ? (size_t)atoi(argv[4]) : 0;
+    size_t num_queries = argc > 5 ? (size_t)atoi(argv[5]) : DEFAULT_BATCH_QUERIES;
+
+    if (strspn(argv[1], "0123456789") == strlen(argv[1]))
+    {
+        graph = GenerateGraph(atoi(argv[1]));
+    }
+    else
+    {
+        graph = LoadGraph(argv[1], num_threads);
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph, "graph");
+        srand(RAND_SEED);
+    }
+
+    if (graph->node_count < 2)
+    {
+        fprintf(stderr, "The graph needs at least two nodes.\n");
+        DestroyGraph(graph);
+        return -1;
+    }
 
-    graph = GenerateGraph(num_nodes);
     InitializeStartEndNodes(graph);
 
 #ifdef DEBUG
-    printf("Start: %d\n", initial_node->node_num);
-    printf("End: %d\n", target_node->node_num);
+    printf("Start: %u\n", initial_node);
+    printf("End: %u\n", target_node);
     PrintGraph(graph);
 #endif
 
+    if (strcmp(mode, "bidirectional") == 0)
+    {
+        RunBidirectionalQuery(graph);
+    }
+    else if (strcmp(mode, "astar") == 0)
+    {
+        RunAStarQuery(graph, num_landmarks);
+    }
+    else if (strcmp(mode, "batch") == 0)
+    {
+        RunBatchQueries(graph, num_queries, num_landmarks, false);
+    }
+    else if (strcmp(mode, "ch") == 0)
+    {
+        RunBatchQueries(graph, num_queries, 0, true);
+    }
+    else if (strcmp(mode, "save") == 0)
+    {
+        if (argc < 5 || SUCCESS != SaveGraph(graph, argv[4]))
+        {
+            fprintf(stderr, "Graph was not saved.\n");
+        }
+    }
+    else
+    {
+        RunParallelQuery(graph);
+    }
+
+    DestroyGraph(graph);
+
+    printf("The end.\n");
+
+    return 0;
+}
+
+void RunParallelQuery(graph_t *graph)
+{
+    traverse_state = CreateSearchState(graph->node_count);
+    SetDist(traverse_state, initial_node, 0);
+
     num_threads -= 1; // leave some work for the main thread
     pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
 
@@ -69,42 +144,41 @@ int main(int argc, char *argv[])
         pthread_join(*(threads+i), NULL);
     }
 
-    DestroyGraph(graph);
+    printf("Shortest path length: %d\n", GetDist(traverse_state, target_node));
+
+    free(threads);
+    DestroySearchState(traverse_state);
     pthread_cond_destroy(&traverser_wait_condition);
     pthread_mutex_destroy(&traverser_wait_mutex);
     pthread_cond_destroy(&worker_wait_condition);
     pthread_mutex_destroy(&worker_wait_mutex);
-
-    printf("The end.\n");
-
-    return 0;
 }
 
 void Traverse(pthread_t *threads)
 {
-    node_t *nearest_node = NULL;
+    unsigned int nearest_node = NO_NODE;
 
     pthread_mutex_lock(&traverser_wait_mutex);
-    int x = 0;
     while (initial_node != target_node)
     {
-
-        for (int i = 0; i < graph->node_count; i++)
+        for (unsigned int i = 0; i < graph->node_count; i++)
         {
-            if (nearest_node == NULL && graph->nodes[i].in_graph &&
-                graph->nodes[i].dist != INFINITY)
+            int dist = GetDist(traverse_state, i);
+
+            if (IsSettled(traverse_state, i) || dist == UNREACHED)
             {
-                nearest_node = graph->nodes + i;
+                continue;
             }
-            else if (graph->nodes[i].in_graph && graph->nodes[i].dist != INFINITY &&
-                graph->nodes[i].dist < nearest_node->dist)
+
+            if (nearest_node == NO_NODE || dist < GetDist(traverse_state, nearest_node))
             {
-                nearest_node = graph->nodes + i;
+                nearest_node = i;
             }
         }
 
-        initial_node = nearest_node;
-        nearest_node = NULL;
+        // An unreachable target ends the traversal with its distance unset.
+        initial_node = nearest_node != NO_NODE ? nearest_node : target_node;
+        nearest_node = NO_NODE;
 
         if (!threads_initialized)
         {
@@ -128,7 +202,7 @@ void Traverse(pthread_t *threads)
         pthread_mutex_lock(&worker_wait_mutex);
         pthread_mutex_unlock(&worker_wait_mutex);
 
-        initial_node->in_graph = false;
+        MarkSettled(traverse_state, initial_node);
     }
 
     pthread_mutex_unlock(&traverser_wait_mutex);
@@ -142,23 +216,20 @@ void* ThreadMain(void* threadid)
 
     while (initial_node != target_node)
     {
-        int work_number = tid;
+        size_t first_edge = graph->edge_offsets[initial_node];
+        size_t last_edge = graph->edge_offsets[initial_node + 1];
+        int initial_dist = GetDist(traverse_state, initial_node);
 
-        while (work_number < initial_node->path_count)
+        for (size_t e = first_edge + tid; e < last_edge; e += num_threads)
         {
-            node_t *neighbour = GetNeighbour(initial_node, work_number);
+            unsigned int neighbour = graph->edge_targets[e];
+            int dist_to_node = initial_dist + graph->edge_weights[e];
+            int neighbour_dist = GetDist(traverse_state, neighbour);
 
-            if (neighbour != NULL)
+            if (neighbour_dist == UNREACHED || neighbour_dist > dist_to_node)
             {
-                int dist_to_node = initial_node->dist + initial_node->paths[tid]->dist;
-
-                if (neighbour->dist == INFINITY || neighbour->dist > dist_to_node)
-                {
-                    neighbour->dist = dist_to_node;
-                }
+                SetDist(traverse_state, neighbour, dist_to_node);
             }
-
-            work_number += num_threads;
         }
 
         waiting++;
@@ -179,105 +250,87 @@ void* ThreadMain(void* threadid)
     return NULL;
 }
 
-node_t *GetNeighbour(node_t *node, int path_number)
-{
-    if (node->paths[path_number]->a == NULL || node->paths[path_number]->b == NULL)
-    {
-        return NULL;
-    }
-
-    if (node->paths[path_number]->a == node)
-    {
-        return node->paths[path_number]->b;
-    }
-    else if (node->paths[path_number]->b == node)
-    {
-        return node->paths[path_number]->a;
-    }
-
-    return NULL;
-}
-
 graph_t * GenerateGraph(size_t num_nodes)
 {
     srand(RAND_SEED);
 
-    node_t *nodes = (node_t *)calloc(num_nodes, sizeof(node_t));
-    path_t ***paths = (path_t ***)calloc(num_nodes, sizeof(path_t **));
+    // Each pair of nodes is connected with 50% probability. Paths are first
+    // collected per lower-numbered node and then laid out in CSR order.
+    size_t *degrees = (size_t *)calloc(num_nodes, sizeof(size_t));
+    size_t path_capacity = num_nodes;
+    size_t path_count = 0;
+    unsigned int (*pairs)[2] = (unsigned int (*)[2])malloc(path_capacity * sizeof(*pairs));
+    int *dists = (int *)malloc(path_capacity * sizeof(int));
 
-    for (int i = 0; i < num_nodes; i++)
+    for (unsigned int i = 0; i + 1 < num_nodes; i++)
     {
-        nodes[i].node_num = i;
-        nodes[i].in_graph = true;
-        nodes[i].dist = INFINITY;
-        nodes[i].paths = (path_t **)calloc(num_nodes - 1, sizeof(path_t *));
-    }
-
-    for (int i = 0; i < num_nodes - 1; i++)
-    {
-        size_t path_seq = nodes[i].path_count;
-
-        for (int j = i + 1; j < num_nodes; j++)
+        for (unsigned int j = i + 1; j < num_nodes; j++)
         {
             bool has_connection = (rand() % 2 == 0);
 
             if (has_connection)
             {
-                nodes[i].paths[path_seq] = (path_t *)calloc(1, sizeof(path_t));
-                nodes[i].paths[path_seq]->dist = rand() % 100;
-                nodes[i].paths[path_seq]->a = nodes + i;
-                nodes[i].paths[path_seq]->b = nodes + j;
-                nodes[i].path_count++;
-
-                size_t to_path_seq = nodes[j].path_count;
-                nodes[j].paths[to_path_seq] = nodes[i].paths[path_seq];
-                nodes[j].path_count++;
+                if (path_count == path_capacity)
+                {
+                    path_capacity *= 2;
+                    pairs = (unsigned int (*)[2])realloc(pairs, path_capacity * sizeof(*pairs));
+                    dists = (int *)realloc(dists, path_capacity * sizeof(int));
+                    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(pairs, "pairs");
+                    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(dists, "dists");
+                }
 
-                path_seq++;
+                pairs[path_count][0] = i;
+                pairs[path_count][1] = j;
+                dists[path_count] = rand() % 100;
+                degrees[i]++;
+                degrees[j]++;
+                path_count++;
             }
         }
-
-        paths[i] = (path_t **)malloc(sizeof(path_t) * nodes[i].path_count);
-        for (int j = 0; j < nodes[i].path_count; j++)
-        {
-            paths[i][j] = nodes[i].paths[j];
-        }
     }
 
     graph_t *graph = (graph_t *)calloc(1, sizeof(graph_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph, "graph");
     graph->node_count = num_nodes;
-    graph->nodes = nodes;
-    graph->paths = paths;
-
-    return graph;
-}
-
-void DestroyGraph(graph_t *graph)
-{
-    // TODO: free paths.
+    graph->edge_count = 2 * path_count;
+    graph->edge_offsets = (size_t *)malloc((num_nodes + 1) * sizeof(size_t));
+    graph->edge_targets = (unsigned int *)malloc(graph->edge_count * sizeof(unsigned int));
+    graph->edge_weights = (int *)malloc(graph->edge_count * sizeof(int));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph->edge_targets, "graph->edge_targets");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph->edge_weights, "graph->edge_weights");
+
+    graph->edge_offsets[0] = 0;
+    for (size_t i = 0; i < num_nodes; i++)
+    {
+        graph->edge_offsets[i + 1] = graph->edge_offsets[i] + degrees[i];
+        degrees[i] = graph->edge_offsets[i]; // reused as the fill cursor
+    }
 
-    for (int i = 0; i < graph->node_count; i++)
+    for (size_t k = 0; k < path_count; k++)
     {
-        node_t *node = graph->nodes + i;
+        unsigned int a = pairs[k][0];
+        unsigned int b = pairs[k][1];
 
-        free(node->paths);
+        graph->edge_targets[degrees[a]] = b;
+        graph->edge_weights[degrees[a]++] = dists[k];
+        graph->edge_targets[degrees[b]] = a;
+        graph->edge_weights[degrees[b]++] = dists[k];
     }
 
-    free(graph->nodes);
-    free(graph->paths);
+    free(dists);
+    free(pairs);
+    free(degrees);
 
-    free(graph);
+    return graph;
 }
 
 void PrintGraph(graph_t *graph)
 {
-    for (int i = 0; i < graph->node_count; i++)
+    for (unsigned int i = 0; i < graph->node_count; i++)
     {
-        node_t *node = graph->nodes+i;
-        for (int j = 0; j < node->path_count; j++)
+        for (size_t e = graph->edge_offsets[i]; e < graph->edge_offsets[i + 1]; e++)
         {
-            path_t path = *node->paths[j];
-            printf("%d -> %d = %d + %d\n", node->node_num, path.a == node ? path.b->node_num : path.a->node_num, node->dist, path.dist);
+            printf("%u -> %u = %d\n", i, graph->edge_targets[e], graph->edge_weights[e]);
         }
 
         printf("\n");
@@ -286,11 +339,105 @@ void PrintGraph(graph_t *graph)
 
 void InitializeStartEndNodes(graph_t *graph)
 {
-    initial_node = graph->nodes + (rand() % graph->node_count);
-    initial_node->dist = 0;
+    initial_node = rand() % graph->node_count;
+
+    while (target_node == NO_NODE || target_node == initial_node)
+    {
+        target_node = rand() % graph->node_count;
+    }
+}
+
+void RunBidirectionalQuery(graph_t *graph)
+{
+    search_state_t *forward = CreateSearchState(graph->node_count);
+    search_state_t *backward = CreateSearchState(graph->node_count);
+
+    int length = BidirectionalSearch(graph, forward, backward, initial_node, target_node);
+
+    printf("Shortest path length: %d (%zu nodes settled)\n", length,
+           forward->settled_count + backward->settled_count);
+
+    DestroySearchState(backward);
+    DestroySearchState(forward);
+}
+
+void RunAStarQuery(graph_t *graph, size_t num_landmarks)
+{
+    search_state_t *state = CreateSearchState(graph->node_count);
+    landmarks_t *landmarks = NULL;
+    landmark_query_t query;
+    heuristic_t heuristic = { ZeroHeuristic, NULL };
 
-    while (target_node == NULL || target_node == initial_node)
+    if (num_landmarks > 0)
     {
-        target_node = graph->nodes + (rand() % graph->node_count);
+        landmarks = CreateLandmarks(graph, num_landmarks, num_threads);
+        query.landmarks = landmarks;
+        query.target = target_node;
+        heuristic.estimate = LandmarkHeuristic;
+        heuristic.context = &query;
     }
+
+    int length = AStarSearch(graph, state, initial_node, target_node, &heuristic);
+
+    printf("Shortest path length: %d (%zu nodes settled)\n", length, state->settled_count);
+
+    DestroyLandmarks(landmarks);
+    DestroySearchState(state);
+}
+
+double ElapsedSeconds(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void RunBatchQueries(graph_t *graph, size_t num_queries, size_t num_landmarks, bool use_ch)
+{
+    query_t *queries = (query_t *)calloc(num_queries, sizeof(query_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(queries, "queries");
+
+    for (size_t i = 0; i < num_queries; i++)
+    {
+        queries[i].source = rand() % graph->node_count;
+        queries[i].target = rand() % graph->node_count;
+    }
+
+    landmarks_t *landmarks = num_landmarks > 0 ? CreateLandmarks(graph, num_landmarks, num_threads) : NULL;
+    ch_t *ch = NULL;
+
+    struct timespec start;
+
+    if (use_ch)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ch = BuildContractionHierarchy(graph, num_threads);
+        printf("Contraction hierarchy: %zu shortcuts, %zu rounds in %.3f s\n",
+               ch->shortcut_count, ch->rounds, ElapsedSeconds(&start));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    RunQueryBatch(graph, queries, num_queries, num_threads, landmarks, ch);
+
+    double seconds = ElapsedSeconds(&start);
+
+    size_t reachable = 0;
+    long long total_length = 0;
+    for (size_t i = 0; i < num_queries; i++)
+    {
+        if (queries[i].length != UNREACHED)
+        {
+            reachable++;
+            total_length += queries[i].length;
+        }
+    }
+
+    printf("Answered %zu queries (%zu reachable, total length %lld) in %.3f s, %.0f queries/s\n",
+           num_queries, reachable, total_length, seconds, seconds > 0 ? num_queries / seconds : 0.);
+
+    DestroyContractionHierarchy(ch);
+    DestroyLandmarks(landmarks);
+    free(queries);
 }
@@ -0,0 +1,759 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "typedefs.h"
+#include "graph_io.h"
+
+#define INSERTION_SORT_DEGREE 32 // adjacency lists up to this size are insertion sorted
+
+typedef struct edge_t
+{
+    unsigned int from;
+    unsigned int to;
+    int weight;
+} edge_t;
+
+typedef enum load_phase_t
+{
+    PHASE_PARSE,   // parse a chunk of lines into local edges
+    PHASE_COUNT,   // count node degrees
+    PHASE_SCATTER, // place local edges into the CSR arrays
+    PHASE_SORT     // sort adjacency lists by target for a range of nodes
+} load_phase_t;
+
+typedef struct loader_worker_t
+{
+    load_phase_t phase;
+    const char *begin;
+    const char *end;
+    bool dimacs;
+    bool undirected;
+    edge_t *edges;
+    size_t edge_count;
+    size_t edge_capacity;
+    unsigned int max_node;
+    const char *error;      // what is wrong with the first bad line of the chunk, NULL if none
+    const char *error_line; // start of that line
+    graph_t *graph;
+    size_t *cursors;
+    size_t first_node;
+    size_t last_node;
+} loader_worker_t;
+
+typedef struct adjacency_item_t
+{
+    unsigned int target;
+    int weight;
+} adjacency_item_t;
+
+static graph_t * LoadTextGraph(const char *data, size_t size, bool dimacs, size_t num_threads);
+static graph_t * MapBinaryGraph(const char *path);
+static bool BinaryGraphFits(const graph_file_header_t *header, size_t size);
+static bool BinaryGraphConsistent(const uint64_t *offsets, const uint32_t *targets, const int32_t *weights,
+                                  size_t node_count, size_t edge_count);
+static bool ReadDimacsNodeCount(const char *data, size_t size, size_t *node_count);
+static size_t LineNumber(const char *data, const char *line);
+static void RunPhase(loader_worker_t *workers, size_t num_threads, load_phase_t phase);
+static void * LoaderThreadMain(void *args);
+static void ParseChunk(loader_worker_t *worker);
+static void CountDegrees(loader_worker_t *worker);
+static void ScatterEdges(loader_worker_t *worker);
+static void SortAdjacency(loader_worker_t *worker);
+static int CompareAdjacencyItems(const void *a, const void *b);
+
+static bool HasSuffix(const char *str, const char *suffix)
+{
+    size_t str_len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return str_len >= suffix_len && strcmp(str + str_len - suffix_len, suffix) == 0;
+}
+
+static inline size_t Padded(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t)7;
+}
+
+graph_t * LoadGraph(const char *path, size_t num_threads)
+{
+    if (HasSuffix(path, ".bin"))
+    {
+        return MapBinaryGraph(path);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot open graph file %s.\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        fprintf(stderr, "Graph file %s is empty.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map graph file %s.\n", path);
+        return NULL;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    graph_t *graph = LoadTextGraph((const char *)data, size, HasSuffix(path, ".gr"),
+                                   num_threads > 0 ? num_threads : 1);
+
+    munmap(data, size);
+
+    return graph;
+}
+
+static graph_t * LoadTextGraph(const char *data, size_t size, bool dimacs, size_t num_threads)
+{
+    size_t node_count = 0;
+    if (dimacs && !ReadDimacsNodeCount(data, size, &node_count))
+    {
+        fprintf(stderr, "DIMACS graph has no \"p sp\" line.\n");
+        return NULL;
+    }
+
+    loader_worker_t *workers = (loader_worker_t *)calloc(num_threads, sizeof(loader_worker_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(workers, "workers");
+
+    // Chunks start at line boundaries, a line belongs to the chunk it starts in.
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        size_t start = size * i / num_threads;
+        if (start > 0)
+        {
+            const char *newline = (const char *)memchr(data + start - 1, '\n', size - start + 1);
+            start = newline != NULL ? (size_t)(newline - data) + 1 : size;
+        }
+
+        workers[i].begin = data + start;
+        workers[i].dimacs = dimacs;
+        workers[i].undirected = !dimacs;
+
+        if (i > 0)
+        {
+            workers[i - 1].end = workers[i].begin;
+        }
+    }
+    workers[num_threads - 1].end = data + size;
+
+    RunPhase(workers, num_threads, PHASE_PARSE);
+
+    size_t edge_count = 0;
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        if (workers[i].error != NULL)
+        {
+            fprintf(stderr, "Graph file line %zu: %s.\n", LineNumber(data, workers[i].error_line), workers[i].error);
+            node_count = 0;
+            edge_count = 0;
+            break;
+        }
+
+        if (!dimacs && workers[i].edge_count > 0 && (size_t)workers[i].max_node + 1 > node_count)
+        {
+            node_count = (size_t)workers[i].max_node + 1;
+        }
+
+        edge_count += workers[i].edge_count * (workers[i].undirected ? 2 : 1);
+    }
+
+    graph_t *graph = NULL;
+
+    if (dimacs)
+    {
+        for (size_t i = 0; i < num_threads && node_count > 0; i++)
+        {
+            if (workers[i].edge_count > 0 && workers[i].max_node >= node_count)
+            {
+                fprintf(stderr, "DIMACS arc refers to a node above the declared count.\n");
+                node_count = 0;
+            }
+        }
+    }
+
+    if (node_count > 0)
+    {
+        graph = (graph_t *)calloc(1, sizeof(graph_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph, "graph");
+        graph->node_count = node_count;
+        graph->edge_count = edge_count;
+        graph->edge_offsets = (size_t *)calloc(node_count + 1, sizeof(size_t));
+        graph->edge_targets = (unsigned int *)malloc(edge_count * sizeof(unsigned int) + 1);
+        graph->edge_weights = (int *)malloc(edge_count * sizeof(int) + 1);
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph->edge_offsets, "graph->edge_offsets");
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph->edge_targets, "graph->edge_targets");
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph->edge_weights, "graph->edge_weights");
+
+        for (size_t i = 0; i < num_threads; i++)
+        {
+            workers[i].graph = graph;
+        }
+
+        // Degrees are counted into edge_offsets[node + 1] and turned into
+        // offsets by a prefix sum.
+        RunPhase(workers, num_threads, PHASE_COUNT);
+
+        size_t *cursors = (size_t *)malloc(node_count * sizeof(size_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cursors, "cursors");
+
+        for (size_t i = 0; i < node_count; i++)
+        {
+            graph->edge_offsets[i + 1] += graph->edge_offsets[i];
+            cursors[i] = graph->edge_offsets[i];
+        }
+
+        for (size_t i = 0; i < num_threads; i++)
+        {
+            workers[i].cursors = cursors;
+            workers[i].first_node = node_count * i / num_threads;
+            workers[i].last_node = node_count * (i + 1) / num_threads;
+        }
+
+        RunPhase(workers, num_threads, PHASE_SCATTER);
+
+        // Scattering order depends on thread timing, sorting makes the
+        // adjacency deterministic.
+        RunPhase(workers, num_threads, PHASE_SORT);
+
+        free(cursors);
+    }
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        free(workers[i].edges);
+    }
+    free(workers);
+
+    return graph;
+}
+
+static bool ReadDimacsNodeCount(const char *data, size_t size, size_t *node_count)
+{
+    const char *p = data;
+    const char *end = data + size;
+
+    while (p < end)
+    {
+        const char *line_end = (const char *)memchr(p, '\n', end - p);
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        if (*p == 'p')
+        {
+            char header[128];
+            size_t length = (size_t)(line_end - p);
+            if (length > sizeof(header) - 1)
+            {
+                length = sizeof(header) - 1;
+            }
+            memcpy(header, p, length);
+            header[length] = '\0';
+
+            unsigned long nodes, arcs;
+            if (sscanf(header, "p sp %lu %lu", &nodes, &arcs) == 2)
+            {
+                *node_count = nodes;
+                return true;
+            }
+        }
+        else if (*p == 'a')
+        {
+            break; // the problem line precedes all arcs
+        }
+
+        p = line_end + 1;
+    }
+
+    return false;
+}
+
+static void RunPhase(loader_worker_t *workers, size_t num_threads, load_phase_t phase)
+{
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(threads, "threads");
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        workers[i].phase = phase;
+
+        if (0 != pthread_create(threads+i, NULL, LoaderThreadMain, (void *)(workers+i)))
+        {
+            fprintf(stderr, "Error creating a thread: %zu.\n", i);
+            exit(1);
+        }
+    }
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
+
+static void * LoaderThreadMain(void *args)
+{
+    loader_worker_t *worker = (loader_worker_t *)args;
+
+    switch (worker->phase)
+    {
+    case PHASE_PARSE:
+        ParseChunk(worker);
+        break;
+    case PHASE_COUNT:
+        CountDegrees(worker);
+        break;
+    case PHASE_SCATTER:
+        ScatterEdges(worker);
+        break;
+    case PHASE_SORT:
+        SortAdjacency(worker);
+        break;
+    }
+
+    return NULL;
+}
+
+static inline const char * SkipBlanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+// NULL if there is no number or it is above limit.
+static inline const char * ParseNumber(const char *p, const char *end, unsigned long limit, unsigned long *value)
+{
+    p = SkipBlanks(p, end);
+
+    if (p == end || *p < '0' || *p > '9')
+    {
+        return NULL;
+    }
+
+    unsigned long result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        unsigned long digit = (unsigned long)(*p - '0');
+        if (result > (limit - digit) / 10)
+        {
+            return NULL;
+        }
+
+        result = result * 10 + digit;
+        p++;
+    }
+
+    *value = result;
+    return p;
+}
+
+static void ParseChunk(loader_worker_t *worker)
+{
+    const char *p = worker->begin;
+    const char *end = worker->end;
+
+    // UINT_MAX stands for no node in the searches, DIMACS ids are 1-based.
+    unsigned long id_limit = worker->dimacs ? UINT_MAX : UINT_MAX - 1;
+
+    while (p < end)
+    {
+        const char *line_end = (const char *)memchr(p, '\n', end - p);
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        const char *line = p;
+        const char *q = SkipBlanks(p, line_end);
+        p = line_end + 1;
+
+        if (q == line_end || *q == '#' || *q == '%')
+        {
+            continue;
+        }
+
+        if (worker->dimacs)
+        {
+            if (*q != 'a')
+            {
+                continue; // comment and problem lines
+            }
+
+            q++;
+        }
+
+        unsigned long from, to, weight = 1;
+        if ((q = ParseNumber(q, line_end, id_limit, &from)) == NULL ||
+            (q = ParseNumber(q, line_end, id_limit, &to)) == NULL)
+        {
+            worker->error = "missing or out of range node id";
+            worker->error_line = line;
+            return;
+        }
+
+        // Only an edge list line may end after the two nodes.
+        q = SkipBlanks(q, line_end);
+        if ((q < line_end || worker->dimacs) && ParseNumber(q, line_end, INT_MAX, &weight) == NULL)
+        {
+            worker->error = q == line_end ? "missing weight" :
+                            *q == '-' ? "negative weight" : "malformed or out of range weight";
+            worker->error_line = line;
+            return;
+        }
+
+        if (worker->dimacs)
+        {
+            if (from == 0 || to == 0)
+            {
+                worker->error = "DIMACS node ids start at 1";
+                worker->error_line = line;
+                return;
+            }
+
+            from--;
+            to--;
+        }
+
+        if (worker->edge_count == worker->edge_capacity)
+        {
+            worker->edge_capacity = worker->edge_capacity > 0 ? 2 * worker->edge_capacity : 4096;
+            worker->edges = (edge_t *)realloc(worker->edges, worker->edge_capacity * sizeof(edge_t));
+            ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(worker->edges, "worker->edges");
+        }
+
+        edge_t *edge = worker->edges + worker->edge_count++;
+        edge->from = (unsigned int)from;
+        edge->to = (unsigned int)to;
+        edge->weight = (int)weight;
+
+        if (edge->from > worker->max_node)
+        {
+            worker->max_node = edge->from;
+        }
+        if (edge->to > worker->max_node)
+        {
+            worker->max_node = edge->to;
+        }
+    }
+}
+
+// 1-based number of the line starting at line.
+static size_t LineNumber(const char *data, const char *line)
+{
+    size_t number = 1;
+    for (const char *p = data; p < line; p++)
+    {
+        number += *p == '\n';
+    }
+
+    return number;
+}
+
+static void CountDegrees(loader_worker_t *worker)
+{
+    size_t *degrees = worker->graph->edge_offsets + 1;
+
+    for (size_t i = 0; i < worker->edge_count; i++)
+    {
+        __atomic_fetch_add(degrees + worker->edges[i].from, 1, __ATOMIC_RELAXED);
+        if (worker->undirected)
+        {
+            __atomic_fetch_add(degrees + worker->edges[i].to, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void ScatterEdges(loader_worker_t *worker)
+{
+    graph_t *graph = worker->graph;
+
+    for (size_t i = 0; i < worker->edge_count; i++)
+    {
+        edge_t *edge = worker->edges + i;
+
+        size_t slot = __atomic_fetch_add(worker->cursors + edge->from, 1, __ATOMIC_RELAXED);
+        graph->edge_targets[slot] = edge->to;
+        graph->edge_weights[slot] = edge->weight;
+
+        if (worker->undirected)
+        {
+            slot = __atomic_fetch_add(worker->cursors + edge->to, 1, __ATOMIC_RELAXED);
+            graph->edge_targets[slot] = edge->from;
+            graph->edge_weights[slot] = edge->weight;
+        }
+    }
+}
+
+static void SortAdjacency(loader_worker_t *worker)
+{
+    graph_t *graph = worker->graph;
+    adjacency_item_t *items = NULL;
+    size_t items_capacity = 0;
+
+    for (size_t node = worker->first_node; node < worker->last_node; node++)
+    {
+        size_t first = graph->edge_offsets[node];
+        size_t degree = graph->edge_offsets[node + 1] - first;
+        unsigned int *targets = graph->edge_targets + first;
+        int *weights = graph->edge_weights + first;
+
+        if (degree <= INSERTION_SORT_DEGREE)
+        {
+            for (size_t i = 1; i < degree; i++)
+            {
+                unsigned int target = targets[i];
+                int weight = weights[i];
+                size_t j = i;
+
+                while (j > 0 && (targets[j - 1] > target || (targets[j - 1] == target && weights[j - 1] > weight)))
+                {
+                    targets[j] = targets[j - 1];
+                    weights[j] = weights[j - 1];
+                    j--;
+                }
+
+                targets[j] = target;
+                weights[j] = weight;
+            }
+
+            continue;
+        }
+
+        if (degree > items_capacity)
+        {
+            items_capacity = degree;
+            items = (adjacency_item_t *)realloc(items, items_capacity * sizeof(adjacency_item_t));
+            ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(items, "items");
+        }
+
+        for (size_t i = 0; i < degree; i++)
+        {
+            items[i].target = targets[i];
+            items[i].weight = weights[i];
+        }
+
+        qsort(items, degree, sizeof(adjacency_item_t), CompareAdjacencyItems);
+
+        for (size_t i = 0; i < degree; i++)
+        {
+            targets[i] = items[i].target;
+            weights[i] = items[i].weight;
+        }
+    }
+
+    free(items);
+}
+
+static int CompareAdjacencyItems(const void *a, const void *b)
+{
+    const adjacency_item_t *x = (const adjacency_item_t *)a;
+    const adjacency_item_t *y = (const adjacency_item_t *)b;
+
+    if (x->target != y->target)
+    {
+        return x->target < y->target ? -1 : 1;
+    }
+
+    return (x->weight > y->weight) - (x->weight < y->weight);
+}
+
+static graph_t * MapBinaryGraph(const char *path)
+{
+    if (sizeof(size_t) != sizeof(uint64_t))
+    {
+        fprintf(stderr, "Binary graphs require 64-bit offsets.\n");
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot open graph file %s.\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(graph_file_header_t))
+    {
+        fprintf(stderr, "Graph file %s is too short.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map graph file %s.\n", path);
+        return NULL;
+    }
+
+    const graph_file_header_t *header = (const graph_file_header_t *)data;
+    if (!BinaryGraphFits(header, size))
+    {
+        fprintf(stderr, "Graph file %s is not a valid binary graph.\n", path);
+        munmap(data, size);
+        return NULL;
+    }
+
+    // Searches touch the arrays almost at random, ask for them up front.
+    madvise(data, size, MADV_WILLNEED);
+
+    char *base = (char *)data + sizeof(graph_file_header_t);
+    size_t offsets_bytes = (header->node_count + 1) * sizeof(uint64_t);
+    size_t targets_bytes = Padded(header->edge_count * sizeof(uint32_t));
+
+    if (!BinaryGraphConsistent((const uint64_t *)base, (const uint32_t *)(base + offsets_bytes),
+                               (const int32_t *)(base + offsets_bytes + targets_bytes), header->node_count,
+                               header->edge_count))
+    {
+        fprintf(stderr, "Graph file %s has inconsistent edge arrays.\n", path);
+        munmap(data, size);
+        return NULL;
+    }
+
+    graph_t *graph = (graph_t *)calloc(1, sizeof(graph_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(graph, "graph");
+    graph->node_count = header->node_count;
+    graph->edge_count = header->edge_count;
+    graph->edge_offsets = (size_t *)base;
+    graph->edge_targets = (unsigned int *)(base + offsets_bytes);
+    graph->edge_weights = (int *)(base + offsets_bytes + targets_bytes);
+    graph->mapping = data;
+    graph->mapping_size = size;
+
+    return graph;
+}
+
+// The magic matches and the file holds the arrays of the header counts.
+// The sizes are bounded one array at a time so that none of them overflows.
+static bool BinaryGraphFits(const graph_file_header_t *header, size_t size)
+{
+    if (memcmp(header->magic, GRAPH_FILE_MAGIC, sizeof(header->magic)) != 0 || header->node_count > UINT_MAX)
+    {
+        return false;
+    }
+
+    size_t available = size - sizeof(graph_file_header_t);
+    if (header->node_count >= available / sizeof(uint64_t))
+    {
+        return false;
+    }
+
+    available -= (header->node_count + 1) * sizeof(uint64_t);
+    if (header->edge_count > available / (sizeof(uint32_t) + sizeof(int32_t)))
+    {
+        return false;
+    }
+
+    return Padded(header->edge_count * sizeof(uint32_t)) + header->edge_count * sizeof(int32_t) <= available;
+}
+
+// Offsets run from 0 to edge_count without going back, targets are nodes
+// and weights are not negative, so the searches can trust the arrays.
+static bool BinaryGraphConsistent(const uint64_t *offsets, const uint32_t *targets, const int32_t *weights,
+                                  size_t node_count, size_t edge_count)
+{
+    if (offsets[0] != 0 || offsets[node_count] != edge_count)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < node_count; i++)
+    {
+        if (offsets[i] > offsets[i + 1])
+        {
+            return false;
+        }
+    }
+
+    for (size_t e = 0; e < edge_count; e++)
+    {
+        if (targets[e] >= node_count || weights[e] < 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int SaveGraph(graph_t *graph, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Cannot create graph file %s.\n", path);
+        return FAILURE;
+    }
+
+    graph_file_header_t header;
+    memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof(header.magic));
+    header.node_count = graph->node_count;
+    header.edge_count = graph->edge_count;
+
+    size_t targets_bytes = graph->edge_count * sizeof(uint32_t);
+    uint64_t padding = 0;
+
+    bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(graph->edge_offsets, sizeof(uint64_t), graph->node_count + 1, file) == graph->node_count + 1 &&
+        fwrite(graph->edge_targets, sizeof(uint32_t), graph->edge_count, file) == graph->edge_count &&
+        fwrite(&padding, 1, Padded(targets_bytes) - targets_bytes, file) == Padded(targets_bytes) - targets_bytes &&
+        fwrite(graph->edge_weights, sizeof(int32_t), graph->edge_count, file) == graph->edge_count;
+
+    if (fclose(file) != 0 || !written)
+    {
+        fprintf(stderr, "Error writing graph file %s.\n", path);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+void DestroyGraph(graph_t *graph)
+{
+    if (graph->mapping != NULL)
+    {
+        munmap(graph->mapping, graph->mapping_size);
+    }
+    else
+    {
+        free(graph->edge_weights);
+        free(graph->edge_targets);
+        free(graph->edge_offsets);
+    }
+
+    free(graph);
+}
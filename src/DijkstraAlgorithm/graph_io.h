@@ -0,0 +1,31 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include "typedefs.h"
+
+#define GRAPH_FILE_MAGIC "PTGRAPH1"
+
+// Binary graph file layout, usable in place once mapped:
+//   header
+//   uint64_t edge_offsets[node_count + 1]
+//   uint32_t edge_targets[edge_count], zero padded to 8 bytes
+//   int32_t  edge_weights[edge_count]
+typedef struct graph_file_header_t
+{
+    char magic[8];
+    uint64_t node_count;
+    uint64_t edge_count;
+} graph_file_header_t;
+
+// Loads a graph by file extension: ".gr" - DIMACS shortest path arcs
+// ("a u v w", 1-based), ".bin" - binary graph (mapped, not copied), anything
+// else - edge list ("u v [w]" per line, 0-based, undirected, weight 1 if
+// missing). Text files are parsed by num_threads threads. The searches expect
+// every edge to be present in both directions, as in DIMACS road graphs.
+graph_t * LoadGraph(const char *path, size_t num_threads);
+int SaveGraph(graph_t *graph, const char *path);
+void DestroyGraph(graph_t *graph);
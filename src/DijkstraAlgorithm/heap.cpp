@@ -0,0 +1,108 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "typedefs.h"
+#include "heap.h"
+
+heap_t * CreateHeap(size_t capacity)
+{
+    heap_t *heap = (heap_t *)calloc(1, sizeof(heap_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(heap, "heap");
+
+    heap->capacity = capacity > 0 ? capacity : 1;
+    heap->items = (heap_item_t *)malloc(heap->capacity * sizeof(heap_item_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(heap->items, "heap->items");
+
+    return heap;
+}
+
+void DestroyHeap(heap_t *heap)
+{
+    if (heap == NULL)
+    {
+        return;
+    }
+
+    free(heap->items);
+    free(heap);
+}
+
+void ClearHeap(heap_t *heap)
+{
+    heap->size = 0;
+}
+
+bool HeapEmpty(heap_t *heap)
+{
+    return heap->size == 0;
+}
+
+int HeapTopKey(heap_t *heap)
+{
+    return heap->items[0].key;
+}
+
+void HeapPush(heap_t *heap, int key, unsigned int node)
+{
+    if (heap->size == heap->capacity)
+    {
+        heap->capacity *= 2;
+        heap->items = (heap_item_t *)realloc(heap->items, heap->capacity * sizeof(heap_item_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(heap->items, "heap->items");
+    }
+
+    size_t i = heap->size++;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].key <= key)
+        {
+            break;
+        }
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+
+    heap->items[i].key = key;
+    heap->items[i].node = node;
+}
+
+heap_item_t HeapPop(heap_t *heap)
+{
+    heap_item_t top = heap->items[0];
+    heap_item_t last = heap->items[--heap->size];
+
+    size_t i = 0;
+    while (true)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->size)
+        {
+            break;
+        }
+
+        if (child + 1 < heap->size && heap->items[child + 1].key < heap->items[child].key)
+        {
+            child++;
+        }
+
+        if (last.key <= heap->items[child].key)
+        {
+            break;
+        }
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+
+    if (heap->size > 0)
+    {
+        heap->items[i] = last;
+    }
+
+    return top;
+}
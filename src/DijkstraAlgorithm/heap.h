@@ -0,0 +1,31 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#pragma once
+
+#include <stdlib.h>
+
+// Binary min-heap of (key, node) pairs. Decrease-key is done lazily: a node is
+// pushed again with the smaller key and stale entries are skipped on pop.
+
+typedef struct heap_item_t
+{
+    int key;
+    unsigned int node;
+} heap_item_t;
+
+typedef struct heap_t
+{
+    size_t size;
+    size_t capacity;
+    heap_item_t *items;
+} heap_t;
+
+heap_t * CreateHeap(size_t capacity);
+void DestroyHeap(heap_t *heap);
+void ClearHeap(heap_t *heap);
+bool HeapEmpty(heap_t *heap);
+int HeapTopKey(heap_t *heap);
+void HeapPush(heap_t *heap, int key, unsigned int node);
+heap_item_t HeapPop(heap_t *heap);
@@ -0,0 +1,423 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include "typedefs.h"
+#include "search.h"
+
+#define NO_TARGET UINT_MAX // run the search until every reachable node is settled
+
+typedef struct bidirectional_shared_t
+{
+    pthread_mutex_t mutex; // protects best
+    int best;              // shortest path length found so far, UNREACHED if none
+    int radius[2];         // distance of the node each side settled last
+    bool done;
+} bidirectional_shared_t;
+
+typedef struct bidirectional_side_t
+{
+    graph_t *graph;
+    search_state_t *state;
+    search_state_t *other;
+    unsigned int origin;
+    int side;
+    bidirectional_shared_t *shared;
+} bidirectional_side_t;
+
+typedef struct landmark_worker_t
+{
+    graph_t *graph;
+    landmarks_t *landmarks;
+    size_t tid;
+    size_t num_threads;
+} landmark_worker_t;
+
+static int RunSearch(graph_t *graph, search_state_t *state, unsigned int source, unsigned int target,
+                     heuristic_t *heuristic);
+static void * BidirectionalThreadMain(void *args);
+static void ScanNode(bidirectional_side_t *side, unsigned int node);
+static void OfferMeeting(bidirectional_shared_t *shared, int length);
+static void * LandmarkThreadMain(void *args);
+
+search_state_t * CreateSearchState(size_t node_count)
+{
+    search_state_t *state = (search_state_t *)calloc(1, sizeof(search_state_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(state, "state");
+
+    state->node_count = node_count;
+    state->dist = (int *)malloc(node_count * sizeof(int));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(state->dist, "state->dist");
+    state->reached = (unsigned int *)calloc(node_count, sizeof(unsigned int));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(state->reached, "state->reached");
+    state->settled = (unsigned int *)calloc(node_count, sizeof(unsigned int));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(state->settled, "state->settled");
+    state->heap = CreateHeap(node_count);
+
+    ResetSearchState(state);
+
+    return state;
+}
+
+void DestroySearchState(search_state_t *state)
+{
+    if (state == NULL)
+    {
+        return;
+    }
+
+    DestroyHeap(state->heap);
+    free(state->settled);
+    free(state->reached);
+    free(state->dist);
+    free(state);
+}
+
+void ResetSearchState(search_state_t *state)
+{
+    state->epoch++;
+
+    // Stamps are only cleared when the epoch counter wraps around.
+    if (state->epoch == 0)
+    {
+        for (size_t i = 0; i < state->node_count; i++)
+        {
+            state->reached[i] = 0;
+            state->settled[i] = 0;
+        }
+
+        state->epoch = 1;
+    }
+
+    ClearHeap(state->heap);
+    state->settled_count = 0;
+}
+
+int DijkstraSearch(graph_t *graph, search_state_t *state, unsigned int source, unsigned int target)
+{
+    return RunSearch(graph, state, source, target, NULL);
+}
+
+int AStarSearch(graph_t *graph, search_state_t *state, unsigned int source, unsigned int target,
+                heuristic_t *heuristic)
+{
+    return RunSearch(graph, state, source, target, heuristic);
+}
+
+static int RunSearch(graph_t *graph, search_state_t *state, unsigned int source, unsigned int target,
+                     heuristic_t *heuristic)
+{
+    ResetSearchState(state);
+
+    SetDist(state, source, 0);
+    HeapPush(state->heap, heuristic ? heuristic->estimate(heuristic->context, source) : 0, source);
+
+    while (!HeapEmpty(state->heap))
+    {
+        unsigned int u = HeapPop(state->heap).node;
+
+        // With a consistent heuristic the first pop of a node carries its final
+        // distance, later (stale) entries are skipped.
+        if (IsSettled(state, u))
+        {
+            continue;
+        }
+
+        MarkSettled(state, u);
+
+        int dist_u = state->dist[u];
+        if (u == target)
+        {
+            return dist_u;
+        }
+
+        for (size_t e = graph->edge_offsets[u]; e < graph->edge_offsets[u + 1]; e++)
+        {
+            unsigned int v = graph->edge_targets[e];
+            if (IsSettled(state, v))
+            {
+                continue;
+            }
+
+            int dist_to_node = dist_u + graph->edge_weights[e];
+            int dist_v = GetDist(state, v);
+            if (dist_v == UNREACHED || dist_to_node < dist_v)
+            {
+                SetDist(state, v, dist_to_node);
+                int key = dist_to_node + (heuristic ? heuristic->estimate(heuristic->context, v) : 0);
+                HeapPush(state->heap, key, v);
+            }
+        }
+    }
+
+    return target == NO_TARGET ? 0 : UNREACHED;
+}
+
+// Forward search from the source and backward search from the target run on
+// their own threads. Whenever a side settles a node it checks the other side's
+// settled nodes for a meeting point; the searches stop once the sum of both
+// search radii reaches the best meeting found.
+int BidirectionalSearch(graph_t *graph, search_state_t *forward, search_state_t *backward,
+                        unsigned int source, unsigned int target)
+{
+    bidirectional_shared_t shared;
+    pthread_mutex_init(&shared.mutex, NULL);
+    shared.best = UNREACHED;
+    shared.radius[0] = 0;
+    shared.radius[1] = 0;
+    shared.done = false;
+
+    bidirectional_side_t sides[2] = {
+        { graph, forward, backward, source, 0, &shared },
+        { graph, backward, forward, target, 1, &shared }
+    };
+
+    // Both origins are settled before the threads start so that a side which
+    // exhausts its component early still sees the other origin.
+    for (int i = 0; i < 2; i++)
+    {
+        ResetSearchState(sides[i].state);
+        SetDist(sides[i].state, sides[i].origin, 0);
+        MarkSettled(sides[i].state, sides[i].origin);
+    }
+
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++)
+    {
+        if (0 != pthread_create(threads+i, NULL, BidirectionalThreadMain, (void *)(sides+i)))
+        {
+            fprintf(stderr, "Error creating a thread: %i.\n", i);
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&shared.mutex);
+
+    return shared.best;
+}
+
+static void * BidirectionalThreadMain(void *args)
+{
+    bidirectional_side_t *side = (bidirectional_side_t *)args;
+    bidirectional_shared_t *shared = side->shared;
+    search_state_t *state = side->state;
+
+    ScanNode(side, side->origin);
+
+    while (!__atomic_load_n(&shared->done, __ATOMIC_SEQ_CST))
+    {
+        if (HeapEmpty(state->heap))
+        {
+            // The whole component of the origin is settled, any meeting point
+            // has been seen already.
+            __atomic_store_n(&shared->done, true, __ATOMIC_SEQ_CST);
+            break;
+        }
+
+        unsigned int u = HeapPop(state->heap).node;
+        if (IsSettled(state, u))
+        {
+            continue;
+        }
+
+        int radius = state->dist[u];
+        __atomic_store_n(&shared->radius[side->side], radius, __ATOMIC_SEQ_CST);
+        int other_radius = __atomic_load_n(&shared->radius[1 - side->side], __ATOMIC_SEQ_CST);
+
+        pthread_mutex_lock(&shared->mutex);
+        int best = shared->best;
+        pthread_mutex_unlock(&shared->mutex);
+
+        if (best != UNREACHED && radius + other_radius >= best)
+        {
+            __atomic_store_n(&shared->done, true, __ATOMIC_SEQ_CST);
+            break;
+        }
+
+        __atomic_store_n(&state->settled[u], state->epoch, __ATOMIC_SEQ_CST);
+        state->settled_count++;
+
+        ScanNode(side, u);
+    }
+
+    return NULL;
+}
+
+static void ScanNode(bidirectional_side_t *side, unsigned int u)
+{
+    search_state_t *state = side->state;
+    search_state_t *other = side->other;
+    graph_t *graph = side->graph;
+    int dist_u = state->dist[u];
+
+    // Distances of nodes settled by the other side are final, so they can be
+    // read without holding the lock.
+    if (__atomic_load_n(&other->settled[u], __ATOMIC_SEQ_CST) == other->epoch)
+    {
+        OfferMeeting(side->shared, dist_u + other->dist[u]);
+    }
+
+    for (size_t e = graph->edge_offsets[u]; e < graph->edge_offsets[u + 1]; e++)
+    {
+        unsigned int v = graph->edge_targets[e];
+        int dist_to_node = dist_u + graph->edge_weights[e];
+
+        if (__atomic_load_n(&other->settled[v], __ATOMIC_SEQ_CST) == other->epoch)
+        {
+            OfferMeeting(side->shared, dist_to_node + other->dist[v]);
+        }
+
+        if (IsSettled(state, v))
+        {
+            continue;
+        }
+
+        int dist_v = GetDist(state, v);
+        if (dist_v == UNREACHED || dist_to_node < dist_v)
+        {
+            SetDist(state, v, dist_to_node);
+            HeapPush(state->heap, dist_to_node, v);
+        }
+    }
+}
+
+static void OfferMeeting(bidirectional_shared_t *shared, int length)
+{
+    pthread_mutex_lock(&shared->mutex);
+    if (shared->best == UNREACHED || length < shared->best)
+    {
+        shared->best = length;
+    }
+    pthread_mutex_unlock(&shared->mutex);
+}
+
+int ZeroHeuristic(void *, unsigned int)
+{
+    return 0;
+}
+
+// ALT lower bound: by the triangle inequality |d(L, t) - d(L, v)| <= d(v, t)
+// for every landmark L of an undirected graph.
+int LandmarkHeuristic(void *context, unsigned int node)
+{
+    landmark_query_t *query = (landmark_query_t *)context;
+    landmarks_t *landmarks = query->landmarks;
+    int estimate = 0;
+
+    for (size_t i = 0; i < landmarks->count; i++)
+    {
+        int to_target = landmarks->dist[i][query->target];
+        int to_node = landmarks->dist[i][node];
+
+        if (to_target == UNREACHED || to_node == UNREACHED)
+        {
+            continue;
+        }
+
+        int bound = abs(to_target - to_node);
+        if (bound > estimate)
+        {
+            estimate = bound;
+        }
+    }
+
+    return estimate;
+}
+
+landmarks_t * CreateLandmarks(graph_t *graph, size_t count, size_t num_threads)
+{
+    landmarks_t *landmarks = (landmarks_t *)calloc(1, sizeof(landmarks_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(landmarks, "landmarks");
+
+    landmarks->count = count;
+    landmarks->nodes = (unsigned int *)calloc(count, sizeof(unsigned int));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(landmarks->nodes, "landmarks->nodes");
+    landmarks->dist = (int **)calloc(count, sizeof(int *));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(landmarks->dist, "landmarks->dist");
+
+    for (size_t i = 0; i < count; i++)
+    {
+        landmarks->nodes[i] = rand() % graph->node_count;
+        landmarks->dist[i] = (int *)malloc(graph->node_count * sizeof(int));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(landmarks->dist[i], "landmarks->dist[i]");
+    }
+
+    if (num_threads > count)
+    {
+        num_threads = count;
+    }
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+    landmark_worker_t *workers = (landmark_worker_t *)malloc(sizeof(landmark_worker_t) * num_threads);
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        workers[i].graph = graph;
+        workers[i].landmarks = landmarks;
+        workers[i].tid = i;
+        workers[i].num_threads = num_threads;
+
+        if (0 != pthread_create(threads+i, NULL, LandmarkThreadMain, (void *)(workers+i)))
+        {
+            fprintf(stderr, "Error creating a thread: %zu.\n", i);
+            exit(1);
+        }
+    }
+
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(workers);
+    free(threads);
+
+    return landmarks;
+}
+
+static void * LandmarkThreadMain(void *args)
+{
+    landmark_worker_t *worker = (landmark_worker_t *)args;
+    landmarks_t *landmarks = worker->landmarks;
+    search_state_t *state = CreateSearchState(worker->graph->node_count);
+
+    for (size_t i = worker->tid; i < landmarks->count; i += worker->num_threads)
+    {
+        RunSearch(worker->graph, state, landmarks->nodes[i], NO_TARGET, NULL);
+
+        for (size_t j = 0; j < worker->graph->node_count; j++)
+        {
+            landmarks->dist[i][j] = GetDist(state, (unsigned int)j);
+        }
+    }
+
+    DestroySearchState(state);
+
+    return NULL;
+}
+
+void DestroyLandmarks(landmarks_t *landmarks)
+{
+    if (landmarks == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < landmarks->count; i++)
+    {
+        free(landmarks->dist[i]);
+    }
+
+    free(landmarks->dist);
+    free(landmarks->nodes);
+    free(landmarks);
+}
@@ -0,0 +1,87 @@
+/**
+* Programa: Dijkstra algorithm
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "heap.h"
+
+#define UNREACHED -1 // distance of a node the search has not reached
+
+// Per-query search state, kept outside of the graph so that several searches
+// can run over the same graph at once. Entries are valid only when their stamp
+// equals the current epoch, so starting a new query is O(1) instead of O(V).
+typedef struct search_state_t
+{
+    size_t node_count;
+    unsigned int epoch;
+    int *dist;
+    unsigned int *reached; // epoch in which dist was last written
+    unsigned int *settled; // epoch in which the node was settled
+    heap_t *heap;
+    size_t settled_count; // nodes settled by the last search
+} search_state_t;
+
+// A* heuristic: lower bound on the distance from node to the query target.
+// Must be consistent (h(u) <= w(u, v) + h(v)) for A* to return shortest paths.
+typedef int (*heuristic_func_t)(void *context, unsigned int node);
+
+typedef struct heuristic_t
+{
+    heuristic_func_t estimate;
+    void *context;
+} heuristic_t;
+
+// ALT heuristic data: exact distances from a few landmark nodes to every node.
+typedef struct landmarks_t
+{
+    size_t count;
+    unsigned int *nodes;
+    int **dist;
+} landmarks_t;
+
+// LandmarkHeuristic context, one per query.
+typedef struct landmark_query_t
+{
+    landmarks_t *landmarks;
+    unsigned int target;
+} landmark_query_t;
+
+search_state_t * CreateSearchState(size_t node_count);
+void DestroySearchState(search_state_t *state);
+void ResetSearchState(search_state_t *state);
+
+static inline int GetDist(search_state_t *state, unsigned int node)
+{
+    return state->reached[node] == state->epoch ? state->dist[node] : UNREACHED;
+}
+
+static inline void SetDist(search_state_t *state, unsigned int node, int dist)
+{
+    state->dist[node] = dist;
+    state->reached[node] = state->epoch;
+}
+
+static inline bool IsSettled(search_state_t *state, unsigned int node)
+{
+    return state->settled[node] == state->epoch;
+}
+
+static inline void MarkSettled(search_state_t *state, unsigned int node)
+{
+    state->settled[node] = state->epoch;
+    state->settled_count++;
+}
+
+int DijkstraSearch(graph_t *graph, search_state_t *state, unsigned int source, unsigned int target);
+int AStarSearch(graph_t *graph, search_state_t *state, unsigned int source, unsigned int target,
+                heuristic_t *heuristic);
+int BidirectionalSearch(graph_t *graph, search_state_t *forward, search_state_t *backward,
+                        unsigned int source, unsigned int target);
+
+int ZeroHeuristic(void *context, unsigned int node);
+int LandmarkHeuristic(void *context, unsigned int node);
+
+landmarks_t * CreateLandmarks(graph_t *graph, size_t count, size_t num_threads);
+void DestroyLandmarks(landmarks_t *landmarks);
@@ -16,27 +16,17 @@
 #define SUCCESS 0
 #define FAILURE 1
 
-typedef struct node_t;
-
-typedef struct path_t
-{
-    int dist;
-    node_t *a;
-    node_t *b;
-} path_t;
-
-typedef struct node_t
-{
-    bool in_graph;
-    unsigned int node_num;
-    int dist;
-    size_t path_count;
-    path_t **paths;
-} node_t;
-
+// Immutable graph in compressed sparse row form. Edges of node i are
+// edge_targets/edge_weights[edge_offsets[i] .. edge_offsets[i+1]), every
+// undirected path is stored once in each direction. Search state is kept
+// outside of the graph (see search_state_t) so queries can share it.
 typedef struct graph_t
 {
     size_t node_count;
-    node_t *nodes;
-    path_t ***paths;
+    size_t edge_count;
+    size_t *edge_offsets;
+    unsigned int *edge_targets;
+    int *edge_weights;
+    void *mapping;       // binary graph file the arrays point into, NULL if allocated
+    size_t mapping_size;
 } graph_t;
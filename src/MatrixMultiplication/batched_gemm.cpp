@@ -0,0 +1,477 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "matrix.h"
+#include "batched_gemm.h"
+
+typedef struct batch_job_t
+{
+    const batched_gemm_t *gemm;
+    const matrix_batch_t *a, *b;
+    matrix_batch_t *c;
+    size_t num_threads;
+} batch_job_t;
+
+static void ScalarBatchGroup(size_t m, size_t n, size_t p, const double *a, const double *b, double *c);
+static void RunGroups(const batched_gemm_t *gemm, const matrix_batch_t *a, const matrix_batch_t *b,
+                      matrix_batch_t *c, size_t group_start, size_t group_end);
+static void BatchJob(void *args, size_t tid);
+
+matrix_batch_t * CreateMatrixBatch(size_t count, size_t rows, size_t columns)
+{
+    matrix_batch_t *batch = (matrix_batch_t *)malloc(sizeof(matrix_batch_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(batch, "batch");
+
+    batch->count = count;
+    batch->rows = rows;
+    batch->columns = columns;
+    batch->groups = (count + BATCH_LANES - 1) / BATCH_LANES;
+    batch->data = AllocateAligned(batch->groups * rows * columns * BATCH_LANES);
+
+    return batch;
+}
+
+void DestroyMatrixBatch(matrix_batch_t *batch)
+{
+    if (batch == NULL)
+    {
+        return;
+    }
+
+    free(batch->data);
+    free(batch);
+}
+
+void SetBatchMatrix(matrix_batch_t *batch, size_t index, const double *matrix, size_t ld)
+{
+    for (size_t i = 0; i < batch->rows; i++)
+    {
+        for (size_t j = 0; j < batch->columns; j++)
+        {
+            *BatchElement(batch, index, i, j) = matrix[i * ld + j];
+        }
+    }
+}
+
+void GetBatchMatrix(const matrix_batch_t *batch, size_t index, double *matrix, size_t ld)
+{
+    for (size_t i = 0; i < batch->rows; i++)
+    {
+        for (size_t j = 0; j < batch->columns; j++)
+        {
+            matrix[i * ld + j] = *BatchElement(batch, index, i, j);
+        }
+    }
+}
+
+// Lane l of every element belongs to matrix l of the group, the innermost
+// loop runs over the lanes and is left to the compiler to vectorize.
+static void ScalarBatchGroup(size_t m, size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t j = 0; j < p; j++)
+        {
+            double sum[BATCH_LANES] = { 0 };
+
+            for (size_t k = 0; k < n; k++)
+            {
+                const double *x = a + (i * n + k) * BATCH_LANES;
+                const double *y = b + (k * p + j) * BATCH_LANES;
+                for (size_t l = 0; l < BATCH_LANES; l++)
+                {
+                    sum[l] += x[l] * y[l];
+                }
+            }
+
+            memcpy(c + (i * p + j) * BATCH_LANES, sum, sizeof(sum));
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// One register holds an element of all the matrices of a group. A TI x TJ
+// tile of C stays in registers over the whole depth; every k loads TI
+// elements of A and TJ of B for TI x TJ multiply-adds. Groups are a whole
+// number of cache lines, so every access is aligned.
+
+#define AVX512_BATCH_TILE 4
+
+template <size_t TI, size_t TJ>
+__attribute__((target("avx512f"), always_inline))
+static inline void Avx512BatchTile(size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    __m512d tile[TI][TJ];
+
+#pragma GCC unroll 4
+    for (size_t i = 0; i < TI; i++)
+    {
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            tile[i][j] = _mm512_setzero_pd();
+        }
+    }
+
+    for (size_t k = 0; k < n; k++)
+    {
+        __m512d row[TJ];
+
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            row[j] = _mm512_load_pd(b + (k * p + j) * BATCH_LANES);
+        }
+
+#pragma GCC unroll 4
+        for (size_t i = 0; i < TI; i++)
+        {
+            __m512d x = _mm512_load_pd(a + (i * n + k) * BATCH_LANES);
+
+#pragma GCC unroll 4
+            for (size_t j = 0; j < TJ; j++)
+            {
+                tile[i][j] = _mm512_fmadd_pd(x, row[j], tile[i][j]);
+            }
+        }
+    }
+
+#pragma GCC unroll 4
+    for (size_t i = 0; i < TI; i++)
+    {
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            _mm512_store_pd(c + (i * p + j) * BATCH_LANES, tile[i][j]);
+        }
+    }
+}
+
+// TI rows of C, the columns in tiles of AVX512_BATCH_TILE and a narrower
+// one for the rest.
+template <size_t TI>
+__attribute__((target("avx512f"), always_inline))
+static inline void Avx512BatchRows(size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    size_t j = 0;
+    for (; j + AVX512_BATCH_TILE <= p; j += AVX512_BATCH_TILE)
+    {
+        Avx512BatchTile<TI, AVX512_BATCH_TILE>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+    }
+
+    switch (p - j)
+    {
+    case 1:
+        Avx512BatchTile<TI, 1>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+        break;
+    case 2:
+        Avx512BatchTile<TI, 2>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+        break;
+    case 3:
+        Avx512BatchTile<TI, 3>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+        break;
+    }
+}
+
+// M, N and P fix the shape at compile time, 0 leaves the dimension to the
+// arguments. With all three fixed the loops have constant trip counts and
+// the remainder tiles are resolved by the compiler.
+template <size_t M, size_t N, size_t P>
+__attribute__((target("avx512f")))
+static void Avx512BatchGroup(size_t m, size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    const size_t rows = M != 0 ? M : m;
+    const size_t depth = N != 0 ? N : n;
+    const size_t columns = P != 0 ? P : p;
+
+    size_t i = 0;
+    for (; i + AVX512_BATCH_TILE <= rows; i += AVX512_BATCH_TILE)
+    {
+        Avx512BatchRows<AVX512_BATCH_TILE>(depth, columns, a + i * depth * BATCH_LANES, b,
+                                           c + i * columns * BATCH_LANES);
+    }
+
+    switch (rows - i)
+    {
+    case 1:
+        Avx512BatchRows<1>(depth, columns, a + i * depth * BATCH_LANES, b, c + i * columns * BATCH_LANES);
+        break;
+    case 2:
+        Avx512BatchRows<2>(depth, columns, a + i * depth * BATCH_LANES, b, c + i * columns * BATCH_LANES);
+        break;
+    case 3:
+        Avx512BatchRows<3>(depth, columns, a + i * depth * BATCH_LANES, b, c + i * columns * BATCH_LANES);
+        break;
+    }
+}
+
+// Past 16 the loop overhead is lost in the multiply-adds and the runtime
+// sized kernel is as fast.
+typedef struct fixed_batch_kernel_t
+{
+    size_t size; // square matrices of this size
+    batch_group_kernel_t run;
+} fixed_batch_kernel_t;
+
+static const fixed_batch_kernel_t avx512_fixed_kernels[] =
+{
+    { 3, Avx512BatchGroup<3, 3, 3> },
+    { 4, Avx512BatchGroup<4, 4, 4> },
+    { 6, Avx512BatchGroup<6, 6, 6> },
+    { 8, Avx512BatchGroup<8, 8, 8> },
+    { 16, Avx512BatchGroup<16, 16, 16> }
+};
+
+// The AVX2 kernel runs the group as two halves of four lanes, one register
+// each. The tile is narrower than the AVX-512 one: 3 x 3 accumulators, a
+// row of B and an element of A fit the 16 registers.
+
+#define AVX2_BATCH_HALF 4
+#define AVX2_BATCH_TILE 3
+
+template <size_t TI, size_t TJ>
+__attribute__((target("avx2,fma"), always_inline))
+static inline void Avx2BatchTile(size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    __m256d tile[TI][TJ];
+
+#pragma GCC unroll 3
+    for (size_t i = 0; i < TI; i++)
+    {
+#pragma GCC unroll 3
+        for (size_t j = 0; j < TJ; j++)
+        {
+            tile[i][j] = _mm256_setzero_pd();
+        }
+    }
+
+    for (size_t k = 0; k < n; k++)
+    {
+        __m256d row[TJ];
+
+#pragma GCC unroll 3
+        for (size_t j = 0; j < TJ; j++)
+        {
+            row[j] = _mm256_load_pd(b + (k * p + j) * BATCH_LANES);
+        }
+
+#pragma GCC unroll 3
+        for (size_t i = 0; i < TI; i++)
+        {
+            __m256d x = _mm256_load_pd(a + (i * n + k) * BATCH_LANES);
+
+#pragma GCC unroll 3
+            for (size_t j = 0; j < TJ; j++)
+            {
+                tile[i][j] = _mm256_fmadd_pd(x, row[j], tile[i][j]);
+            }
+        }
+    }
+
+#pragma GCC unroll 3
+    for (size_t i = 0; i < TI; i++)
+    {
+#pragma GCC unroll 3
+        for (size_t j = 0; j < TJ; j++)
+        {
+            _mm256_store_pd(c + (i * p + j) * BATCH_LANES, tile[i][j]);
+        }
+    }
+}
+
+template <size_t TI>
+__attribute__((target("avx2,fma"), always_inline))
+static inline void Avx2BatchRows(size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    size_t j = 0;
+    for (; j + AVX2_BATCH_TILE <= p; j += AVX2_BATCH_TILE)
+    {
+        Avx2BatchTile<TI, AVX2_BATCH_TILE>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+    }
+
+    switch (p - j)
+    {
+    case 1:
+        Avx2BatchTile<TI, 1>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+        break;
+    case 2:
+        Avx2BatchTile<TI, 2>(n, p, a, b + j * BATCH_LANES, c + j * BATCH_LANES);
+        break;
+    }
+}
+
+template <size_t M, size_t N, size_t P>
+__attribute__((target("avx2,fma")))
+static void Avx2BatchGroup(size_t m, size_t n, size_t p, const double *a, const double *b, double *c)
+{
+    const size_t rows = M != 0 ? M : m;
+    const size_t depth = N != 0 ? N : n;
+    const size_t columns = P != 0 ? P : p;
+
+    for (size_t h = 0; h < BATCH_LANES; h += AVX2_BATCH_HALF)
+    {
+        size_t i = 0;
+        for (; i + AVX2_BATCH_TILE <= rows; i += AVX2_BATCH_TILE)
+        {
+            Avx2BatchRows<AVX2_BATCH_TILE>(depth, columns, a + i * depth * BATCH_LANES + h, b + h,
+                                           c + i * columns * BATCH_LANES + h);
+        }
+
+        switch (rows - i)
+        {
+        case 1:
+            Avx2BatchRows<1>(depth, columns, a + i * depth * BATCH_LANES + h, b + h,
+                             c + i * columns * BATCH_LANES + h);
+            break;
+        case 2:
+            Avx2BatchRows<2>(depth, columns, a + i * depth * BATCH_LANES + h, b + h,
+                             c + i * columns * BATCH_LANES + h);
+            break;
+        }
+    }
+}
+
+static const fixed_batch_kernel_t avx2_fixed_kernels[] =
+{
+    { 3, Avx2BatchGroup<3, 3, 3> },
+    { 4, Avx2BatchGroup<4, 4, 4> },
+    { 6, Avx2BatchGroup<6, 6, 6> },
+    { 8, Avx2BatchGroup<8, 8, 8> },
+    { 16, Avx2BatchGroup<16, 16, 16> }
+};
+
+// The specialization of kernels for square m x n x p, NULL if there is none.
+static batch_group_kernel_t FindFixedKernel(const fixed_batch_kernel_t *kernels, size_t count, size_t m, size_t n,
+                                            size_t p)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t size = kernels[i].size;
+        if (m == size && n == size && p == size)
+        {
+            return kernels[i].run;
+        }
+    }
+
+    return NULL;
+}
+
+#endif
+
+batched_gemm_t * CreateBatchedGemm(size_t m, size_t n, size_t p, const char *name, thread_pool_t *pool)
+{
+    batch_group_kernel_t run = NULL;
+    bool fixed_size = false;
+
+#if defined(__x86_64__)
+    if ((name == NULL || strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f"))
+    {
+        name = "avx512";
+        run = FindFixedKernel(avx512_fixed_kernels, sizeof(avx512_fixed_kernels) / sizeof(avx512_fixed_kernels[0]),
+                              m, n, p);
+        fixed_size = run != NULL;
+        if (run == NULL)
+        {
+            run = Avx512BatchGroup<0, 0, 0>;
+        }
+    }
+
+    if (run == NULL && (name == NULL || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma"))
+    {
+        name = "avx2";
+        run = FindFixedKernel(avx2_fixed_kernels, sizeof(avx2_fixed_kernels) / sizeof(avx2_fixed_kernels[0]), m, n,
+                              p);
+        fixed_size = run != NULL;
+        if (run == NULL)
+        {
+            run = Avx2BatchGroup<0, 0, 0>;
+        }
+    }
+#endif
+
+    if (run == NULL && (name == NULL || strcmp(name, "scalar") == 0))
+    {
+        name = "scalar";
+        run = ScalarBatchGroup;
+    }
+
+    if (run == NULL)
+    {
+        return NULL;
+    }
+
+    batched_gemm_t *gemm = (batched_gemm_t *)malloc(sizeof(batched_gemm_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm, "gemm");
+
+    gemm->name = name;
+    gemm->fixed_size = fixed_size;
+    gemm->m = m;
+    gemm->n = n;
+    gemm->p = p;
+    gemm->run = run;
+    gemm->pool = pool;
+
+    return gemm;
+}
+
+void DestroyBatchedGemm(batched_gemm_t *gemm)
+{
+    free(gemm);
+}
+
+int BatchedGemm(const batched_gemm_t *gemm, const matrix_batch_t *a, const matrix_batch_t *b, matrix_batch_t *c)
+{
+    if (a->rows != gemm->m || a->columns != gemm->n || b->rows != gemm->n || b->columns != gemm->p ||
+        c->rows != gemm->m || c->columns != gemm->p || a->count != c->count || b->count != c->count)
+    {
+        return FAILURE;
+    }
+
+    // Waking the workers costs microseconds, more than small batches take.
+    size_t work = c->groups * BATCH_LANES * gemm->m * gemm->n * gemm->p;
+    if (gemm->pool == NULL || gemm->pool->num_threads == 1 || work < BATCH_PARALLEL_WORK)
+    {
+        RunGroups(gemm, a, b, c, 0, c->groups);
+        return SUCCESS;
+    }
+
+    batch_job_t job;
+    job.gemm = gemm;
+    job.a = a;
+    job.b = b;
+    job.c = c;
+    job.num_threads = gemm->pool->num_threads;
+    RunOnThreadPool(gemm->pool, BatchJob, &job);
+
+    return SUCCESS;
+}
+
+static void RunGroups(const batched_gemm_t *gemm, const matrix_batch_t *a, const matrix_batch_t *b,
+                      matrix_batch_t *c, size_t group_start, size_t group_end)
+{
+    size_t m = gemm->m, n = gemm->n, p = gemm->p;
+    size_t a_size = m * n * BATCH_LANES, b_size = n * p * BATCH_LANES, c_size = m * p * BATCH_LANES;
+
+    for (size_t g = group_start; g < group_end; g++)
+    {
+        gemm->run(m, n, p, a->data + g * a_size, b->data + g * b_size, c->data + g * c_size);
+    }
+}
+
+static void BatchJob(void *args, size_t tid)
+{
+    batch_job_t *job = (batch_job_t *)args;
+    size_t groups = job->c->groups;
+
+    RunGroups(job->gemm, job->a, job->b, job->c, groups * tid / job->num_threads,
+              groups * (tid + 1) / job->num_threads);
+}
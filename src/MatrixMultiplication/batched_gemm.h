@@ -0,0 +1,65 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "thread_pool.h"
+
+#define BATCH_LANES 8 // matrices interleaved in a group, one AVX-512 register of doubles
+#define BATCH_PARALLEL_WORK (1 << 20) // multiply-adds below which a batch runs on the calling thread
+
+// Batch of count equally sized matrices in the interleaved layout: the
+// matrices form groups of BATCH_LANES, and a group stores element (i, j) of
+// its matrices next to each other. The kernels then run BATCH_LANES
+// multiplications at once, one per vector lane, whatever the matrix size,
+// and need neither packing nor edge handling. The lanes past count in the
+// last group are zero.
+typedef struct matrix_batch_t
+{
+    size_t count;
+    size_t rows, columns;
+    size_t groups; // count / BATCH_LANES rounded up
+    double *data;  // groups x rows x columns x BATCH_LANES
+} matrix_batch_t;
+
+matrix_batch_t * CreateMatrixBatch(size_t count, size_t rows, size_t columns);
+void DestroyMatrixBatch(matrix_batch_t *batch);
+
+inline double * BatchElement(const matrix_batch_t *batch, size_t index, size_t row, size_t column)
+{
+    return batch->data + ((index / BATCH_LANES * batch->rows + row) * batch->columns + column) * BATCH_LANES
+           + index % BATCH_LANES;
+}
+
+// Copy the row-major matrix with row stride ld into or out of matrix index
+// of the batch.
+void SetBatchMatrix(matrix_batch_t *batch, size_t index, const double *matrix, size_t ld);
+void GetBatchMatrix(const matrix_batch_t *batch, size_t index, double *matrix, size_t ld);
+
+// Computes the BATCH_LANES products C = A B of one group, A being m x n and
+// B n x p.
+typedef void (*batch_group_kernel_t)(size_t m, size_t n, size_t p, const double *a, const double *b, double *c);
+
+// Plan of a batched multiplication: the kernel is picked once, a compile
+// time specialization when the shape is one of the common square sizes, so
+// a call costs a dimension check and the loop over the groups.
+typedef struct batched_gemm_t
+{
+    const char *name; // avx512, avx2 or scalar
+    bool fixed_size;  // run is specialized for m x n x p
+    size_t m, n, p;
+    batch_group_kernel_t run;
+    thread_pool_t *pool; // NULL to always run on the calling thread
+} batched_gemm_t;
+
+// The plan with the kernel named name, or with name NULL the widest one the
+// running CPU supports. NULL if the CPU lacks the named one.
+batched_gemm_t * CreateBatchedGemm(size_t m, size_t n, size_t p, const char *name, thread_pool_t *pool);
+void DestroyBatchedGemm(batched_gemm_t *gemm);
+
+// C[i] = A[i] B[i] for every matrix of the batches. Large batches are split
+// into contiguous ranges of groups, one per pool worker. Returns FAILURE if
+// the batches do not match the plan or each other.
+int BatchedGemm(const batched_gemm_t *gemm, const matrix_batch_t *a, const matrix_batch_t *b, matrix_batch_t *c);
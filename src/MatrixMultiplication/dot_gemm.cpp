@@ -0,0 +1,228 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "dot_gemm.h"
+
+// Dot products of rows [0, rows) of a and [0, columns) of bt over kc
+// elements, written to or added to the rows x columns block at c.
+typedef void (*dot_block_t)(size_t rows, size_t columns, size_t kc, const double *a, size_t lda, const double *bt,
+                            size_t ldb, double *c, size_t ldc, bool accumulate);
+
+static void ScalarDotBlock(size_t rows, size_t columns, size_t kc, const double *a, size_t lda, const double *bt,
+                           size_t ldb, double *c, size_t ldc, bool accumulate);
+
+static void ScalarDotBlock(size_t rows, size_t columns, size_t kc, const double *a, size_t lda, const double *bt,
+                           size_t ldb, double *c, size_t ldc, bool accumulate)
+{
+    for (size_t j = 0; j < columns; j++)
+    {
+        for (size_t i = 0; i < rows; i++)
+        {
+            double sum = 0;
+            for (size_t k = 0; k < kc; k++)
+            {
+                sum += a[i * lda + k] * bt[j * ldb + k];
+            }
+
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + sum : sum;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// A TI x TJ tile of dot products in TI x TJ vector accumulators: every 8
+// elements of depth load TI vectors of A and TJ of bt for TI x TJ
+// multiply-adds, the tail goes through masked loads. The accumulators are
+// summed across their lanes at the end.
+
+#define AVX512_DOT_TILE 4
+
+// Sum of the lanes of v, halves added pairwise as _mm512_reduce_add_pd
+// does. The lanes go through memory: GCC's reductions and shuffles take an
+// undefined vector for their unused mask operand and warn at every use.
+__attribute__((target("avx512f"), always_inline))
+static inline double Avx512Sum(__m512d v)
+{
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, v);
+
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+template <size_t TI, size_t TJ>
+__attribute__((target("avx512f"), always_inline))
+static inline void Avx512DotTile(size_t kc, const double *a, size_t lda, const double *bt, size_t ldb, double *c,
+                                 size_t ldc, bool accumulate)
+{
+    __m512d tile[TI][TJ];
+
+#pragma GCC unroll 4
+    for (size_t i = 0; i < TI; i++)
+    {
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            tile[i][j] = _mm512_setzero_pd();
+        }
+    }
+
+    size_t k = 0;
+    for (; k + 8 <= kc; k += 8)
+    {
+        __m512d row[TJ];
+
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            row[j] = _mm512_loadu_pd(bt + j * ldb + k);
+        }
+
+#pragma GCC unroll 4
+        for (size_t i = 0; i < TI; i++)
+        {
+            __m512d x = _mm512_loadu_pd(a + i * lda + k);
+
+#pragma GCC unroll 4
+            for (size_t j = 0; j < TJ; j++)
+            {
+                tile[i][j] = _mm512_fmadd_pd(x, row[j], tile[i][j]);
+            }
+        }
+    }
+
+    if (k < kc)
+    {
+        __mmask8 mask = (__mmask8)((1u << (kc - k)) - 1);
+        __m512d row[TJ];
+
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            row[j] = _mm512_maskz_loadu_pd(mask, bt + j * ldb + k);
+        }
+
+#pragma GCC unroll 4
+        for (size_t i = 0; i < TI; i++)
+        {
+            __m512d x = _mm512_maskz_loadu_pd(mask, a + i * lda + k);
+
+#pragma GCC unroll 4
+            for (size_t j = 0; j < TJ; j++)
+            {
+                tile[i][j] = _mm512_fmadd_pd(x, row[j], tile[i][j]);
+            }
+        }
+    }
+
+#pragma GCC unroll 4
+    for (size_t i = 0; i < TI; i++)
+    {
+#pragma GCC unroll 4
+        for (size_t j = 0; j < TJ; j++)
+        {
+            double sum = Avx512Sum(tile[i][j]);
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + sum : sum;
+        }
+    }
+}
+
+template <size_t TI>
+__attribute__((target("avx512f"), always_inline))
+static inline void Avx512DotRows(size_t columns, size_t kc, const double *a, size_t lda, const double *bt, size_t ldb,
+                                 double *c, size_t ldc, bool accumulate)
+{
+    size_t j = 0;
+    for (; j + AVX512_DOT_TILE <= columns; j += AVX512_DOT_TILE)
+    {
+        Avx512DotTile<TI, AVX512_DOT_TILE>(kc, a, lda, bt + j * ldb, ldb, c + j, ldc, accumulate);
+    }
+
+    switch (columns - j)
+    {
+    case 1:
+        Avx512DotTile<TI, 1>(kc, a, lda, bt + j * ldb, ldb, c + j, ldc, accumulate);
+        break;
+    case 2:
+        Avx512DotTile<TI, 2>(kc, a, lda, bt + j * ldb, ldb, c + j, ldc, accumulate);
+        break;
+    case 3:
+        Avx512DotTile<TI, 3>(kc, a, lda, bt + j * ldb, ldb, c + j, ldc, accumulate);
+        break;
+    }
+}
+
+// The columns go in tiles of AVX512_DOT_TILE rows of bt, each kept in L1
+// while every row of A passes it.
+__attribute__((target("avx512f")))
+static void Avx512DotBlock(size_t rows, size_t columns, size_t kc, const double *a, size_t lda, const double *bt,
+                           size_t ldb, double *c, size_t ldc, bool accumulate)
+{
+    for (size_t j = 0; j < columns; j += AVX512_DOT_TILE)
+    {
+        size_t tile_columns = columns - j < AVX512_DOT_TILE ? columns - j : AVX512_DOT_TILE;
+
+        size_t i = 0;
+        for (; i + AVX512_DOT_TILE <= rows; i += AVX512_DOT_TILE)
+        {
+            Avx512DotRows<AVX512_DOT_TILE>(tile_columns, kc, a + i * lda, lda, bt + j * ldb, ldb, c + i * ldc + j,
+                                           ldc, accumulate);
+        }
+
+        switch (rows - i)
+        {
+        case 1:
+            Avx512DotRows<1>(tile_columns, kc, a + i * lda, lda, bt + j * ldb, ldb, c + i * ldc + j, ldc, accumulate);
+            break;
+        case 2:
+            Avx512DotRows<2>(tile_columns, kc, a + i * lda, lda, bt + j * ldb, ldb, c + i * ldc + j, ldc, accumulate);
+            break;
+        case 3:
+            Avx512DotRows<3>(tile_columns, kc, a + i * lda, lda, bt + j * ldb, ldb, c + i * ldc + j, ldc, accumulate);
+            break;
+        }
+    }
+}
+
+#endif
+
+void DotProductColumns(const matrix_t *a, const matrix_t *bt, matrix_t *c, size_t column_start, size_t column_end)
+{
+    dot_block_t block = ScalarDotBlock;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        block = Avx512DotBlock;
+    }
+#endif
+
+    if (column_start >= column_end)
+    {
+        return;
+    }
+
+    if (a->columns == 0)
+    {
+        for (size_t i = 0; i < c->rows; i++)
+        {
+            for (size_t j = column_start; j < column_end; j++)
+            {
+                c->data[i * c->stride + j] = 0;
+            }
+        }
+        return;
+    }
+
+    for (size_t pc = 0; pc < a->columns; pc += DOT_KC)
+    {
+        size_t kc = a->columns - pc < DOT_KC ? a->columns - pc : DOT_KC;
+        block(c->rows, column_end - column_start, kc, a->data + pc, a->stride, bt->data + column_start * bt->stride + pc,
+              bt->stride, c->data + column_start, c->stride, pc > 0);
+    }
+}
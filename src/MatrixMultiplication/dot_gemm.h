@@ -0,0 +1,18 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include "typedefs.h"
+
+#define DOT_MAX_ROWS 64 // rows of A up to which the AVX-512 dot products beat packing B
+#define DOT_KC 512      // depth of a block, DOT_MAX_ROWS x DOT_KC of A stays in L2
+
+// C = A B with B given as its p x n transpose bt, so element (i, j) is the
+// dot product of row i of A and row j of bt, both contiguous. The packed
+// multiplication copies all of B for every call however few rows A has;
+// here bt is read once and in place, which wins while A is short.
+// Computes columns [column_start, column_end) of C, so that threads can
+// split a short C by columns.
+void DotProductColumns(const matrix_t *a, const matrix_t *bt, matrix_t *c, size_t column_start, size_t column_end);
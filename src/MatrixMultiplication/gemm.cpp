@@ -0,0 +1,534 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "matrix.h"
+#include "gemm.h"
+
+static void ScalarKernel(size_t kc, const double *a, const double *b, double *c, size_t ldc, bool accumulate);
+static void PackA(const matrix_t *a, size_t row, size_t rows, size_t depth, size_t kc, size_t mr, double *packed);
+static void PackB(const matrix_t *b, size_t depth, size_t kc, size_t column, size_t columns, size_t nr,
+                  double *packed);
+static void MultiplyPanels(const gemm_kernel_t *kernel, const double *packed_a, const double *packed_b, matrix_t *c,
+                           size_t row, size_t rows, size_t column, size_t columns, size_t kc, bool accumulate);
+static void ZeroBlock(matrix_t *c, size_t row_start, size_t row_end, size_t column_start, size_t column_end);
+static void ChooseGrid(size_t row_panels, size_t column_panels, const gemm_kernel_t *kernel, size_t num_threads,
+                       size_t *grid_rows, size_t *grid_columns);
+
+#define SCALAR_MR 4
+#define SCALAR_NR 4
+
+static void ScalarKernel(size_t kc, const double *a, const double *b, double *c, size_t ldc, bool accumulate)
+{
+    double tile[SCALAR_MR][SCALAR_NR] = { { 0 } };
+
+    for (size_t k = 0; k < kc; k++)
+    {
+        for (size_t i = 0; i < SCALAR_MR; i++)
+        {
+            for (size_t j = 0; j < SCALAR_NR; j++)
+            {
+                tile[i][j] += a[k * SCALAR_MR + i] * b[k * SCALAR_NR + j];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < SCALAR_MR; i++)
+    {
+        for (size_t j = 0; j < SCALAR_NR; j++)
+        {
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + tile[i][j] : tile[i][j];
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// The vector kernels are compiled for their instruction set whatever the
+// compiler targets and only called once the CPU is known to support it.
+
+#define AVX2_MR 6
+#define AVX2_NR 8
+
+__attribute__((target("avx2,fma")))
+static void Avx2Kernel(size_t kc, const double *a, const double *b, double *c, size_t ldc, bool accumulate)
+{
+    __m256d tile[AVX2_MR][2];
+
+#pragma GCC unroll 6
+    for (size_t i = 0; i < AVX2_MR; i++)
+    {
+        tile[i][0] = _mm256_setzero_pd();
+        tile[i][1] = _mm256_setzero_pd();
+    }
+
+    for (size_t k = 0; k < kc; k++)
+    {
+        __m256d b0 = _mm256_load_pd(b + k * AVX2_NR);
+        __m256d b1 = _mm256_load_pd(b + k * AVX2_NR + 4);
+
+#pragma GCC unroll 6
+        for (size_t i = 0; i < AVX2_MR; i++)
+        {
+            __m256d ai = _mm256_broadcast_sd(a + k * AVX2_MR + i);
+            tile[i][0] = _mm256_fmadd_pd(ai, b0, tile[i][0]);
+            tile[i][1] = _mm256_fmadd_pd(ai, b1, tile[i][1]);
+        }
+    }
+
+#pragma GCC unroll 6
+    for (size_t i = 0; i < AVX2_MR; i++)
+    {
+        double *row = c + i * ldc;
+        if (accumulate)
+        {
+            tile[i][0] = _mm256_add_pd(tile[i][0], _mm256_loadu_pd(row));
+            tile[i][1] = _mm256_add_pd(tile[i][1], _mm256_loadu_pd(row + 4));
+        }
+
+        _mm256_storeu_pd(row, tile[i][0]);
+        _mm256_storeu_pd(row + 4, tile[i][1]);
+    }
+}
+
+#define AVX512_MR 12
+#define AVX512_NR 16
+
+__attribute__((target("avx512f")))
+static void Avx512Kernel(size_t kc, const double *a, const double *b, double *c, size_t ldc, bool accumulate)
+{
+    __m512d tile[AVX512_MR][2];
+
+#pragma GCC unroll 12
+    for (size_t i = 0; i < AVX512_MR; i++)
+    {
+        tile[i][0] = _mm512_setzero_pd();
+        tile[i][1] = _mm512_setzero_pd();
+    }
+
+    for (size_t k = 0; k < kc; k++)
+    {
+        __m512d b0 = _mm512_load_pd(b + k * AVX512_NR);
+        __m512d b1 = _mm512_load_pd(b + k * AVX512_NR + 8);
+
+#pragma GCC unroll 12
+        for (size_t i = 0; i < AVX512_MR; i++)
+        {
+            __m512d ai = _mm512_set1_pd(a[k * AVX512_MR + i]);
+            tile[i][0] = _mm512_fmadd_pd(ai, b0, tile[i][0]);
+            tile[i][1] = _mm512_fmadd_pd(ai, b1, tile[i][1]);
+        }
+    }
+
+#pragma GCC unroll 12
+    for (size_t i = 0; i < AVX512_MR; i++)
+    {
+        double *row = c + i * ldc;
+        if (accumulate)
+        {
+            tile[i][0] = _mm512_add_pd(tile[i][0], _mm512_loadu_pd(row));
+            tile[i][1] = _mm512_add_pd(tile[i][1], _mm512_loadu_pd(row + 8));
+        }
+
+        _mm512_storeu_pd(row, tile[i][0]);
+        _mm512_storeu_pd(row + 8, tile[i][1]);
+    }
+}
+
+#endif
+
+static const gemm_kernel_t kernels[] =
+{
+#if defined(__x86_64__)
+    { "avx512", AVX512_MR, AVX512_NR, Avx512Kernel },
+    { "avx2", AVX2_MR, AVX2_NR, Avx2Kernel },
+#endif
+    { "scalar", SCALAR_MR, SCALAR_NR, ScalarKernel }
+};
+
+static bool KernelSupported(const gemm_kernel_t *kernel)
+{
+#if defined(__x86_64__)
+    if (strcmp(kernel->name, "avx512") == 0)
+    {
+        return __builtin_cpu_supports("avx512f");
+    }
+
+    if (strcmp(kernel->name, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#endif
+
+    return true;
+}
+
+const gemm_kernel_t * SelectGemmKernel(const char *name)
+{
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        if ((name == NULL || strcmp(kernels[i].name, name) == 0) && KernelSupported(kernels + i))
+        {
+            return kernels + i;
+        }
+    }
+
+    return NULL;
+}
+
+gemm_workspace_t * CreateGemmWorkspace(const gemm_kernel_t *kernel)
+{
+    gemm_workspace_t *workspace = (gemm_workspace_t *)malloc(sizeof(gemm_workspace_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(workspace, "workspace");
+
+    workspace->kernel = kernel;
+    workspace->packed_a = AllocateAligned(GEMM_MC * GEMM_KC);
+    workspace->packed_b = AllocateAligned(GEMM_KC * GEMM_NC);
+
+    return workspace;
+}
+
+void DestroyGemmWorkspace(gemm_workspace_t *workspace)
+{
+    if (workspace == NULL)
+    {
+        return;
+    }
+
+    free(workspace->packed_a);
+    free(workspace->packed_b);
+    free(workspace);
+}
+
+void GemmRows(gemm_workspace_t *workspace, const matrix_t *a, const matrix_t *b, matrix_t *c,
+              size_t row_start, size_t row_end, bool accumulate)
+{
+    const gemm_kernel_t *kernel = workspace->kernel;
+
+    if (a->columns == 0)
+    {
+        if (!accumulate)
+        {
+            ZeroBlock(c, row_start, row_end, 0, c->columns);
+        }
+        return;
+    }
+
+    for (size_t jc = 0; jc < b->columns; jc += GEMM_NC)
+    {
+        size_t nc = b->columns - jc < GEMM_NC ? b->columns - jc : GEMM_NC;
+
+        for (size_t pc = 0; pc < a->columns; pc += GEMM_KC)
+        {
+            size_t kc = a->columns - pc < GEMM_KC ? a->columns - pc : GEMM_KC;
+            PackB(b, pc, kc, jc, nc, kernel->nr, workspace->packed_b);
+
+            for (size_t ic = row_start; ic < row_end; ic += GEMM_MC)
+            {
+                size_t mc = row_end - ic < GEMM_MC ? row_end - ic : GEMM_MC;
+                PackA(a, ic, mc, pc, kc, kernel->mr, workspace->packed_a);
+                MultiplyPanels(kernel, workspace->packed_a, workspace->packed_b, c, ic, mc, jc, nc, kc,
+                               accumulate || pc > 0);
+            }
+        }
+    }
+}
+
+parallel_gemm_t * CreateParallelGemm(const gemm_kernel_t *kernel, const matrix_t *a, const matrix_t *b, bool trans_b,
+                                     matrix_t *c, size_t num_threads)
+{
+    parallel_gemm_t *gemm = (parallel_gemm_t *)calloc(1, sizeof(parallel_gemm_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm, "gemm");
+
+    gemm->kernel = kernel;
+    gemm->a = a;
+    gemm->b = b;
+    gemm->trans_b = trans_b;
+    gemm->c = c;
+    gemm->num_threads = num_threads;
+
+    size_t row_panels = (c->rows + kernel->mr - 1) / kernel->mr;
+    size_t column_panels = (c->columns + kernel->nr - 1) / kernel->nr;
+    ChooseGrid(row_panels, column_panels, kernel, num_threads, &gemm->grid_rows, &gemm->grid_columns);
+
+    gemm->row_starts = (size_t *)malloc((gemm->grid_rows + 1) * sizeof(size_t));
+    gemm->column_starts = (size_t *)malloc((gemm->grid_columns + 1) * sizeof(size_t));
+    gemm->packed_a = (double **)malloc(gemm->grid_rows * sizeof(double *));
+    gemm->packed_b = (double **)malloc(gemm->grid_columns * sizeof(double *));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->row_starts, "gemm->row_starts");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->column_starts, "gemm->column_starts");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->packed_a, "gemm->packed_a");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->packed_b, "gemm->packed_b");
+
+    for (size_t r = 0; r <= gemm->grid_rows; r++)
+    {
+        size_t start = row_panels * r / gemm->grid_rows * kernel->mr;
+        gemm->row_starts[r] = start < c->rows ? start : c->rows;
+    }
+
+    for (size_t g = 0; g <= gemm->grid_columns; g++)
+    {
+        size_t start = column_panels * g / gemm->grid_columns * kernel->nr;
+        gemm->column_starts[g] = start < c->columns ? start : c->columns;
+    }
+
+    size_t widest = 0;
+    for (size_t r = 0; r < gemm->grid_rows; r++)
+    {
+        size_t rows = gemm->row_starts[r + 1] - gemm->row_starts[r];
+        gemm->packed_a[r] = AllocateUntouched((rows + kernel->mr - 1) / kernel->mr * kernel->mr * GEMM_KC);
+    }
+
+    for (size_t g = 0; g < gemm->grid_columns; g++)
+    {
+        size_t columns = gemm->column_starts[g + 1] - gemm->column_starts[g];
+        size_t width = (columns < GEMM_NC ? columns : GEMM_NC);
+        gemm->packed_b[g] = AllocateUntouched((width + kernel->nr - 1) / kernel->nr * kernel->nr * GEMM_KC);
+        widest = columns > widest ? columns : widest;
+    }
+
+    gemm->column_chunks = (widest + GEMM_NC - 1) / GEMM_NC;
+    InitSpinBarrier(&gemm->barrier, (unsigned int)num_threads, DEFAULT_BARRIER_SPIN);
+
+    return gemm;
+}
+
+void DestroyParallelGemm(parallel_gemm_t *gemm)
+{
+    if (gemm == NULL)
+    {
+        return;
+    }
+
+    for (size_t r = 0; r < gemm->grid_rows; r++)
+    {
+        free(gemm->packed_a[r]);
+    }
+
+    for (size_t g = 0; g < gemm->grid_columns; g++)
+    {
+        free(gemm->packed_b[g]);
+    }
+
+    free(gemm->packed_a);
+    free(gemm->packed_b);
+    free(gemm->row_starts);
+    free(gemm->column_starts);
+    free(gemm);
+}
+
+void ParallelGemm(parallel_gemm_t *gemm, size_t tid)
+{
+    const gemm_kernel_t *kernel = gemm->kernel;
+    const matrix_t *a = gemm->a, *b = gemm->b;
+    size_t mr = kernel->mr, nr = kernel->nr;
+
+    // Threads beyond the grid only take part in the barriers.
+    bool active = tid < gemm->grid_rows * gemm->grid_columns;
+    size_t r = active ? tid / gemm->grid_columns : 0;
+    size_t g = active ? tid % gemm->grid_columns : 0;
+    size_t row_start = gemm->row_starts[r], row_end = active ? gemm->row_starts[r + 1] : row_start;
+    size_t column_start = gemm->column_starts[g], column_end = active ? gemm->column_starts[g + 1] : column_start;
+    double *packed_a = gemm->packed_a[r];
+    double *packed_b = gemm->packed_b[g];
+
+    if (a->columns == 0)
+    {
+        ZeroBlock(gemm->c, row_start, row_end, column_start, column_end);
+        return;
+    }
+
+    for (size_t chunk = 0; chunk < gemm->column_chunks; chunk++)
+    {
+        size_t jc = column_start + chunk * GEMM_NC < column_end ? column_start + chunk * GEMM_NC : column_end;
+        size_t nc = column_end - jc < GEMM_NC ? column_end - jc : GEMM_NC;
+
+        for (size_t pc = 0; pc < a->columns; pc += GEMM_KC)
+        {
+            size_t kc = a->columns - pc < GEMM_KC ? a->columns - pc : GEMM_KC;
+
+            // The previous panels are still read until everyone is done.
+            SpinBarrierWait(&gemm->barrier);
+
+            // Thread (r, g) packs the r-th share of the NR panels of its grid
+            // column and the g-th share of the MR panels of its grid row.
+            size_t panels = active ? (nc + nr - 1) / nr : 0;
+            size_t first = panels * r / gemm->grid_rows, last = panels * (r + 1) / gemm->grid_rows;
+            if (first < last)
+            {
+                size_t end = jc + last * nr < jc + nc ? jc + last * nr : jc + nc;
+                if (gemm->trans_b)
+                {
+                    // Columns of B are rows of its transpose, packed the way A is.
+                    PackA(b, jc + first * nr, end - jc - first * nr, pc, kc, nr, packed_b + first * nr * kc);
+                }
+                else
+                {
+                    PackB(b, pc, kc, jc + first * nr, end - jc - first * nr, nr, packed_b + first * nr * kc);
+                }
+            }
+
+            panels = active ? (row_end - row_start + mr - 1) / mr : 0;
+            first = panels * g / gemm->grid_columns;
+            last = panels * (g + 1) / gemm->grid_columns;
+            if (first < last)
+            {
+                size_t end = row_start + last * mr < row_end ? row_start + last * mr : row_end;
+                PackA(a, row_start + first * mr, end - row_start - first * mr, pc, kc, mr, packed_a + first * mr * kc);
+            }
+
+            SpinBarrierWait(&gemm->barrier);
+
+            for (size_t ic = row_start; ic < row_end; ic += GEMM_MC)
+            {
+                size_t mc = row_end - ic < GEMM_MC ? row_end - ic : GEMM_MC;
+                MultiplyPanels(kernel, packed_a + (ic - row_start) * kc, packed_b, gemm->c, ic, mc, jc, nc, kc, pc > 0);
+            }
+        }
+    }
+}
+
+// C[row, row + rows) x [column, column + columns) = or += packed A times
+// packed B, MR x NR tiles at a time.
+static void MultiplyPanels(const gemm_kernel_t *kernel, const double *packed_a, const double *packed_b, matrix_t *c,
+                           size_t row, size_t rows, size_t column, size_t columns, size_t kc, bool accumulate)
+{
+    size_t mr = kernel->mr, nr = kernel->nr;
+    size_t ldc = c->stride;
+    double edge[GEMM_MAX_MR * GEMM_MAX_NR];
+
+    for (size_t jr = 0; jr < columns; jr += nr)
+    {
+        const double *panel_b = packed_b + jr * kc;
+        size_t tile_columns = columns - jr < nr ? columns - jr : nr;
+
+        for (size_t ir = 0; ir < rows; ir += mr)
+        {
+            const double *panel_a = packed_a + ir * kc;
+            size_t tile_rows = rows - ir < mr ? rows - ir : mr;
+            double *tile = c->data + (row + ir) * ldc + column + jr;
+
+            if (tile_rows == mr && tile_columns == nr)
+            {
+                kernel->run(kc, panel_a, panel_b, tile, ldc, accumulate);
+                continue;
+            }
+
+            // Edge tiles go through a full size buffer.
+            kernel->run(kc, panel_a, panel_b, edge, nr, false);
+            for (size_t i = 0; i < tile_rows; i++)
+            {
+                for (size_t j = 0; j < tile_columns; j++)
+                {
+                    tile[i * ldc + j] = accumulate ? tile[i * ldc + j] + edge[i * nr + j] : edge[i * nr + j];
+                }
+            }
+        }
+    }
+}
+
+static void ZeroBlock(matrix_t *c, size_t row_start, size_t row_end, size_t column_start, size_t column_end)
+{
+    for (size_t i = row_start; i < row_end; i++)
+    {
+        memset(c->data + i * c->stride + column_start, 0, (column_end - column_start) * sizeof(double));
+    }
+}
+
+// Grid with rows x columns = num_threads that minimizes the rows of A plus
+// the columns of B a thread reads, i.e. the closest to square blocks. Grid
+// rows and columns without a panel of their own are avoided while possible.
+static void ChooseGrid(size_t row_panels, size_t column_panels, const gemm_kernel_t *kernel, size_t num_threads,
+                       size_t *grid_rows, size_t *grid_columns)
+{
+    double best = -1;
+    *grid_rows = 1;
+    *grid_columns = 1;
+
+    for (size_t rows = 1; rows <= num_threads; rows++)
+    {
+        if (num_threads % rows != 0)
+        {
+            continue;
+        }
+
+        size_t columns = num_threads / rows;
+        if ((rows > row_panels && rows > 1) || (columns > column_panels && columns > 1))
+        {
+            continue;
+        }
+
+        double cost = (double)((row_panels + rows - 1) / rows * kernel->mr)
+                    + (double)((column_panels + columns - 1) / columns * kernel->nr);
+        if (best < 0 || cost < best)
+        {
+            best = cost;
+            *grid_rows = rows;
+            *grid_columns = columns;
+        }
+    }
+
+    // Too few panels for every thread: give each a row panel if possible.
+    if (best < 0)
+    {
+        *grid_rows = row_panels < num_threads ? (row_panels > 0 ? row_panels : 1) : num_threads;
+        *grid_columns = 1;
+    }
+}
+
+// Rows [row, row + rows) and columns [depth, depth + kc) of A as panels of mr
+// rows stored column by column, the last panel padded with zeros.
+static void PackA(const matrix_t *a, size_t row, size_t rows, size_t depth, size_t kc, size_t mr, double *packed)
+{
+    for (size_t ir = 0; ir < rows; ir += mr)
+    {
+        size_t panel_rows = rows - ir < mr ? rows - ir : mr;
+
+        for (size_t k = 0; k < kc; k++)
+        {
+            const double *column = a->data + (row + ir) * a->stride + depth + k;
+            size_t i = 0;
+            for (; i < panel_rows; i++)
+            {
+                packed[i] = column[i * a->stride];
+            }
+            for (; i < mr; i++)
+            {
+                packed[i] = 0;
+            }
+            packed += mr;
+        }
+    }
+}
+
+// Rows [depth, depth + kc) and columns [column, column + columns) of B as
+// panels of nr columns stored row by row, the last panel padded with zeros.
+static void PackB(const matrix_t *b, size_t depth, size_t kc, size_t column, size_t columns, size_t nr,
+                  double *packed)
+{
+    for (size_t jr = 0; jr < columns; jr += nr)
+    {
+        size_t panel_columns = columns - jr < nr ? columns - jr : nr;
+
+        for (size_t k = 0; k < kc; k++)
+        {
+            const double *row = b->data + (depth + k) * b->stride + column + jr;
+            size_t j = 0;
+            for (; j < panel_columns; j++)
+            {
+                packed[j] = row[j];
+            }
+            for (; j < nr; j++)
+            {
+                packed[j] = 0;
+            }
+            packed += nr;
+        }
+    }
+}
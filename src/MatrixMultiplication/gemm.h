@@ -0,0 +1,82 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "barrier.h"
+
+// Cache blocking of the multiplication, in elements. A KC x MC block of A
+// stays in L2 while it meets every KC x NR panel of the KC x NC block of B,
+// which stays in L3. MC and NC are multiples of every kernel's MR and NR.
+#define GEMM_KC 384
+#define GEMM_MC 96
+#define GEMM_NC 3072
+
+#define GEMM_MAX_MR 12
+#define GEMM_MAX_NR 16
+
+// Computes the MR x NR tile C = A B, or C += A B when accumulate is set,
+// from kc columns of a packed A panel (MR values per column) and kc rows of
+// a packed B panel (NR values per row). C is row-major with ldc columns.
+typedef void (*gemm_micro_kernel_t)(size_t kc, const double *a, const double *b, double *c, size_t ldc,
+                                    bool accumulate);
+
+typedef struct gemm_kernel_t
+{
+    const char *name;
+    size_t mr, nr;
+    gemm_micro_kernel_t run;
+} gemm_kernel_t;
+
+// The kernel named name (scalar, avx2 or avx512), or with name NULL the
+// widest one the running CPU supports. NULL if the CPU lacks the named one.
+const gemm_kernel_t * SelectGemmKernel(const char *name);
+
+// Packing buffers of one thread.
+typedef struct gemm_workspace_t
+{
+    const gemm_kernel_t *kernel;
+    double *packed_a; // GEMM_MC x GEMM_KC, MR row panels
+    double *packed_b; // GEMM_KC x GEMM_NC, NR column panels
+} gemm_workspace_t;
+
+gemm_workspace_t * CreateGemmWorkspace(const gemm_kernel_t *kernel);
+void DestroyGemmWorkspace(gemm_workspace_t *workspace);
+
+// Rows [row_start, row_end) of C = A B, or C += A B when accumulate is set.
+void GemmRows(gemm_workspace_t *workspace, const matrix_t *a, const matrix_t *b, matrix_t *c,
+              size_t row_start, size_t row_end, bool accumulate);
+
+// C = A B on num_threads threads. C is split into a grid_rows x
+// grid_columns grid of blocks, one per thread. The threads of a grid row
+// pack the panels of A for its rows together and share them, those of a
+// grid column do the same with the panels of B. The buffers are not
+// touched before the packing, so their pages land on the memory node of
+// the threads that pack and read them; the same holds for the blocks of C
+// when it comes from CreateUntouchedMatrix and the threads are pinned.
+typedef struct parallel_gemm_t
+{
+    const gemm_kernel_t *kernel;
+    const matrix_t *a, *b;
+    bool trans_b;          // b holds the transpose of B
+    matrix_t *c;
+    size_t num_threads;
+    size_t grid_rows, grid_columns;
+    size_t *row_starts;    // grid_rows + 1 boundaries, multiples of MR
+    size_t *column_starts; // grid_columns + 1 boundaries, multiples of NR
+    size_t column_chunks;  // GEMM_NC wide steps through the widest grid column
+    double **packed_a;     // per grid row, its rows x GEMM_KC
+    double **packed_b;     // per grid column, GEMM_KC x GEMM_NC at most
+    spin_barrier_t barrier;
+} parallel_gemm_t;
+
+// With trans_b set b is the p x n transpose of B; it is packed from its
+// rows, as A is, and costs no more than B itself.
+parallel_gemm_t * CreateParallelGemm(const gemm_kernel_t *kernel, const matrix_t *a, const matrix_t *b, bool trans_b,
+                                     matrix_t *c, size_t num_threads);
+void DestroyParallelGemm(parallel_gemm_t *gemm);
+
+// Collective: every thread tid < num_threads calls it once.
+void ParallelGemm(parallel_gemm_t *gemm, size_t tid);
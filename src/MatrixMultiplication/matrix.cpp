@@ -0,0 +1,95 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "matrix.h"
+
+#define TRANSPOSE_BLOCK 32 // square blocks whose rows and columns both stay in L1
+
+matrix_t * CreateMatrix(size_t rows, size_t columns)
+{
+    matrix_t *matrix = (matrix_t *)malloc(sizeof(matrix_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(matrix, "matrix");
+
+    matrix->rows = rows;
+    matrix->columns = columns;
+    matrix->stride = columns;
+    matrix->data = AllocateAligned(rows * columns);
+
+    return matrix;
+}
+
+matrix_t * CreateUntouchedMatrix(size_t rows, size_t columns)
+{
+    matrix_t *matrix = (matrix_t *)malloc(sizeof(matrix_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(matrix, "matrix");
+
+    matrix->rows = rows;
+    matrix->columns = columns;
+    matrix->stride = columns;
+    matrix->data = AllocateUntouched(rows * columns);
+
+    return matrix;
+}
+
+void DestroyMatrix(matrix_t *matrix)
+{
+    if (matrix == NULL)
+    {
+        return;
+    }
+
+    free(matrix->data);
+    free(matrix);
+}
+
+matrix_t MatrixView(const matrix_t *matrix, size_t row, size_t column, size_t rows, size_t columns)
+{
+    matrix_t view = { rows, columns, matrix->stride, matrix->data + row * matrix->stride + column };
+    return view;
+}
+
+matrix_t * TransposeMatrix(const matrix_t *matrix)
+{
+    matrix_t *transpose = CreateUntouchedMatrix(matrix->columns, matrix->rows);
+
+    for (size_t ib = 0; ib < matrix->rows; ib += TRANSPOSE_BLOCK)
+    {
+        size_t i_end = ib + TRANSPOSE_BLOCK < matrix->rows ? ib + TRANSPOSE_BLOCK : matrix->rows;
+
+        for (size_t jb = 0; jb < matrix->columns; jb += TRANSPOSE_BLOCK)
+        {
+            size_t j_end = jb + TRANSPOSE_BLOCK < matrix->columns ? jb + TRANSPOSE_BLOCK : matrix->columns;
+
+            for (size_t i = ib; i < i_end; i++)
+            {
+                for (size_t j = jb; j < j_end; j++)
+                {
+                    transpose->data[j * transpose->stride + i] = matrix->data[i * matrix->stride + j];
+                }
+            }
+        }
+    }
+
+    return transpose;
+}
+
+double * AllocateUntouched(size_t count)
+{
+    size_t bytes = (count * sizeof(double) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    double *buffer = (double *)aligned_alloc(CACHE_LINE, bytes > 0 ? bytes : CACHE_LINE);
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(buffer, "buffer");
+
+    return buffer;
+}
+
+double * AllocateAligned(size_t count)
+{
+    double *buffer = AllocateUntouched(count);
+    memset(buffer, 0, count * sizeof(double));
+
+    return buffer;
+}
@@ -0,0 +1,27 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include "typedefs.h"
+
+// Zero filled rows x columns matrix.
+matrix_t * CreateMatrix(size_t rows, size_t columns);
+void DestroyMatrix(matrix_t *matrix);
+
+// Matrix whose pages are left to be placed by the first thread writing them.
+matrix_t * CreateUntouchedMatrix(size_t rows, size_t columns);
+
+// Uninitialized buffer of count doubles aligned to a cache line, its pages
+// are not touched.
+double * AllocateUntouched(size_t count);
+
+// Rows x columns block of matrix starting at (row, column), sharing its data.
+matrix_t MatrixView(const matrix_t *matrix, size_t row, size_t column, size_t rows, size_t columns);
+
+// New columns x rows matrix holding the transpose of matrix.
+matrix_t * TransposeMatrix(const matrix_t *matrix);
+
+// Zero filled buffer of count doubles aligned to a cache line.
+double * AllocateAligned(size_t count);
@@ -4,25 +4,74 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <string.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "typedefs.h"
+#include "matrix.h"
+#include "gemm.h"
+#include "strassen.h"
+#include "typed_gemm.h"
+#include "batched_gemm.h"
+#include "sparse_gemm.h"
+#include "dot_gemm.h"
+#include "tiled_matrix.h"
+#include "ooc_gemm.h"
 
 #define RAND_SEED 46540 // input matrix generation seed
 #define MAX_U_SHORT 65535 // maximum matrix cell value
 
-int **matA; // input matrix A
-int **matB; // input matrix B
-int **matC; // result matrix C
+matrix_t *matA; // input matrix A
+matrix_t *matB; // input matrix B
+matrix_t *matC; // result matrix C
 size_t m, n, p; // matrix dimensions (m - first matrix rows,
                 // n - first matrix columns, second matrix rows,
                 // p - second matrix columns)
 size_t num_threads; // number of working threads
 bool rand_initialized; // randomization initialization flag
-size_t work_units; // number of work units for individual thread
-size_t auxiliary_units; // unassigned work units that will be shared among threads
+const gemm_kernel_t *kernel; // micro-kernel chosen for the running CPU
+const char *kernel_name; // kernel requested on the command line, NULL for the best one
+parallel_gemm_t *gemm; // thread grid and shared packed panels
+strassen_t *strassen; // Strassen-Winograd plan, NULL for the classical multiplication
+bool use_strassen; // Strassen-Winograd requested on the command line
+size_t cutoff = STRASSEN_DEFAULT_CUTOFF; // smallest dimension Strassen-Winograd halves to
+element_type_t element_type = ELEMENT_DOUBLE; // type of the A and B elements
+bool transpose_a, transpose_b; // A is stored n x m, B p x n
+double alpha = 1, beta = 0; // C = alpha op(A) op(B) + beta C
+void *typed_gemm; // typed_gemm_t of element_type when the typed multiplication runs
+size_t typed_row_block; // rows of C per thread in the typed multiplication
+size_t batch_count; // independent m x n x p multiplications, 0 for a single one
+double density = 1; // fraction of nonzero elements of the generated A
+csr_matrix_t *sparse_a; // A in sparse form when it is mostly zeros, NULL otherwise
+bool dot_products; // C from dot products of the rows of A and of the transposed B
+const char *ooc_prefix; // out-of-core mode: A, B and C in the tiled files <prefix>_a.tiles, _b and _c
+size_t ooc_tile = OOC_DEFAULT_TILE; // side of the file tiles
+size_t ooc_memory = OOC_DEFAULT_MEMORY; // MB of tile buffers
+size_t ooc_io_threads = OOC_DEFAULT_IO_THREADS; // threads loading tiles ahead of the multiplication
+ooc_gemm_t *ooc; // out-of-core multiplication in progress
 
 void * ThreadMain(void *); // main matrix multiplication function
-int** GenerateMatrix(size_t rows, size_t columns, unsigned int seed); // input matrix generator
+matrix_t * GenerateMatrix(size_t rows, size_t columns, double nonzeros, unsigned int seed); // input matrix generator
+void ParseOptions(int argc, char *argv[]);
+void PinThread(pthread_attr_t *attr, size_t tid); // keeps a thread next to the pages it touched first
+int RunThreads(void * (*thread_main)(void *));
+template <typename T> int RunTypedGemm();
+int RunBatchedGemm();
+int RunOutOfCoreGemm();
+void * OutOfCoreThreadMain(void *threadid);
+tiled_matrix_t * PrepareTiledOperand(const char *prefix, const char *name, size_t rows, size_t columns);
+matrix_batch_t * GenerateMatrixBatch(size_t count, size_t rows, size_t columns, unsigned int seed);
+template <typename T> void * TypedThreadMain(void *threadid);
+template <typename T> T * GenerateTypedMatrix(size_t rows, size_t columns, unsigned int seed);
+
+// Untouched cache line aligned buffer of count elements of T.
+template <typename T>
+T * AllocateTyped(size_t count)
+{
+    return (T *)AllocateUntouched((count * sizeof(T) + sizeof(double) - 1) / sizeof(double));
+}
 
 int main(int argc, char *argv[])
 {
@@ -34,7 +83,21 @@ int main(int argc, char *argv[])
                         m - first matrix row count\n \
                         n - first matrix column count, second matrix row count\n \
                         p - second matrix column count\n \
-                        num_threads - number of worker threads.");
+                        num_threads - number of worker threads.\n \
+                        Optional name=value arguments:\n \
+                        kernel - scalar, avx2 or avx512 (default the widest the CPU supports).\n \
+                        algorithm - classical (default) or strassen.\n \
+                        cutoff - Strassen-Winograd recursion stops before a dimension gets below it (default 1024).\n \
+                        type - double (default), float, int32, int16 or int8 elements of A and B.\n \
+                        transpose - none (default), a, b or both, operands stored transposed.\n \
+                        alpha, beta - C = alpha A B + beta C (default 1 and 0).\n \
+                        batch - multiply this many independent pairs of matrices (default off).\n \
+                        density - fraction of nonzero elements of A (default 1), mostly zero A is multiplied as a sparse matrix by the avx512 kernel.\n \
+                        out_of_core - keep A, B and C in the tiled files <value>_a.tiles, _b.tiles and _c.tiles, existing\n \
+                                      A and B files of the right shape are used as they are (default off).\n \
+                        tile - side of the file tiles in the out-of-core mode (default 1024).\n \
+                        memory - MB of tile buffers in the out-of-core mode (default 256).\n \
+                        io_threads - threads reading tiles ahead in the out-of-core mode (default 2).");
         return -1;
     }
 
@@ -42,34 +105,164 @@ int main(int argc, char *argv[])
     n = atoi(argv[2]);
     p = atoi(argv[3]);
     num_threads = atoi(argv[4]);
+    ParseOptions(argc, argv);
+
+    if (num_threads < 1)
+    {
+        fprintf(stderr, "At least one thread is required.\n");
+        return -1;
+    }
 
-    matA = GenerateMatrix(m, n, RAND_SEED);
-    matB = GenerateMatrix(n, p, RAND_SEED);
+    bool typed = element_type != ELEMENT_DOUBLE || transpose_a || alpha != 1 || beta != 0;
 
-    matC = (int**) malloc(m * sizeof(int*));
-    for (unsigned int i = 0; i < m; i++)
+    if (ooc_prefix != NULL)
     {
-        matC[i] = (int*) malloc(p * sizeof(int));
-        for (unsigned int j = 0; j < p; j++)
+        if (use_strassen || typed || transpose_b || density < 1 || batch_count > 0)
         {
-            matC[i][j] = 0;
+            fprintf(stderr, "The out-of-core mode supports only double C = A B.\n");
+            return -1;
         }
+
+        return RunOutOfCoreGemm();
     }
 
-    size_t spawnedThreads = m * p >= num_threads ? num_threads : m*p;
+    if (batch_count > 0)
+    {
+        if (use_strassen || typed || transpose_b || density < 1)
+        {
+            fprintf(stderr, "Batched multiplication supports only double C = A B.\n");
+            return -1;
+        }
 
-    work_units = (unsigned int)m * (unsigned int)p / spawnedThreads;
-    auxiliary_units = (m * p) % spawnedThreads;
+        return RunBatchedGemm();
+    }
+
+    if (typed)
+    {
+        if (use_strassen)
+        {
+            fprintf(stderr, "Strassen-Winograd is only available for double C = A B.\n");
+            return -1;
+        }
+
+        if (density < 1)
+        {
+            fprintf(stderr, "A sparse A is only supported for double C = A B.\n");
+            return -1;
+        }
+
+        bool integer = element_type == ELEMENT_INT32 || element_type == ELEMENT_INT16 || element_type == ELEMENT_INT8;
+        if (integer && (alpha != floor(alpha) || beta != floor(beta) || fabs(alpha) > INT32_MAX ||
+                        fabs(beta) > INT32_MAX))
+        {
+            fprintf(stderr, "alpha and beta must be whole numbers of at most 2^31 - 1 for integer elements.\n");
+            return -1;
+        }
+
+        switch (element_type)
+        {
+        case ELEMENT_FLOAT:
+            return RunTypedGemm<float>();
+        case ELEMENT_INT32:
+            return RunTypedGemm<int32_t>();
+        case ELEMENT_INT16:
+            return RunTypedGemm<int16_t>();
+        case ELEMENT_INT8:
+            return RunTypedGemm<int8_t>();
+        default:
+            return RunTypedGemm<double>();
+        }
+    }
+
+    if (use_strassen && transpose_b)
+    {
+        fprintf(stderr, "Strassen-Winograd needs B untransposed.\n");
+        return -1;
+    }
+
+    kernel = SelectGemmKernel(kernel_name);
+    if (kernel == NULL)
+    {
+        fprintf(stderr, "The CPU does not support the %s kernel.\n", kernel_name);
+        return -1;
+    }
+
+    matA = GenerateMatrix(m, n, density, RAND_SEED);
+    matB = transpose_b ? GenerateMatrix(p, n, 1, RAND_SEED) : GenerateMatrix(n, p, 1, RAND_SEED);
+    matC = CreateUntouchedMatrix(m, p);
+
+    // A mostly zero A is multiplied by its nonzeros alone; the sparse
+    // kernel reads B by rows, so a transposed B is turned back first. A
+    // short A times a transposed B goes by dot products. Both kernels, and
+    // the density up to which the sparse one wins, are AVX-512 ones; with
+    // any other kernel, asked for or all the CPU has, B is packed.
+    bool avx512 = strcmp(kernel->name, "avx512") == 0;
+    if (avx512 && IsMostlyZero(matA, SPARSE_MAX_DENSITY))
+    {
+        sparse_a = CreateCsrMatrix(matA);
+        if (transpose_b)
+        {
+            matrix_t *b = TransposeMatrix(matB);
+            DestroyMatrix(matB);
+            matB = b;
+        }
+    }
+    else if (avx512 && transpose_b && m <= DOT_MAX_ROWS)
+    {
+        dot_products = true;
+    }
+    else if (use_strassen)
+    {
+        strassen = CreateStrassen(kernel, matA, matB, matC, num_threads, cutoff);
+        if (strassen->levels == 0)
+        {
+            DestroyStrassen(strassen);
+            strassen = NULL;
+        }
+    }
+
+    if (sparse_a == NULL && !dot_products && strassen == NULL)
+    {
+        gemm = CreateParallelGemm(kernel, matA, matB, transpose_b, matC, num_threads);
+    }
+
+    if (RunThreads(ThreadMain) != 0)
+    {
+        return -1;
+    }
+
+    DestroyParallelGemm(gemm);
+    DestroyStrassen(strassen);
+    DestroyCsrMatrix(sparse_a);
+    DestroyMatrix(matA);
+    DestroyMatrix(matB);
+    DestroyMatrix(matC);
+
+    printf("The end.\n");
+
+    return 0;
+}
+
+int RunThreads(void * (*thread_main)(void *))
+{
+    size_t spawnedThreads = num_threads;
 
     pthread_t * threads = (pthread_t *)malloc(sizeof(pthread_t) * spawnedThreads);
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(threads, "threads");
 
     for (size_t i = 0; i < spawnedThreads; i++)
     {
-        if (0 != pthread_create(threads+i, NULL, ThreadMain, (void *)i))
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        PinThread(&attr, i);
+
+        if (0 != pthread_create(threads+i, &attr, thread_main, (void *)i))
         {
-            fprintf(stderr, "Error creating a thread: %i.\n", i);
+            fprintf(stderr, "Error creating a thread: %zu.\n", i);
             return -1;
         }
+
+        pthread_attr_destroy(&attr);
     }
 
     for (unsigned int i = 0; i < spawnedThreads; i++)
@@ -77,7 +270,7 @@ int main(int argc, char *argv[])
         pthread_join(*(threads+i), NULL);
     }
 
-    printf("The end.\n");
+    free(threads);
 
     return 0;
 }
@@ -86,40 +279,246 @@ void * ThreadMain(void *threadid)
 {
     size_t tid = (size_t)threadid;
 
-    size_t thread_work_units = work_units;
-    size_t start_cell = work_units * tid;
-    if (tid < auxiliary_units)
+    if (sparse_a != NULL)
+    {
+        // Equal shares of the nonzeros
+        SparseDenseRows(sparse_a, matB, matC, CsrRowSplit(sparse_a, num_threads, tid),
+                        CsrRowSplit(sparse_a, num_threads, tid + 1));
+    }
+    else if (dot_products)
+    {
+        // A is short, the threads split C by columns.
+        DotProductColumns(matA, matB, matC, p * tid / num_threads, p * (tid + 1) / num_threads);
+    }
+    else if (strassen != NULL)
+    {
+        Strassen(strassen, tid);
+    }
+    else
+    {
+        ParallelGemm(gemm, tid);
+    }
+
+    return 0;
+}
+
+// A and B are generated in the shape they are stored in, C as well when
+// beta makes its old values matter.
+template <typename T>
+int RunTypedGemm()
+{
+    typedef typename gemm_accumulator_t<T>::type acc_t;
+
+    typed_gemm_t<T> config;
+    config.kernel = SelectTypedKernel<T>(kernel_name);
+    if (config.kernel == NULL)
+    {
+        fprintf(stderr, "The CPU does not support the %s kernel.\n", kernel_name);
+        return -1;
+    }
+
+    config.trans_a = transpose_a;
+    config.trans_b = transpose_b;
+    config.m = m;
+    config.n = n;
+    config.p = p;
+    config.alpha = (acc_t)alpha;
+    config.beta = (acc_t)beta;
+    config.a = transpose_a ? GenerateTypedMatrix<T>(n, m, RAND_SEED) : GenerateTypedMatrix<T>(m, n, RAND_SEED);
+    config.b = transpose_b ? GenerateTypedMatrix<T>(p, n, RAND_SEED) : GenerateTypedMatrix<T>(n, p, RAND_SEED);
+    config.lda = transpose_a ? m : n;
+    config.ldb = transpose_b ? n : p;
+    config.c = beta != 0 ? GenerateTypedMatrix<acc_t>(m, p, RAND_SEED)
+                         : AllocateTyped<acc_t>(m * p);
+    config.ldc = p;
+    typed_gemm = &config;
+
+    // Whole micro-tiles of rows per thread
+    size_t tiles = (m + config.kernel->mr - 1) / config.kernel->mr;
+    typed_row_block = (tiles + num_threads - 1) / num_threads * config.kernel->mr;
+
+    int result = RunThreads(TypedThreadMain<T>);
+
+    free((void *)config.a);
+    free((void *)config.b);
+    free(config.c);
+
+    if (result == 0)
+    {
+        printf("The end.\n");
+    }
+
+    return result;
+}
+
+// The batch is handed to a pool of num_threads workers, which splits it by
+// groups of interleaved matrices.
+int RunBatchedGemm()
+{
+    thread_pool_t *pool = CreateThreadPool(num_threads);
+    batched_gemm_t *batched = CreateBatchedGemm(m, n, p, kernel_name, pool);
+    if (batched == NULL)
     {
-        thread_work_units += 1;
+        fprintf(stderr, "The %s kernel is not available for batched multiplication.\n", kernel_name);
+        DestroyThreadPool(pool);
+        return -1;
     }
 
-    start_cell += (tid < auxiliary_units) ? tid : auxiliary_units;
+    matrix_batch_t *a = GenerateMatrixBatch(batch_count, m, n, RAND_SEED);
+    matrix_batch_t *b = GenerateMatrixBatch(batch_count, n, p, RAND_SEED);
+    matrix_batch_t *c = CreateMatrixBatch(batch_count, m, p);
+
+    int result = BatchedGemm(batched, a, b, c) == SUCCESS ? 0 : -1;
 
-    size_t column = start_cell % p;
-    size_t row = start_cell / p;
+    DestroyMatrixBatch(a);
+    DestroyMatrixBatch(b);
+    DestroyMatrixBatch(c);
+    DestroyBatchedGemm(batched);
+    DestroyThreadPool(pool);
 
-    for (size_t i = 0; i < thread_work_units; i++)
+    if (result == 0)
     {
-        matC[row][column] = 0;
+        printf("The end.\n");
+    }
+
+    return result;
+}
+
+// Only the tile buffers are in memory, the matrices stay in their files.
+int RunOutOfCoreGemm()
+{
+    kernel = SelectGemmKernel(kernel_name);
+    if (kernel == NULL)
+    {
+        fprintf(stderr, "The CPU does not support the %s kernel.\n", kernel_name);
+        return -1;
+    }
+
+    tiled_matrix_t *a = PrepareTiledOperand(ooc_prefix, "a", m, n);
+    tiled_matrix_t *b = a != NULL ? PrepareTiledOperand(ooc_prefix, "b", n, p) : NULL;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s_c.tiles", ooc_prefix);
+    tiled_matrix_t *c = b != NULL ? CreateTiledMatrix(path, m, p, ooc_tile) : NULL;
+
+    ooc = c != NULL ? CreateOutOfCoreGemm(kernel, a, b, c, num_threads, ooc_io_threads, ooc_memory << 20) : NULL;
+    int result = ooc != NULL ? RunThreads(OutOfCoreThreadMain) : -1;
 
-        for (size_t j = 0; j < p; j++)
+    DestroyOutOfCoreGemm(ooc);
+    CloseTiledMatrix(a);
+    CloseTiledMatrix(b);
+    CloseTiledMatrix(c);
+
+    if (result == 0)
+    {
+        printf("The end.\n");
+    }
+
+    return result;
+}
+
+void * OutOfCoreThreadMain(void *threadid)
+{
+    OutOfCoreGemm(ooc, (size_t)threadid);
+    return 0;
+}
+
+// The existing <prefix>_<name>.tiles if it holds a rows x columns matrix
+// in tiles of the requested size, a newly generated one otherwise. The
+// values are drawn in row-major order, as GenerateMatrix draws them, and
+// every band of tiles is dropped from memory once filled.
+tiled_matrix_t * PrepareTiledOperand(const char *prefix, const char *name, size_t rows, size_t columns)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s_%s.tiles", prefix, name);
+
+    size_t tile = (ooc_tile + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+    if (access(path, F_OK) == 0)
+    {
+        tiled_matrix_t *matrix = OpenTiledMatrix(path);
+        if (matrix != NULL && matrix->rows == rows && matrix->columns == columns && matrix->tile == tile)
         {
-            matC[row][column] += matA[row][j] * matB[j][column];
+            return matrix;
         }
 
-        column++;
+        CloseTiledMatrix(matrix);
+    }
+
+    tiled_matrix_t *matrix = CreateTiledMatrix(path, rows, columns, tile);
+    if (matrix == NULL)
+    {
+        return NULL;
+    }
+
+    if (!rand_initialized)
+    {
+        srand(RAND_SEED);
+        rand_initialized = true;
+    }
+
+    for (size_t i = 0; i < rows; i++)
+    {
+        for (size_t j = 0; j < columns; j++)
+        {
+            *TiledMatrixElement(matrix, i, j) = rand() % (MAX_U_SHORT + 1);
+        }
 
-        if (column >= p)
+        if ((i + 1) % matrix->tile == 0 || i + 1 == rows)
         {
-            column = 0;
-            row++;
+            ReleaseTiles(matrix, i / matrix->tile * matrix->tile_columns, matrix->tile_columns);
         }
     }
 
+    return matrix;
+}
+
+template <typename T>
+void * TypedThreadMain(void *threadid)
+{
+    size_t tid = (size_t)threadid;
+    const typed_gemm_t<T> *config = (const typed_gemm_t<T> *)typed_gemm;
+
+    size_t row_start = tid * typed_row_block < m ? tid * typed_row_block : m;
+    size_t row_end = row_start + typed_row_block < m ? row_start + typed_row_block : m;
+    if (row_start < row_end)
+    {
+        typed_workspace_t<T> *workspace = CreateTypedWorkspace<T>();
+        TypedGemmRows(workspace, config, row_start, row_end);
+        DestroyTypedWorkspace(workspace);
+    }
+
     return 0;
 }
 
-int** GenerateMatrix(size_t rows, size_t columns, unsigned int seed)
+// Thread tid runs on the tid-th CPU the process may use, round robin.
+void PinThread(pthread_attr_t *attr, size_t tid)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+    {
+        return;
+    }
+
+    size_t skip = tid % (size_t)CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed) || skip-- > 0)
+        {
+            continue;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+        return;
+    }
+}
+
+// Integer values are exact in double, so are the products as long as
+// n * MAX_U_SHORT^2 stays below 2^53. With nonzeros below 1 each element
+// is kept with that probability and zero otherwise.
+matrix_t * GenerateMatrix(size_t rows, size_t columns, double nonzeros, unsigned int seed)
 {
     if (!rand_initialized)
     {
@@ -128,16 +527,162 @@ int** GenerateMatrix(size_t rows, size_t columns, unsigned int seed)
     }
 
     // Initializing matrix elements
-    int** matrix = (int**) malloc(m * sizeof(int*));
-    for (unsigned int i = 0; i < rows; i++)
+    matrix_t *matrix = CreateMatrix(rows, columns);
+    for (size_t i = 0; i < rows * columns; i++)
+    {
+        matrix->data[i] = rand() % (MAX_U_SHORT + 1);
+        if (nonzeros < 1 && rand() >= nonzeros * RAND_MAX)
+        {
+            matrix->data[i] = 0;
+        }
+    }
+
+    return matrix;
+}
+
+matrix_batch_t * GenerateMatrixBatch(size_t count, size_t rows, size_t columns, unsigned int seed)
+{
+    if (!rand_initialized)
+    {
+        srand(seed);
+        rand_initialized = true;
+    }
+
+    matrix_batch_t *batch = CreateMatrixBatch(count, rows, columns);
+    for (size_t index = 0; index < count; index++)
+    {
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t j = 0; j < columns; j++)
+            {
+                *BatchElement(batch, index, i, j) = rand() % (MAX_U_SHORT + 1);
+            }
+        }
+    }
+
+    return batch;
+}
+
+// Signed types get values centred on zero, as quantized data is.
+template <typename T>
+T * GenerateTypedMatrix(size_t rows, size_t columns, unsigned int seed)
+{
+    if (!rand_initialized)
+    {
+        srand(seed);
+        rand_initialized = true;
+    }
+
+    T *matrix = AllocateTyped<T>(rows * columns);
+    for (size_t i = 0; i < rows * columns; i++)
     {
-        matrix[i] = (int*) malloc(n * sizeof(int));
-        for (unsigned int j = 0; j < columns; j++)
+        if (sizeof(T) == 1)
+        {
+            matrix[i] = (T)(rand() % 256 - 128);
+        }
+        else if (sizeof(T) == 2)
         {
-            matrix[i][j] = rand() % (MAX_U_SHORT + 1);
+            matrix[i] = (T)(rand() % (MAX_U_SHORT + 1) - 32768);
+        }
+        else
+        {
+            matrix[i] = (T)(rand() % (MAX_U_SHORT + 1));
         }
     }
 
     return matrix;
 }
 
+void ParseOptions(int argc, char *argv[])
+{
+    for (int i = 5; i < argc; i++)
+    {
+        char *value = strchr(argv[i], '=');
+        if (value == NULL)
+        {
+            fprintf(stderr, "Expected name=value, got: %s.\n", argv[i]);
+            exit(1);
+        }
+
+        size_t length = (size_t)(value - argv[i]);
+        value++;
+
+        if (length == strlen("kernel") && strncmp(argv[i], "kernel", length) == 0)
+        {
+            kernel_name = value;
+        }
+        else if (length == strlen("algorithm") && strncmp(argv[i], "algorithm", length) == 0)
+        {
+            use_strassen = strcmp(value, "strassen") == 0;
+        }
+        else if (length == strlen("cutoff") && strncmp(argv[i], "cutoff", length) == 0)
+        {
+            cutoff = atoi(value) > 0 ? (size_t)atoi(value) : 1;
+        }
+        else if (length == strlen("type") && strncmp(argv[i], "type", length) == 0)
+        {
+            if (strcmp(value, "float") == 0)
+            {
+                element_type = ELEMENT_FLOAT;
+            }
+            else if (strcmp(value, "int32") == 0)
+            {
+                element_type = ELEMENT_INT32;
+            }
+            else if (strcmp(value, "int16") == 0)
+            {
+                element_type = ELEMENT_INT16;
+            }
+            else if (strcmp(value, "int8") == 0)
+            {
+                element_type = ELEMENT_INT8;
+            }
+            else
+            {
+                element_type = ELEMENT_DOUBLE;
+            }
+        }
+        else if (length == strlen("transpose") && strncmp(argv[i], "transpose", length) == 0)
+        {
+            transpose_a = strcmp(value, "a") == 0 || strcmp(value, "both") == 0;
+            transpose_b = strcmp(value, "b") == 0 || strcmp(value, "both") == 0;
+        }
+        else if (length == strlen("alpha") && strncmp(argv[i], "alpha", length) == 0)
+        {
+            alpha = atof(value);
+        }
+        else if (length == strlen("beta") && strncmp(argv[i], "beta", length) == 0)
+        {
+            beta = atof(value);
+        }
+        else if (length == strlen("batch") && strncmp(argv[i], "batch", length) == 0)
+        {
+            batch_count = atoi(value) > 0 ? (size_t)atoi(value) : 0;
+        }
+        else if (length == strlen("density") && strncmp(argv[i], "density", length) == 0)
+        {
+            density = atof(value);
+        }
+        else if (length == strlen("out_of_core") && strncmp(argv[i], "out_of_core", length) == 0)
+        {
+            ooc_prefix = value;
+        }
+        else if (length == strlen("tile") && strncmp(argv[i], "tile", length) == 0)
+        {
+            ooc_tile = atoi(value) > 0 ? (size_t)atoi(value) : 1;
+        }
+        else if (length == strlen("memory") && strncmp(argv[i], "memory", length) == 0)
+        {
+            ooc_memory = atoi(value) > 0 ? (size_t)atoi(value) : 0;
+        }
+        else if (length == strlen("io_threads") && strncmp(argv[i], "io_threads", length) == 0)
+        {
+            ooc_io_threads = atoi(value) > 0 ? (size_t)atoi(value) : 1;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s.\n", argv[i]);
+            exit(1);
+        }
+    }
+}
@@ -0,0 +1,223 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "typedefs.h"
+#include "matrix.h"
+#include "gemm.h"
+#include "tiled_matrix.h"
+#include "ooc_gemm.h"
+
+static void * IoThreadMain(void *args);
+static void LoadTile(const tiled_matrix_t *matrix, size_t tile_row, size_t tile_column, double *buffer);
+
+ooc_gemm_t * CreateOutOfCoreGemm(const gemm_kernel_t *kernel, const tiled_matrix_t *a, const tiled_matrix_t *b,
+                                 tiled_matrix_t *c, size_t num_threads, size_t num_io_threads, size_t memory)
+{
+    if (a->tile != b->tile || a->tile != c->tile || a->columns != b->rows || a->rows != c->rows ||
+        b->columns != c->columns)
+    {
+        fprintf(stderr, "The tiled matrices do not fit together.\n");
+        return NULL;
+    }
+
+    ooc_gemm_t *gemm = (ooc_gemm_t *)calloc(1, sizeof(ooc_gemm_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm, "gemm");
+
+    size_t tile = a->tile;
+    gemm->a = a;
+    gemm->b = b;
+    gemm->c = c;
+    gemm->num_threads = num_threads;
+    gemm->num_io_threads = num_io_threads > 0 ? num_io_threads : 1;
+    gemm->steps = c->tile_rows * c->tile_columns * a->tile_columns;
+
+    gemm->num_slots = memory / (2 * a->tile_bytes);
+    gemm->num_slots = gemm->num_slots > 2 ? gemm->num_slots : 2;
+    gemm->num_slots = gemm->num_slots < gemm->steps ? gemm->num_slots : (gemm->steps > 0 ? gemm->steps : 1);
+
+    gemm->slots = (ooc_slot_t *)malloc(gemm->num_slots * sizeof(ooc_slot_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->slots, "gemm->slots");
+    for (size_t s = 0; s < gemm->num_slots; s++)
+    {
+        gemm->slots[s].step = s;
+        gemm->slots[s].ready = false;
+        gemm->slots[s].pending = num_threads;
+        gemm->slots[s].a = AllocateUntouched(tile * tile);
+        gemm->slots[s].b = AllocateUntouched(tile * tile);
+    }
+
+    gemm->c_tile = AllocateUntouched(tile * tile);
+    gemm->row_starts = (size_t *)malloc((num_threads + 1) * sizeof(size_t));
+    gemm->workspaces = (gemm_workspace_t **)malloc(num_threads * sizeof(gemm_workspace_t *));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->row_starts, "gemm->row_starts");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->workspaces, "gemm->workspaces");
+
+    size_t panels = (tile + kernel->mr - 1) / kernel->mr;
+    for (size_t t = 0; t <= num_threads; t++)
+    {
+        size_t start = panels * t / num_threads * kernel->mr;
+        gemm->row_starts[t] = start < tile ? start : tile;
+    }
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        gemm->workspaces[t] = CreateGemmWorkspace(kernel);
+    }
+
+    pthread_mutex_init(&gemm->mutex, NULL);
+    pthread_cond_init(&gemm->loaded_cond, NULL);
+    pthread_cond_init(&gemm->freed_cond, NULL);
+
+    gemm->io_threads = (pthread_t *)malloc(gemm->num_io_threads * sizeof(pthread_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(gemm->io_threads, "gemm->io_threads");
+    for (size_t t = 0; t < gemm->num_io_threads; t++)
+    {
+        if (0 != pthread_create(gemm->io_threads + t, NULL, IoThreadMain, gemm))
+        {
+            fprintf(stderr, "Error creating an I/O thread: %zu.\n", t);
+            exit(1);
+        }
+    }
+
+    return gemm;
+}
+
+void DestroyOutOfCoreGemm(ooc_gemm_t *gemm)
+{
+    if (gemm == NULL)
+    {
+        return;
+    }
+
+    for (size_t t = 0; t < gemm->num_io_threads; t++)
+    {
+        pthread_join(gemm->io_threads[t], NULL);
+    }
+
+    pthread_cond_destroy(&gemm->freed_cond);
+    pthread_cond_destroy(&gemm->loaded_cond);
+    pthread_mutex_destroy(&gemm->mutex);
+
+    for (size_t t = 0; t < gemm->num_threads; t++)
+    {
+        DestroyGemmWorkspace(gemm->workspaces[t]);
+    }
+
+    for (size_t s = 0; s < gemm->num_slots; s++)
+    {
+        free(gemm->slots[s].a);
+        free(gemm->slots[s].b);
+    }
+
+    free(gemm->io_threads);
+    free(gemm->workspaces);
+    free(gemm->row_starts);
+    free(gemm->c_tile);
+    free(gemm->slots);
+    free(gemm);
+}
+
+// Takes the steps in order, each as soon as its slot is free. With several
+// I/O threads the reads of consecutive steps proceed in parallel.
+static void * IoThreadMain(void *args)
+{
+    ooc_gemm_t *gemm = (ooc_gemm_t *)args;
+    size_t depth = gemm->a->tile_columns;
+    size_t columns = gemm->c->tile_columns;
+
+    pthread_mutex_lock(&gemm->mutex);
+    while (gemm->next_load < gemm->steps)
+    {
+        size_t step = gemm->next_load++;
+        ooc_slot_t *slot = gemm->slots + step % gemm->num_slots;
+
+        while (slot->step != step)
+        {
+            pthread_cond_wait(&gemm->freed_cond, &gemm->mutex);
+        }
+        pthread_mutex_unlock(&gemm->mutex);
+
+        size_t k = step % depth, j = step / depth % columns, i = step / depth / columns;
+        LoadTile(gemm->a, i, k, slot->a);
+        LoadTile(gemm->b, k, j, slot->b);
+
+        pthread_mutex_lock(&gemm->mutex);
+        slot->ready = true;
+        pthread_cond_broadcast(&gemm->loaded_cond);
+    }
+    pthread_mutex_unlock(&gemm->mutex);
+
+    return NULL;
+}
+
+// Copies the tile out of the mapping and drops its pages again, so the
+// mapped files never hold more than the tiles being copied.
+static void LoadTile(const tiled_matrix_t *matrix, size_t tile_row, size_t tile_column, double *buffer)
+{
+    size_t index = tile_row * matrix->tile_columns + tile_column;
+
+    PrefetchTiles(matrix, index, 1);
+    memcpy(buffer, TiledMatrixTile(matrix, tile_row, tile_column), matrix->tile_bytes);
+    ReleaseTiles(matrix, index, 1);
+}
+
+void OutOfCoreGemm(ooc_gemm_t *gemm, size_t tid)
+{
+    size_t tile = gemm->a->tile;
+    size_t depth = gemm->a->tile_columns;
+    size_t columns = gemm->c->tile_columns;
+    size_t row_start = gemm->row_starts[tid], row_end = gemm->row_starts[tid + 1];
+
+    matrix_t c_tile = { tile, tile, tile, gemm->c_tile };
+
+    for (size_t step = 0; step < gemm->steps; step++)
+    {
+        ooc_slot_t *slot = gemm->slots + step % gemm->num_slots;
+
+        pthread_mutex_lock(&gemm->mutex);
+        while (slot->step != step || !slot->ready)
+        {
+            pthread_cond_wait(&gemm->loaded_cond, &gemm->mutex);
+        }
+        pthread_mutex_unlock(&gemm->mutex);
+
+        size_t k = step % depth, j = step / depth % columns, i = step / depth / columns;
+        matrix_t a_tile = { tile, tile, tile, slot->a };
+        matrix_t b_tile = { tile, tile, tile, slot->b };
+
+        if (row_start < row_end)
+        {
+            GemmRows(gemm->workspaces[tid], &a_tile, &b_tile, &c_tile, row_start, row_end, k > 0);
+        }
+
+        // The rows of C(I, J) are final after the last K, each thread
+        // writes back its own.
+        bool last = k == depth - 1;
+        if (last && row_start < row_end)
+        {
+            memcpy(TiledMatrixTile(gemm->c, i, j) + row_start * tile, gemm->c_tile + row_start * tile,
+                   (row_end - row_start) * tile * sizeof(double));
+        }
+
+        pthread_mutex_lock(&gemm->mutex);
+        bool released = --slot->pending == 0;
+        if (released)
+        {
+            slot->step = step + gemm->num_slots;
+            slot->ready = false;
+            slot->pending = gemm->num_threads;
+            pthread_cond_broadcast(&gemm->freed_cond);
+        }
+        pthread_mutex_unlock(&gemm->mutex);
+
+        if (released && last)
+        {
+            ReleaseTiles(gemm->c, i * columns + j, 1);
+        }
+    }
+}
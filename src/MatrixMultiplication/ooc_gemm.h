@@ -0,0 +1,62 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include <pthread.h>
+#include "typedefs.h"
+#include "gemm.h"
+#include "tiled_matrix.h"
+
+#define OOC_DEFAULT_TILE 1024
+#define OOC_DEFAULT_MEMORY 256 // MB of tile buffers
+#define OOC_DEFAULT_IO_THREADS 2
+
+// Pair of tile buffers holding the A and B tiles of one step.
+typedef struct ooc_slot_t
+{
+    size_t step;    // step the slot is loading or holds
+    bool ready;     // the tiles of step are in the buffers
+    size_t pending; // compute threads yet to finish the step
+    double *a, *b;
+} ooc_slot_t;
+
+// C = A B with all three matrices in tiled files. Step s of the
+// multiplication adds A(I, K) B(K, J) to the tile C(I, J), with
+// s = (I * C tile columns + J) * A tile columns + K. The I/O threads load
+// the tiles of the upcoming steps into a ring of slots, as far ahead as
+// there are free slots, while the compute threads multiply the tiles of
+// the current one. Step s uses slot s % num_slots, so the memory used is
+// the ring, one C tile and the packing buffers of the compute threads,
+// whatever the size of the matrices.
+typedef struct ooc_gemm_t
+{
+    const tiled_matrix_t *a, *b;
+    tiled_matrix_t *c;
+    size_t num_threads;
+    size_t num_io_threads;
+    size_t steps;
+    size_t num_slots;
+    ooc_slot_t *slots;
+    double *c_tile;      // C tile in progress, each compute thread owns its rows
+    size_t *row_starts;  // num_threads + 1 row boundaries in a tile, multiples of MR
+    gemm_workspace_t **workspaces;
+    size_t next_load;    // next step an I/O thread takes
+    pthread_mutex_t mutex;
+    pthread_cond_t loaded_cond; // a slot was loaded
+    pthread_cond_t freed_cond;  // a slot was handed to a later step
+    pthread_t *io_threads;
+} ooc_gemm_t;
+
+// Starts the I/O threads, which begin loading right away. memory is the
+// budget for the slots in bytes, two slots are used at least. NULL if the
+// tiles of a, b and c do not match.
+ooc_gemm_t * CreateOutOfCoreGemm(const gemm_kernel_t *kernel, const tiled_matrix_t *a, const tiled_matrix_t *b,
+                                 tiled_matrix_t *c, size_t num_threads, size_t num_io_threads, size_t memory);
+
+// Waits for the I/O threads and frees the buffers.
+void DestroyOutOfCoreGemm(ooc_gemm_t *gemm);
+
+// Collective: every compute thread tid < num_threads calls it once.
+void OutOfCoreGemm(ooc_gemm_t *gemm, size_t tid);
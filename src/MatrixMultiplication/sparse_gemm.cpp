@@ -0,0 +1,213 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "sparse_gemm.h"
+
+// Columns [0, width) of one row of C from the count nonzeros of the row of
+// A, each selecting a row of B with row stride ldb.
+typedef void (*sparse_row_t)(size_t count, const double *values, const size_t *columns, const double *b, size_t ldb,
+                             size_t width, double *c);
+
+static void ScalarSparseRow(size_t count, const double *values, const size_t *columns, const double *b, size_t ldb,
+                            size_t width, double *c);
+
+bool IsMostlyZero(const matrix_t *a, double max_density)
+{
+    size_t limit = (size_t)(max_density * (double)(a->rows * a->columns));
+    size_t nonzeros = 0;
+
+    for (size_t i = 0; i < a->rows; i++)
+    {
+        const double *row = a->data + i * a->stride;
+        for (size_t j = 0; j < a->columns; j++)
+        {
+            nonzeros += row[j] != 0;
+        }
+
+        if (nonzeros > limit)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+csr_matrix_t * CreateCsrMatrix(const matrix_t *dense)
+{
+    csr_matrix_t *csr = (csr_matrix_t *)malloc(sizeof(csr_matrix_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(csr, "csr");
+
+    csr->rows = dense->rows;
+    csr->columns = dense->columns;
+    csr->row_starts = (size_t *)malloc((dense->rows + 1) * sizeof(size_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(csr->row_starts, "csr->row_starts");
+
+    size_t nonzeros = 0;
+    for (size_t i = 0; i < dense->rows; i++)
+    {
+        csr->row_starts[i] = nonzeros;
+        for (size_t j = 0; j < dense->columns; j++)
+        {
+            nonzeros += dense->data[i * dense->stride + j] != 0;
+        }
+    }
+    csr->row_starts[dense->rows] = nonzeros;
+    csr->nonzeros = nonzeros;
+
+    csr->column_indices = (size_t *)malloc((nonzeros > 0 ? nonzeros : 1) * sizeof(size_t));
+    csr->values = (double *)malloc((nonzeros > 0 ? nonzeros : 1) * sizeof(double));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(csr->column_indices, "csr->column_indices");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(csr->values, "csr->values");
+
+    size_t next = 0;
+    for (size_t i = 0; i < dense->rows; i++)
+    {
+        for (size_t j = 0; j < dense->columns; j++)
+        {
+            double value = dense->data[i * dense->stride + j];
+            if (value != 0)
+            {
+                csr->column_indices[next] = j;
+                csr->values[next] = value;
+                next++;
+            }
+        }
+    }
+
+    return csr;
+}
+
+void DestroyCsrMatrix(csr_matrix_t *csr)
+{
+    if (csr == NULL)
+    {
+        return;
+    }
+
+    free(csr->values);
+    free(csr->column_indices);
+    free(csr->row_starts);
+    free(csr);
+}
+
+// Rows are weighed by their nonzeros plus one, so that empty rows, which
+// still have a row of C to clear, count as well.
+size_t CsrRowSplit(const csr_matrix_t *a, size_t parts, size_t part)
+{
+    size_t target = (a->nonzeros + a->rows) * part / parts;
+
+    // First row whose start is at or past the target.
+    size_t low = 0, high = a->rows;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (a->row_starts[middle] + middle < target)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static void ScalarSparseRow(size_t count, const double *values, const size_t *columns, const double *b, size_t ldb,
+                            size_t width, double *c)
+{
+    memset(c, 0, width * sizeof(double));
+
+    for (size_t nz = 0; nz < count; nz++)
+    {
+        const double *row = b + columns[nz] * ldb;
+        for (size_t j = 0; j < width; j++)
+        {
+            c[j] += values[nz] * row[j];
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// 32 columns of C stay in four registers over all the nonzeros of the row,
+// so the loop only loads B; the tail goes 8 columns at a time, masked.
+__attribute__((target("avx512f")))
+static void Avx512SparseRow(size_t count, const double *values, const size_t *columns, const double *b, size_t ldb,
+                            size_t width, double *c)
+{
+    size_t j = 0;
+    for (; j + 32 <= width; j += 32)
+    {
+        __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+        __m512d sum2 = _mm512_setzero_pd(), sum3 = _mm512_setzero_pd();
+
+        for (size_t nz = 0; nz < count; nz++)
+        {
+            __m512d value = _mm512_set1_pd(values[nz]);
+            const double *row = b + columns[nz] * ldb + j;
+            sum0 = _mm512_fmadd_pd(value, _mm512_loadu_pd(row), sum0);
+            sum1 = _mm512_fmadd_pd(value, _mm512_loadu_pd(row + 8), sum1);
+            sum2 = _mm512_fmadd_pd(value, _mm512_loadu_pd(row + 16), sum2);
+            sum3 = _mm512_fmadd_pd(value, _mm512_loadu_pd(row + 24), sum3);
+        }
+
+        _mm512_storeu_pd(c + j, sum0);
+        _mm512_storeu_pd(c + j + 8, sum1);
+        _mm512_storeu_pd(c + j + 16, sum2);
+        _mm512_storeu_pd(c + j + 24, sum3);
+    }
+
+    for (; j < width; j += 8)
+    {
+        __mmask8 mask = width - j < 8 ? (__mmask8)((1u << (width - j)) - 1) : (__mmask8)0xFF;
+        __m512d sum = _mm512_setzero_pd();
+
+        for (size_t nz = 0; nz < count; nz++)
+        {
+            sum = _mm512_fmadd_pd(_mm512_set1_pd(values[nz]), _mm512_maskz_loadu_pd(mask, b + columns[nz] * ldb + j),
+                                  sum);
+        }
+
+        _mm512_mask_storeu_pd(c + j, mask, sum);
+    }
+}
+
+#endif
+
+void SparseDenseRows(const csr_matrix_t *a, const matrix_t *b, matrix_t *c, size_t row_start, size_t row_end)
+{
+    sparse_row_t sparse_row = ScalarSparseRow;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        sparse_row = Avx512SparseRow;
+    }
+#endif
+
+    // The columns of B go in panels narrow enough for all the rows of B to
+    // stay in L2 while the rows of A pass.
+    size_t panel = b->rows > 0 ? SPARSE_PANEL_BYTES / (b->rows * sizeof(double)) / 32 * 32 : c->columns;
+    panel = panel < 32 ? 32 : panel;
+
+    for (size_t jc = 0; jc < c->columns; jc += panel)
+    {
+        size_t width = c->columns - jc < panel ? c->columns - jc : panel;
+
+        for (size_t i = row_start; i < row_end; i++)
+        {
+            size_t first = a->row_starts[i];
+            sparse_row(a->row_starts[i + 1] - first, a->values + first, a->column_indices + first, b->data + jc,
+                       b->stride, width, c->data + i * c->stride + jc);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include "typedefs.h"
+
+#define SPARSE_MAX_DENSITY 0.1 // fraction of nonzeros in A up to which the AVX-512 sparse kernel wins
+#define SPARSE_PANEL_BYTES (1 << 20) // size of the column panel of B kept in L2
+
+// Compressed sparse row matrix: the nonzeros of row i are values and
+// column_indices [row_starts[i], row_starts[i + 1]), in column order.
+typedef struct csr_matrix_t
+{
+    size_t rows;
+    size_t columns;
+    size_t nonzeros;
+    size_t *row_starts; // rows + 1
+    size_t *column_indices;
+    double *values;
+} csr_matrix_t;
+
+// True if at most max_density of the elements of a are nonzero. The count
+// stops as soon as the limit is passed, so a dense matrix costs only a
+// fraction of a pass.
+bool IsMostlyZero(const matrix_t *a, double max_density);
+
+csr_matrix_t * CreateCsrMatrix(const matrix_t *dense);
+void DestroyCsrMatrix(csr_matrix_t *csr);
+
+// First row of part part of parts ranges holding about as many nonzeros
+// each; part == parts gives the number of rows.
+size_t CsrRowSplit(const csr_matrix_t *a, size_t parts, size_t part);
+
+// Rows [row_start, row_end) of C = A B. Every nonzero a(i, k) adds
+// a(i, k) times row k of B to row i of C, so B is read by rows and the
+// work is proportional to the nonzeros of A.
+void SparseDenseRows(const csr_matrix_t *a, const matrix_t *b, matrix_t *c, size_t row_start, size_t row_end);
@@ -0,0 +1,414 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "matrix.h"
+#include "gemm.h"
+#include "strassen.h"
+
+static size_t LevelStart(size_t level);
+static void SplitNode(strassen_t *strassen, size_t node, size_t level, double **arena);
+static void OperandSumsOfRow(strassen_node_t *node, size_t row);
+static void CombineRow(strassen_node_t *node, size_t row);
+static void Winograd(gemm_workspace_t *workspace, const matrix_t *a, const matrix_t *b, matrix_t *c, size_t levels,
+                     double *arena);
+static void AddScaled(matrix_t *out, const matrix_t *x, const matrix_t *y, double sign);
+static void CopyRows(const matrix_t *from, matrix_t *to, size_t rows, size_t columns, size_t row_start, size_t row_end);
+
+strassen_t * CreateStrassen(const gemm_kernel_t *kernel, const matrix_t *a, const matrix_t *b, matrix_t *c,
+                            size_t num_threads, size_t cutoff)
+{
+    strassen_t *strassen = (strassen_t *)calloc(1, sizeof(strassen_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(strassen, "strassen");
+
+    strassen->kernel = kernel;
+    strassen->a = a;
+    strassen->b = b;
+    strassen->c = c;
+    strassen->num_threads = num_threads;
+
+    size_t smallest = a->rows < a->columns ? a->rows : a->columns;
+    smallest = b->columns < smallest ? b->columns : smallest;
+    cutoff = cutoff > 0 ? cutoff : 1;
+    while (smallest >> (strassen->levels + 1) >= cutoff)
+    {
+        strassen->levels++;
+    }
+
+    // One task per thread at least, as long as the recursion is that deep.
+    size_t tasks = 1;
+    while (tasks < num_threads && strassen->parallel_levels < strassen->levels)
+    {
+        strassen->parallel_levels++;
+        tasks *= 7;
+    }
+
+    size_t unit = (size_t)1 << strassen->levels;
+    size_t m = (a->rows + unit - 1) / unit * unit;
+    size_t n = (a->columns + unit - 1) / unit * unit;
+    size_t p = (b->columns + unit - 1) / unit * unit;
+
+    strassen->num_nodes = LevelStart(strassen->parallel_levels + 1);
+    strassen->nodes = (strassen_node_t *)calloc(strassen->num_nodes, sizeof(strassen_node_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(strassen->nodes, "strassen->nodes");
+
+    strassen_node_t *root = strassen->nodes;
+    if (m != a->rows || n != a->columns || p != b->columns)
+    {
+        strassen->padded_a = CreateMatrix(m, n);
+        strassen->padded_b = CreateMatrix(n, p);
+        strassen->padded_c = CreateUntouchedMatrix(m, p);
+        root->a = *strassen->padded_a;
+        root->b = *strassen->padded_b;
+        root->c = *strassen->padded_c;
+    }
+    else
+    {
+        root->a = *a;
+        root->b = *b;
+        root->c = *c;
+    }
+
+    size_t arena_size = 0;
+    for (size_t level = 0, count = 1; level < strassen->parallel_levels; level++, count *= 7)
+    {
+        size_t mq = m >> (level + 1), nq = n >> (level + 1), pq = p >> (level + 1);
+        arena_size += count * (4 * mq * nq + 4 * nq * pq + 3 * mq * pq);
+    }
+
+    double *next = strassen->arena = AllocateUntouched(arena_size);
+    for (size_t level = 0; level < strassen->parallel_levels; level++)
+    {
+        for (size_t node = LevelStart(level); node < LevelStart(level + 1); node++)
+        {
+            SplitNode(strassen, node, level, &next);
+        }
+    }
+
+    size_t thread_arena_size = 0;
+    for (size_t level = strassen->parallel_levels + 1; level <= strassen->levels; level++)
+    {
+        size_t mq = m >> level, nq = n >> level, pq = p >> level;
+        thread_arena_size += mq * (nq > pq ? nq : pq) + nq * pq;
+    }
+
+    strassen->thread_arenas = (double **)malloc(num_threads * sizeof(double *));
+    strassen->workspaces = (gemm_workspace_t **)malloc(num_threads * sizeof(gemm_workspace_t *));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(strassen->thread_arenas, "strassen->thread_arenas");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(strassen->workspaces, "strassen->workspaces");
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        strassen->thread_arenas[t] = AllocateUntouched(thread_arena_size);
+        strassen->workspaces[t] = CreateGemmWorkspace(kernel);
+    }
+
+    InitSpinBarrier(&strassen->barrier, (unsigned int)num_threads, DEFAULT_BARRIER_SPIN);
+
+    return strassen;
+}
+
+void DestroyStrassen(strassen_t *strassen)
+{
+    if (strassen == NULL)
+    {
+        return;
+    }
+
+    for (size_t t = 0; t < strassen->num_threads; t++)
+    {
+        free(strassen->thread_arenas[t]);
+        DestroyGemmWorkspace(strassen->workspaces[t]);
+    }
+
+    free(strassen->thread_arenas);
+    free(strassen->workspaces);
+    free(strassen->arena);
+    free(strassen->nodes);
+    DestroyMatrix(strassen->padded_a);
+    DestroyMatrix(strassen->padded_b);
+    DestroyMatrix(strassen->padded_c);
+    free(strassen);
+}
+
+void Strassen(strassen_t *strassen, size_t tid)
+{
+    size_t num_threads = strassen->num_threads;
+    const matrix_t *a = strassen->a, *b = strassen->b;
+
+    if (tid == 0)
+    {
+        strassen->next_task = LevelStart(strassen->parallel_levels);
+    }
+
+    if (strassen->padded_a != NULL)
+    {
+        size_t rows = a->rows + b->rows;
+        size_t start = rows * tid / num_threads, end = rows * (tid + 1) / num_threads;
+        CopyRows(a, strassen->padded_a, a->rows, a->columns, start < a->rows ? start : a->rows,
+                 end < a->rows ? end : a->rows);
+        CopyRows(b, strassen->padded_b, b->rows, b->columns, start > a->rows ? start - a->rows : 0,
+                 end > a->rows ? end - a->rows : 0);
+    }
+
+    SpinBarrierWait(&strassen->barrier);
+
+    // Operand sums of the expanded levels, the rows of A and B quadrants of
+    // all nodes of a level shared out together.
+    for (size_t level = 0; level < strassen->parallel_levels; level++)
+    {
+        size_t first = LevelStart(level), count = LevelStart(level + 1) - first;
+        strassen_node_t *sample = strassen->nodes + first;
+        size_t rows = sample->s[0].rows + sample->t[0].rows;
+        size_t start = count * rows * tid / num_threads, end = count * rows * (tid + 1) / num_threads;
+
+        for (size_t item = start; item < end; item++)
+        {
+            OperandSumsOfRow(strassen->nodes + first + item / rows, item % rows);
+        }
+
+        SpinBarrierWait(&strassen->barrier);
+    }
+
+    while (true)
+    {
+        size_t task = __atomic_fetch_add(&strassen->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= strassen->num_nodes)
+        {
+            break;
+        }
+
+        strassen_node_t *node = strassen->nodes + task;
+        Winograd(strassen->workspaces[tid], &node->a, &node->b, &node->c,
+                 strassen->levels - strassen->parallel_levels, strassen->thread_arenas[tid]);
+    }
+
+    SpinBarrierWait(&strassen->barrier);
+
+    for (size_t level = strassen->parallel_levels; level-- > 0;)
+    {
+        size_t first = LevelStart(level), count = LevelStart(level + 1) - first;
+        size_t rows = strassen->nodes[first].p[0].rows;
+        size_t start = count * rows * tid / num_threads, end = count * rows * (tid + 1) / num_threads;
+
+        for (size_t item = start; item < end; item++)
+        {
+            CombineRow(strassen->nodes + first + item / rows, item % rows);
+        }
+
+        SpinBarrierWait(&strassen->barrier);
+    }
+
+    if (strassen->padded_c != NULL)
+    {
+        matrix_t *c = strassen->c;
+        CopyRows(strassen->padded_c, c, c->rows, c->columns, c->rows * tid / num_threads,
+                 c->rows * (tid + 1) / num_threads);
+    }
+}
+
+static size_t LevelStart(size_t level)
+{
+    size_t power = 1;
+    for (size_t l = 0; l < level; l++)
+    {
+        power *= 7;
+    }
+
+    return (power - 1) / 6;
+}
+
+// Carves the operand sums and spare products of a node out of the arena and
+// sets up its children, the products P1 .. P7 in order.
+static void SplitNode(strassen_t *strassen, size_t index, size_t level, double **arena)
+{
+    strassen_node_t *node = strassen->nodes + index;
+    size_t mq = node->a.rows / 2, nq = node->a.columns / 2, pq = node->b.columns / 2;
+
+    for (size_t k = 0; k < 4; k++)
+    {
+        node->s[k] = { mq, nq, nq, *arena };
+        *arena += mq * nq;
+        node->t[k] = { nq, pq, pq, *arena };
+        *arena += nq * pq;
+    }
+
+    for (size_t k = 0; k < 3; k++)
+    {
+        node->p[k] = { mq, pq, pq, *arena };
+        *arena += mq * pq;
+    }
+
+    matrix_t a11 = MatrixView(&node->a, 0, 0, mq, nq), a12 = MatrixView(&node->a, 0, nq, mq, nq);
+    matrix_t a22 = MatrixView(&node->a, mq, nq, mq, nq);
+    matrix_t b11 = MatrixView(&node->b, 0, 0, nq, pq), b21 = MatrixView(&node->b, nq, 0, nq, pq);
+    matrix_t b22 = MatrixView(&node->b, nq, pq, nq, pq);
+    matrix_t c11 = MatrixView(&node->c, 0, 0, mq, pq), c12 = MatrixView(&node->c, 0, pq, mq, pq);
+    matrix_t c21 = MatrixView(&node->c, mq, 0, mq, pq), c22 = MatrixView(&node->c, mq, pq, mq, pq);
+
+    strassen_node_t *children = strassen->nodes + LevelStart(level + 1) + 7 * (index - LevelStart(level));
+    const matrix_t products[7][3] =
+    {
+        { a11, b11, node->p[0] },         // P1 = A11 B11
+        { a12, b21, c11 },                // P2 = A12 B21
+        { node->s[3], b22, c12 },         // P3 = S4 B22
+        { a22, node->t[3], c21 },         // P4 = A22 T4
+        { node->s[0], node->t[0], c22 },  // P5 = S1 T1
+        { node->s[1], node->t[1], node->p[1] }, // P6 = S2 T2
+        { node->s[2], node->t[2], node->p[2] }  // P7 = S3 T3
+    };
+
+    for (size_t k = 0; k < 7; k++)
+    {
+        children[k].a = products[k][0];
+        children[k].b = products[k][1];
+        children[k].c = products[k][2];
+    }
+}
+
+// Row of the A sums for row < rows of S, of the B sums for the rows after.
+static void OperandSumsOfRow(strassen_node_t *node, size_t row)
+{
+    if (row < node->s[0].rows)
+    {
+        size_t mq = node->s[0].rows, nq = node->s[0].columns, lda = node->a.stride;
+        const double *a11 = node->a.data + row * lda, *a12 = a11 + nq;
+        const double *a21 = a11 + mq * lda, *a22 = a21 + nq;
+        double *s1 = node->s[0].data + row * nq, *s2 = node->s[1].data + row * nq;
+        double *s3 = node->s[2].data + row * nq, *s4 = node->s[3].data + row * nq;
+
+        for (size_t j = 0; j < nq; j++)
+        {
+            s1[j] = a21[j] + a22[j];
+            s2[j] = s1[j] - a11[j];
+            s3[j] = a11[j] - a21[j];
+            s4[j] = a12[j] - s2[j];
+        }
+        return;
+    }
+
+    row -= node->s[0].rows;
+    size_t nq = node->t[0].rows, pq = node->t[0].columns, ldb = node->b.stride;
+    const double *b11 = node->b.data + row * ldb, *b12 = b11 + pq;
+    const double *b21 = b11 + nq * ldb, *b22 = b21 + pq;
+    double *t1 = node->t[0].data + row * pq, *t2 = node->t[1].data + row * pq;
+    double *t3 = node->t[2].data + row * pq, *t4 = node->t[3].data + row * pq;
+
+    for (size_t j = 0; j < pq; j++)
+    {
+        t1[j] = b12[j] - b11[j];
+        t2[j] = b22[j] - t1[j];
+        t3[j] = b22[j] - b12[j];
+        t4[j] = t2[j] - b21[j];
+    }
+}
+
+// C11 = P1 + P2, C12 = P1 + P6 + P5 + P3, C21 = P1 + P6 + P7 - P4 and
+// C22 = P1 + P6 + P7 + P5 for one row of the quadrants.
+static void CombineRow(strassen_node_t *node, size_t row)
+{
+    size_t mq = node->p[0].rows, pq = node->p[0].columns, ldc = node->c.stride;
+    const double *p1 = node->p[0].data + row * pq, *p6 = node->p[1].data + row * pq;
+    const double *p7 = node->p[2].data + row * pq;
+    double *c11 = node->c.data + row * ldc, *c12 = c11 + pq;
+    double *c21 = c11 + mq * ldc, *c22 = c21 + pq;
+
+    for (size_t j = 0; j < pq; j++)
+    {
+        double u2 = p1[j] + p6[j];
+        double u3 = u2 + p7[j];
+        c11[j] = p1[j] + c11[j];
+        c12[j] = u2 + c22[j] + c12[j];
+        c21[j] = u3 - c21[j];
+        c22[j] = u3 + c22[j];
+    }
+}
+
+// Sequential C = A B in the order of Douglas et al., which needs only a
+// temporary X the size of the larger of an A and a C quadrant and Y the
+// size of a B quadrant per level, both taken from the arena.
+static void Winograd(gemm_workspace_t *workspace, const matrix_t *a, const matrix_t *b, matrix_t *c, size_t levels,
+                     double *arena)
+{
+    if (levels == 0)
+    {
+        GemmRows(workspace, a, b, c, 0, c->rows, false);
+        return;
+    }
+
+    size_t mq = a->rows / 2, nq = a->columns / 2, pq = b->columns / 2;
+    matrix_t a11 = MatrixView(a, 0, 0, mq, nq), a12 = MatrixView(a, 0, nq, mq, nq);
+    matrix_t a21 = MatrixView(a, mq, 0, mq, nq), a22 = MatrixView(a, mq, nq, mq, nq);
+    matrix_t b11 = MatrixView(b, 0, 0, nq, pq), b12 = MatrixView(b, 0, pq, nq, pq);
+    matrix_t b21 = MatrixView(b, nq, 0, nq, pq), b22 = MatrixView(b, nq, pq, nq, pq);
+    matrix_t c11 = MatrixView(c, 0, 0, mq, pq), c12 = MatrixView(c, 0, pq, mq, pq);
+    matrix_t c21 = MatrixView(c, mq, 0, mq, pq), c22 = MatrixView(c, mq, pq, mq, pq);
+
+    matrix_t x = { mq, nq, nq, arena };
+    matrix_t xc = { mq, pq, pq, arena };
+    matrix_t y = { nq, pq, pq, arena + mq * (nq > pq ? nq : pq) };
+    double *next = y.data + nq * pq;
+    levels--;
+
+    AddScaled(&x, &a11, &a21, -1);     // X = S3
+    AddScaled(&y, &b22, &b12, -1);     // Y = T3
+    Winograd(workspace, &x, &y, &c21, levels, next); // C21 = P7
+    AddScaled(&x, &a21, &a22, 1);      // X = S1
+    AddScaled(&y, &b12, &b11, -1);     // Y = T1
+    Winograd(workspace, &x, &y, &c22, levels, next); // C22 = P5
+    AddScaled(&x, &x, &a11, -1);       // X = S2
+    AddScaled(&y, &b22, &y, -1);       // Y = T2
+    Winograd(workspace, &x, &y, &c12, levels, next); // C12 = P6
+    AddScaled(&x, &a12, &x, -1);       // X = S4
+    Winograd(workspace, &x, &b22, &c11, levels, next); // C11 = P3
+    Winograd(workspace, &a11, &b11, &xc, levels, next); // X = P1
+
+    for (size_t i = 0; i < mq; i++)
+    {
+        const double *p1 = xc.data + i * pq;
+        double *r11 = c11.data + i * c->stride, *r12 = c12.data + i * c->stride;
+        double *r21 = c21.data + i * c->stride, *r22 = c22.data + i * c->stride;
+
+        for (size_t j = 0; j < pq; j++)
+        {
+            double u2 = p1[j] + r12[j]; // P1 + P6
+            double u3 = u2 + r21[j];    // + P7
+            r12[j] = u2 + r22[j] + r11[j]; // + P5 + P3
+            r22[j] = u3 + r22[j];       // + P5
+            r21[j] = u3;
+        }
+    }
+
+    AddScaled(&y, &y, &b21, -1);       // Y = T4
+    Winograd(workspace, &a22, &y, &c11, levels, next); // C11 = P4
+    AddScaled(&c21, &c21, &c11, -1);   // C21 = U3 - P4
+    Winograd(workspace, &a12, &b21, &c11, levels, next); // C11 = P2
+    AddScaled(&c11, &xc, &c11, 1);     // C11 = P1 + P2
+}
+
+// out = x + sign y, element by element, out may be x or y.
+static void AddScaled(matrix_t *out, const matrix_t *x, const matrix_t *y, double sign)
+{
+    for (size_t i = 0; i < out->rows; i++)
+    {
+        const double *xi = x->data + i * x->stride, *yi = y->data + i * y->stride;
+        double *oi = out->data + i * out->stride;
+
+        for (size_t j = 0; j < out->columns; j++)
+        {
+            oi[j] = xi[j] + sign * yi[j];
+        }
+    }
+}
+
+// Rows [row_start, row_end) of the leading rows x columns block.
+static void CopyRows(const matrix_t *from, matrix_t *to, size_t rows, size_t columns, size_t row_start, size_t row_end)
+{
+    for (size_t i = row_start; i < row_end && i < rows; i++)
+    {
+        memcpy(to->data + i * to->stride, from->data + i * from->stride, columns * sizeof(double));
+    }
+}
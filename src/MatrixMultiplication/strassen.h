@@ -0,0 +1,57 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "barrier.h"
+#include "gemm.h"
+
+#define STRASSEN_DEFAULT_CUTOFF 1024 // no product dimension is halved below it
+
+// One product of the recursion, C = A B. Expanded nodes keep the Winograd
+// operand sums of the quadrants of A and B and the products that have no
+// quadrant of C to go to; their seven children are the seven products.
+typedef struct strassen_node_t
+{
+    matrix_t a, b, c;
+    matrix_t s[4]; // S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21, S4 = A12 - S2
+    matrix_t t[4]; // T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12, T4 = T2 - B21
+    matrix_t p[3]; // P1, P6 and P7; P2 .. P5 are written to C11, C12, C21, C22
+} strassen_node_t;
+
+// Strassen-Winograd multiplication C = A B with a fixed number of halvings,
+// the dimensions being zero padded to a multiple of 2^levels when needed.
+// The first parallel_levels are expanded breadth first by all threads
+// together, the 7^parallel_levels products below them are tasks the threads
+// take in turn and finish alone with the memory saving schedule of Douglas
+// et al. (two temporaries per level) and the classical blocked kernel at
+// the bottom. All memory is allocated up front.
+typedef struct strassen_t
+{
+    const gemm_kernel_t *kernel;
+    const matrix_t *a, *b;
+    matrix_t *c;
+    size_t num_threads;
+    size_t levels;
+    size_t parallel_levels;
+    matrix_t *padded_a, *padded_b, *padded_c; // NULL without padding
+    strassen_node_t *nodes; // level l starts at (7^l - 1) / 6, tasks at parallel_levels
+    size_t num_nodes;
+    double *arena;          // operand sums and products of the expanded nodes
+    double **thread_arenas; // temporaries of the sequential recursion, per thread
+    gemm_workspace_t **workspaces;
+    size_t next_task;
+    spin_barrier_t barrier;
+} strassen_t;
+
+// levels is 0 when a dimension is below 2 cutoff. The plan is then a single
+// task running the classical kernel on one thread, the caller had better
+// use the parallel classical multiplication.
+strassen_t * CreateStrassen(const gemm_kernel_t *kernel, const matrix_t *a, const matrix_t *b, matrix_t *c,
+                            size_t num_threads, size_t cutoff);
+void DestroyStrassen(strassen_t *strassen);
+
+// Collective: every thread tid < num_threads calls it once.
+void Strassen(strassen_t *strassen, size_t tid);
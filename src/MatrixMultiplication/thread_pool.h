@@ -0,0 +1,40 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include <pthread.h>
+#include "typedefs.h"
+
+typedef void (*pool_job_t)(void *args, size_t tid);
+
+typedef struct pool_worker_t
+{
+    struct thread_pool_t *pool;
+    size_t tid;
+} pool_worker_t;
+
+// Persistent workers that all run the same job, one call per job and
+// worker, so repeated jobs cost no thread creation.
+typedef struct thread_pool_t
+{
+    size_t num_threads;
+    pthread_t *threads;
+    pool_worker_t *workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_cond;  // a job was posted or the pool stops
+    pthread_cond_t done_cond; // the last worker finished the job
+    pool_job_t job;
+    void *args;
+    size_t generation;        // jobs posted so far
+    size_t running;           // workers still in the current job
+    bool stop;
+} thread_pool_t;
+
+thread_pool_t * CreateThreadPool(size_t num_threads);
+void DestroyThreadPool(thread_pool_t *pool);
+
+// Runs job(args, tid) on every worker, tid = 0 .. num_threads - 1, and
+// returns once all of them are done.
+void RunOnThreadPool(thread_pool_t *pool, pool_job_t job, void *args);
@@ -0,0 +1,139 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "typedefs.h"
+#include "tiled_matrix.h"
+
+static tiled_matrix_t * MapTiledMatrix(const char *path, int fd, size_t size, int protection);
+
+tiled_matrix_t * CreateTiledMatrix(const char *path, size_t rows, size_t columns, size_t tile)
+{
+    tile = (tile + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+    tile = tile > 0 ? tile : TILE_ALIGNMENT;
+
+    size_t tile_rows = (rows + tile - 1) / tile, tile_columns = (columns + tile - 1) / tile;
+    size_t size = TILED_HEADER_BYTES + tile_rows * tile_columns * tile * tile * sizeof(double);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot create tiled matrix file %s.\n", path);
+        return NULL;
+    }
+
+    // A sparse file: the tiles read as zeros until they are written.
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        fprintf(stderr, "Cannot size tiled matrix file %s.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    tiled_file_header_t header;
+    memcpy(header.magic, TILED_FILE_MAGIC, sizeof(header.magic));
+    header.rows = rows;
+    header.columns = columns;
+    header.tile = tile;
+
+    if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    {
+        fprintf(stderr, "Error writing tiled matrix file %s.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    return MapTiledMatrix(path, fd, size, PROT_READ | PROT_WRITE);
+}
+
+tiled_matrix_t * OpenTiledMatrix(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot open tiled matrix file %s.\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < TILED_HEADER_BYTES)
+    {
+        fprintf(stderr, "Tiled matrix file %s is too short.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    return MapTiledMatrix(path, fd, (size_t)st.st_size, PROT_READ);
+}
+
+// Takes over fd, which is closed once mapped.
+static tiled_matrix_t * MapTiledMatrix(const char *path, int fd, size_t size, int protection)
+{
+    void *data = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map tiled matrix file %s.\n", path);
+        return NULL;
+    }
+
+    const tiled_file_header_t *header = (const tiled_file_header_t *)data;
+    size_t tile = (size_t)header->tile;
+    size_t tile_rows = tile > 0 ? (header->rows + tile - 1) / tile : 0;
+    size_t tile_columns = tile > 0 ? (header->columns + tile - 1) / tile : 0;
+
+    if (memcmp(header->magic, TILED_FILE_MAGIC, sizeof(header->magic)) != 0 || tile == 0 ||
+        tile % TILE_ALIGNMENT != 0 || size < TILED_HEADER_BYTES + tile_rows * tile_columns * tile * tile * sizeof(double))
+    {
+        fprintf(stderr, "Tiled matrix file %s is not a valid tiled matrix.\n", path);
+        munmap(data, size);
+        return NULL;
+    }
+
+    tiled_matrix_t *matrix = (tiled_matrix_t *)malloc(sizeof(tiled_matrix_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(matrix, "matrix");
+
+    matrix->rows = (size_t)header->rows;
+    matrix->columns = (size_t)header->columns;
+    matrix->tile = tile;
+    matrix->tile_rows = tile_rows;
+    matrix->tile_columns = tile_columns;
+    matrix->tile_bytes = tile * tile * sizeof(double);
+    matrix->mapping = (char *)data;
+    matrix->mapping_size = size;
+
+    return matrix;
+}
+
+void CloseTiledMatrix(tiled_matrix_t *matrix)
+{
+    if (matrix == NULL)
+    {
+        return;
+    }
+
+    munmap(matrix->mapping, matrix->mapping_size);
+    free(matrix);
+}
+
+void PrefetchTiles(const tiled_matrix_t *matrix, size_t first, size_t count)
+{
+    madvise(matrix->mapping + TILED_HEADER_BYTES + first * matrix->tile_bytes, count * matrix->tile_bytes,
+            MADV_WILLNEED);
+}
+
+// The mapping is shared, so written pages go back to the file rather than
+// being discarded.
+void ReleaseTiles(const tiled_matrix_t *matrix, size_t first, size_t count)
+{
+    madvise(matrix->mapping + TILED_HEADER_BYTES + first * matrix->tile_bytes, count * matrix->tile_bytes,
+            MADV_DONTNEED);
+}
@@ -0,0 +1,68 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include "typedefs.h"
+
+#define TILED_FILE_MAGIC "PTTILES1"
+#define TILED_HEADER_BYTES 4096 // the header is padded to a page so that the tiles are page aligned
+#define TILE_ALIGNMENT 32       // tile sides are multiples of it, a tile is then a whole number of pages
+
+// Tiled matrix file layout, native byte order:
+//   header, padded to TILED_HEADER_BYTES
+//   tiles in row-major tile order, each tile x tile doubles in row-major
+//   order, the tiles on the right and bottom edges zero padded
+typedef struct tiled_file_header_t
+{
+    char magic[8];
+    uint64_t rows;
+    uint64_t columns;
+    uint64_t tile;
+} tiled_file_header_t;
+
+// Matrix kept in a memory-mapped tiled file. A tile is one contiguous,
+// page aligned block of the file, so it can be read, written and dropped
+// from memory on its own.
+typedef struct tiled_matrix_t
+{
+    size_t rows;
+    size_t columns;
+    size_t tile;
+    size_t tile_rows;    // tiles down
+    size_t tile_columns; // tiles across
+    size_t tile_bytes;
+    char *mapping;
+    size_t mapping_size;
+} tiled_matrix_t;
+
+// New zero filled file of a rows x columns matrix, tile rounded up to a
+// multiple of TILE_ALIGNMENT. NULL if the file cannot be created.
+tiled_matrix_t * CreateTiledMatrix(const char *path, size_t rows, size_t columns, size_t tile);
+
+// Existing tiled file, NULL if it cannot be mapped or is not one.
+tiled_matrix_t * OpenTiledMatrix(const char *path);
+
+void CloseTiledMatrix(tiled_matrix_t *matrix);
+
+inline double * TiledMatrixTile(const tiled_matrix_t *matrix, size_t tile_row, size_t tile_column)
+{
+    return (double *)(matrix->mapping + TILED_HEADER_BYTES +
+                      (tile_row * matrix->tile_columns + tile_column) * matrix->tile_bytes);
+}
+
+inline double * TiledMatrixElement(const tiled_matrix_t *matrix, size_t row, size_t column)
+{
+    return TiledMatrixTile(matrix, row / matrix->tile, column / matrix->tile) +
+           row % matrix->tile * matrix->tile + column % matrix->tile;
+}
+
+// Starts reading the tiles [first, first + count) of the row-major tile
+// order in the background.
+void PrefetchTiles(const tiled_matrix_t *matrix, size_t first, size_t count);
+
+// Drops the tiles [first, first + count) from the memory of the process.
+// Their contents stay in the file, written back ones included.
+void ReleaseTiles(const tiled_matrix_t *matrix, size_t first, size_t count);
@@ -0,0 +1,329 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "gemm.h"
+#include "typed_gemm.h"
+
+#define GENERIC_MR 4
+#define GENERIC_NR 8
+
+// Portable kernel, widening every product to the accumulator type.
+template <typename T>
+static void GenericKernel(size_t kc, const T *a, const T *b, typename gemm_accumulator_t<T>::type *c, size_t ldc,
+                          bool accumulate)
+{
+    typedef typename gemm_accumulator_t<T>::type acc_t;
+    acc_t tile[GENERIC_MR][GENERIC_NR] = { { 0 } };
+
+    for (size_t k = 0; k < kc; k++)
+    {
+        for (size_t i = 0; i < GENERIC_MR; i++)
+        {
+            acc_t ai = a[k * GENERIC_MR + i];
+            for (size_t j = 0; j < GENERIC_NR; j++)
+            {
+                tile[i][j] += ai * (acc_t)b[k * GENERIC_NR + j];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < GENERIC_MR; i++)
+    {
+        for (size_t j = 0; j < GENERIC_NR; j++)
+        {
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + tile[i][j] : tile[i][j];
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+#define FLOAT_AVX2_MR 6
+#define FLOAT_AVX2_NR 16
+
+__attribute__((target("avx2,fma")))
+static void FloatAvx2Kernel(size_t kc, const float *a, const float *b, float *c, size_t ldc, bool accumulate)
+{
+    __m256 tile[FLOAT_AVX2_MR][2];
+
+#pragma GCC unroll 6
+    for (size_t i = 0; i < FLOAT_AVX2_MR; i++)
+    {
+        tile[i][0] = _mm256_setzero_ps();
+        tile[i][1] = _mm256_setzero_ps();
+    }
+
+    for (size_t k = 0; k < kc; k++)
+    {
+        __m256 b0 = _mm256_load_ps(b + k * FLOAT_AVX2_NR);
+        __m256 b1 = _mm256_load_ps(b + k * FLOAT_AVX2_NR + 8);
+
+#pragma GCC unroll 6
+        for (size_t i = 0; i < FLOAT_AVX2_MR; i++)
+        {
+            __m256 ai = _mm256_broadcast_ss(a + k * FLOAT_AVX2_MR + i);
+            tile[i][0] = _mm256_fmadd_ps(ai, b0, tile[i][0]);
+            tile[i][1] = _mm256_fmadd_ps(ai, b1, tile[i][1]);
+        }
+    }
+
+#pragma GCC unroll 6
+    for (size_t i = 0; i < FLOAT_AVX2_MR; i++)
+    {
+        float *row = c + i * ldc;
+        if (accumulate)
+        {
+            tile[i][0] = _mm256_add_ps(tile[i][0], _mm256_loadu_ps(row));
+            tile[i][1] = _mm256_add_ps(tile[i][1], _mm256_loadu_ps(row + 8));
+        }
+
+        _mm256_storeu_ps(row, tile[i][0]);
+        _mm256_storeu_ps(row + 8, tile[i][1]);
+    }
+}
+
+#define FLOAT_AVX512_MR 12
+#define FLOAT_AVX512_NR 32
+
+__attribute__((target("avx512f")))
+static void FloatAvx512Kernel(size_t kc, const float *a, const float *b, float *c, size_t ldc, bool accumulate)
+{
+    __m512 tile[FLOAT_AVX512_MR][2];
+
+#pragma GCC unroll 12
+    for (size_t i = 0; i < FLOAT_AVX512_MR; i++)
+    {
+        tile[i][0] = _mm512_setzero_ps();
+        tile[i][1] = _mm512_setzero_ps();
+    }
+
+    for (size_t k = 0; k < kc; k++)
+    {
+        __m512 b0 = _mm512_load_ps(b + k * FLOAT_AVX512_NR);
+        __m512 b1 = _mm512_load_ps(b + k * FLOAT_AVX512_NR + 16);
+
+#pragma GCC unroll 12
+        for (size_t i = 0; i < FLOAT_AVX512_MR; i++)
+        {
+            __m512 ai = _mm512_set1_ps(a[k * FLOAT_AVX512_MR + i]);
+            tile[i][0] = _mm512_fmadd_ps(ai, b0, tile[i][0]);
+            tile[i][1] = _mm512_fmadd_ps(ai, b1, tile[i][1]);
+        }
+    }
+
+#pragma GCC unroll 12
+    for (size_t i = 0; i < FLOAT_AVX512_MR; i++)
+    {
+        float *row = c + i * ldc;
+        if (accumulate)
+        {
+            tile[i][0] = _mm512_add_ps(tile[i][0], _mm512_loadu_ps(row));
+            tile[i][1] = _mm512_add_ps(tile[i][1], _mm512_loadu_ps(row + 16));
+        }
+
+        _mm512_storeu_ps(row, tile[i][0]);
+        _mm512_storeu_ps(row + 16, tile[i][1]);
+    }
+}
+
+#define INT8_VNNI_MR 12
+#define INT8_VNNI_NR 32
+#define INT8_VNNI_GROUP 4
+
+// vpdpbusd multiplies unsigned by signed bytes four at a time, so A comes
+// packed as value + 128 and the tile starts from minus 128 times the
+// column sums of B, gathered with the same instruction beforehand (the
+// tile alone fills the registers in the main loop).
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void Int8VnniKernel(size_t kc, const int8_t *a, const int8_t *b, int32_t *c, size_t ldc, bool accumulate)
+{
+    __m512i offset0 = _mm512_setzero_si512(), offset1 = _mm512_setzero_si512();
+    const __m512i bias = _mm512_set1_epi8((char)0x80);
+
+    for (size_t k = 0; k < kc; k += INT8_VNNI_GROUP)
+    {
+        offset0 = _mm512_dpbusd_epi32(offset0, bias, _mm512_load_si512((const void *)(b + k * INT8_VNNI_NR)));
+        offset1 = _mm512_dpbusd_epi32(offset1, bias, _mm512_load_si512((const void *)(b + k * INT8_VNNI_NR + 64)));
+    }
+
+    __m512i tile[INT8_VNNI_MR][2];
+
+#pragma GCC unroll 12
+    for (size_t i = 0; i < INT8_VNNI_MR; i++)
+    {
+        tile[i][0] = _mm512_sub_epi32(_mm512_setzero_si512(), offset0);
+        tile[i][1] = _mm512_sub_epi32(_mm512_setzero_si512(), offset1);
+    }
+
+    for (size_t k = 0; k < kc; k += INT8_VNNI_GROUP)
+    {
+        __m512i b0 = _mm512_load_si512((const void *)(b + k * INT8_VNNI_NR));
+        __m512i b1 = _mm512_load_si512((const void *)(b + k * INT8_VNNI_NR + 64));
+
+#pragma GCC unroll 12
+        for (size_t i = 0; i < INT8_VNNI_MR; i++)
+        {
+            int32_t group;
+            memcpy(&group, a + k * INT8_VNNI_MR + i * INT8_VNNI_GROUP, sizeof(group));
+            __m512i ai = _mm512_set1_epi32(group);
+            tile[i][0] = _mm512_dpbusd_epi32(tile[i][0], ai, b0);
+            tile[i][1] = _mm512_dpbusd_epi32(tile[i][1], ai, b1);
+        }
+    }
+
+#pragma GCC unroll 12
+    for (size_t i = 0; i < INT8_VNNI_MR; i++)
+    {
+        int32_t *row = c + i * ldc;
+        if (accumulate)
+        {
+            tile[i][0] = _mm512_add_epi32(tile[i][0], _mm512_loadu_si512((const void *)row));
+            tile[i][1] = _mm512_add_epi32(tile[i][1], _mm512_loadu_si512((const void *)(row + 16)));
+        }
+
+        _mm512_storeu_si512((void *)row, tile[i][0]);
+        _mm512_storeu_si512((void *)(row + 16), tile[i][1]);
+    }
+}
+
+#endif
+
+// features names what a kernel needs from the CPU: avx512f, avx2 (with
+// FMA), avx512vnni (with AVX-512BW) or nothing.
+static bool TypedKernelSupported(const char *features)
+{
+#if defined(__x86_64__)
+    if (strcmp(features, "avx512vnni") == 0)
+    {
+        return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+    }
+
+    if (strcmp(features, "avx512f") == 0)
+    {
+        return __builtin_cpu_supports("avx512f");
+    }
+
+    if (strcmp(features, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#endif
+
+    return features[0] == '\0';
+}
+
+// First kernel of the list the CPU supports, among those named name if any.
+template <typename T>
+static const typed_kernel_t<T> * FindTypedKernel(const typed_kernel_t<T> *kernels, const char **features, size_t count,
+                                                 const char *name)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((name == NULL || strcmp(kernels[i].name, name) == 0) && kernels[i].run != NULL
+            && TypedKernelSupported(features[i]))
+        {
+            return kernels + i;
+        }
+    }
+
+    return NULL;
+}
+
+// The double kernel of gemm.cpp with that name, with no run function if the
+// CPU lacks it.
+static typed_kernel_t<double> WrapGemmKernel(const char *name)
+{
+    const gemm_kernel_t *kernel = SelectGemmKernel(name);
+    typed_kernel_t<double> wrapped = { name, 0, 0, 1, false, NULL };
+    if (kernel != NULL)
+    {
+        wrapped.mr = kernel->mr;
+        wrapped.nr = kernel->nr;
+        wrapped.run = kernel->run;
+    }
+
+    return wrapped;
+}
+
+template <>
+const typed_kernel_t<double> * SelectTypedKernel<double>(const char *name)
+{
+    static const typed_kernel_t<double> kernels[] =
+    {
+        WrapGemmKernel("avx512"), WrapGemmKernel("avx2"), WrapGemmKernel("scalar")
+    };
+    static const char *features[] = { "", "", "" };
+
+    return FindTypedKernel(kernels, features, sizeof(kernels) / sizeof(kernels[0]), name);
+}
+
+template <>
+const typed_kernel_t<float> * SelectTypedKernel<float>(const char *name)
+{
+    static const typed_kernel_t<float> kernels[] =
+    {
+#if defined(__x86_64__)
+        { "avx512", FLOAT_AVX512_MR, FLOAT_AVX512_NR, 1, false, FloatAvx512Kernel },
+        { "avx2", FLOAT_AVX2_MR, FLOAT_AVX2_NR, 1, false, FloatAvx2Kernel },
+#endif
+        { "scalar", GENERIC_MR, GENERIC_NR, 1, false, GenericKernel<float> }
+    };
+    static const char *features[] = {
+#if defined(__x86_64__)
+        "avx512f", "avx2",
+#endif
+        "" };
+
+    return FindTypedKernel(kernels, features, sizeof(kernels) / sizeof(kernels[0]), name);
+}
+
+template <>
+const typed_kernel_t<int8_t> * SelectTypedKernel<int8_t>(const char *name)
+{
+    static const typed_kernel_t<int8_t> kernels[] =
+    {
+#if defined(__x86_64__)
+        { "avx512", INT8_VNNI_MR, INT8_VNNI_NR, INT8_VNNI_GROUP, true, Int8VnniKernel },
+#endif
+        { "scalar", GENERIC_MR, GENERIC_NR, 1, false, GenericKernel<int8_t> }
+    };
+    static const char *features[] = {
+#if defined(__x86_64__)
+        "avx512vnni",
+#endif
+        "" };
+
+    return FindTypedKernel(kernels, features, sizeof(kernels) / sizeof(kernels[0]), name);
+}
+
+template <>
+const typed_kernel_t<int16_t> * SelectTypedKernel<int16_t>(const char *name)
+{
+    static const typed_kernel_t<int16_t> kernels[] =
+    {
+        { "scalar", GENERIC_MR, GENERIC_NR, 1, false, GenericKernel<int16_t> }
+    };
+    static const char *features[] = { "" };
+
+    return FindTypedKernel(kernels, features, 1, name);
+}
+
+template <>
+const typed_kernel_t<int32_t> * SelectTypedKernel<int32_t>(const char *name)
+{
+    static const typed_kernel_t<int32_t> kernels[] =
+    {
+        { "scalar", GENERIC_MR, GENERIC_NR, 1, false, GenericKernel<int32_t> }
+    };
+    static const char *features[] = { "" };
+
+    return FindTypedKernel(kernels, features, 1, name);
+}
@@ -0,0 +1,283 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "matrix.h"
+#include "gemm.h"
+
+// C = alpha op(A) op(B) + beta C for element types other than the double
+// matrices of gemm.h, with op() an optional transposition. Products are
+// summed in a wider accumulator type, which is also the type of C, alpha
+// and beta: int8_t and int16_t inputs give int32_t and int64_t results
+// (int16_t pairs can overflow 32 bits), int32_t gives int64_t, float and
+// double stay as they are.
+
+template <typename T> struct gemm_accumulator_t;
+template <> struct gemm_accumulator_t<double> { typedef double type; };
+template <> struct gemm_accumulator_t<float> { typedef float type; };
+template <> struct gemm_accumulator_t<int32_t> { typedef int64_t type; };
+template <> struct gemm_accumulator_t<int16_t> { typedef int64_t type; };
+template <> struct gemm_accumulator_t<int8_t> { typedef int32_t type; };
+
+#define TYPED_GEMM_MAX_TILE (GEMM_MAX_MR * 32) // MR x NR of the widest kernel
+
+// Micro-kernel of the typed multiplication, same contract as
+// gemm_micro_kernel_t. Kernels with group > 1 expect the packed panels to
+// hold group consecutive k values of a row of A (a column of B) together,
+// and offset_a kernels expect A packed as unsigned bytes, value + 128.
+template <typename T>
+struct typed_kernel_t
+{
+    const char *name;
+    size_t mr, nr;
+    size_t group;
+    bool offset_a;
+    void (*run)(size_t kc, const T *a, const T *b, typename gemm_accumulator_t<T>::type *c, size_t ldc,
+                bool accumulate);
+};
+
+// The kernel for T named name (scalar, avx2 or avx512), or with name NULL
+// the widest the running CPU supports. NULL if the CPU lacks the named one.
+// Defined for double, float, int32_t, int16_t and int8_t.
+template <typename T>
+const typed_kernel_t<T> * SelectTypedKernel(const char *name);
+
+template <typename T>
+struct typed_gemm_t
+{
+    typedef typename gemm_accumulator_t<T>::type acc_t;
+
+    const typed_kernel_t<T> *kernel;
+    bool trans_a, trans_b;
+    size_t m, n, p;        // op(A) is m x n, op(B) n x p
+    acc_t alpha, beta;
+    const T *a, *b;
+    size_t lda, ldb;       // row strides of A and B as stored
+    acc_t *c;
+    size_t ldc;
+};
+
+// Packing buffers of one thread.
+template <typename T>
+struct typed_workspace_t
+{
+    T *packed_a; // GEMM_MC x GEMM_KC
+    T *packed_b; // GEMM_KC x GEMM_NC
+};
+
+template <typename T>
+typed_workspace_t<T> * CreateTypedWorkspace()
+{
+    typed_workspace_t<T> *workspace = (typed_workspace_t<T> *)malloc(sizeof(typed_workspace_t<T>));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(workspace, "workspace");
+
+    workspace->packed_a = (T *)aligned_alloc(CACHE_LINE, GEMM_MC * GEMM_KC * sizeof(T));
+    workspace->packed_b = (T *)aligned_alloc(CACHE_LINE, GEMM_KC * GEMM_NC * sizeof(T));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(workspace->packed_a, "workspace->packed_a");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(workspace->packed_b, "workspace->packed_b");
+
+    return workspace;
+}
+
+template <typename T>
+void DestroyTypedWorkspace(typed_workspace_t<T> *workspace)
+{
+    if (workspace == NULL)
+    {
+        return;
+    }
+
+    free(workspace->packed_a);
+    free(workspace->packed_b);
+    free(workspace);
+}
+
+template <typename T>
+inline T OffsetByte(T value)
+{
+    return value;
+}
+
+template <>
+inline int8_t OffsetByte(int8_t value)
+{
+    return (int8_t)((uint8_t)value ^ 0x80);
+}
+
+// Rows [row, row + rows) and columns [depth, depth + kc) of op(A) as panels
+// of mr rows, group k values of a row together, padded with zeros.
+template <typename T>
+void PackTypedA(const typed_gemm_t<T> *gemm, size_t row, size_t rows, size_t depth, size_t kc, T *packed)
+{
+    const typed_kernel_t<T> *kernel = gemm->kernel;
+    size_t mr = kernel->mr, group = kernel->group;
+    size_t row_stride = gemm->trans_a ? 1 : gemm->lda, depth_stride = gemm->trans_a ? gemm->lda : 1;
+    T zero = kernel->offset_a ? OffsetByte((T)0) : (T)0;
+
+    for (size_t ir = 0; ir < rows; ir += mr)
+    {
+        size_t panel_rows = rows - ir < mr ? rows - ir : mr;
+
+        for (size_t k = 0; k < kc; k += group, packed += mr * group)
+        {
+            size_t values = kc - k < group ? kc - k : group;
+            if (panel_rows < mr || values < group)
+            {
+                for (size_t e = 0; e < mr * group; e++)
+                {
+                    packed[e] = zero;
+                }
+            }
+
+            for (size_t i = 0; i < panel_rows; i++)
+            {
+                const T *source = gemm->a + (row + ir + i) * row_stride + (depth + k) * depth_stride;
+                for (size_t g = 0; g < values; g++)
+                {
+                    T value = source[g * depth_stride];
+                    packed[i * group + g] = kernel->offset_a ? OffsetByte(value) : value;
+                }
+            }
+        }
+    }
+}
+
+// Rows [depth, depth + kc) and columns [column, column + columns) of op(B)
+// as panels of nr columns, group k values of a column together, padded with
+// zeros.
+template <typename T>
+void PackTypedB(const typed_gemm_t<T> *gemm, size_t depth, size_t kc, size_t column, size_t columns, T *packed)
+{
+    const typed_kernel_t<T> *kernel = gemm->kernel;
+    size_t nr = kernel->nr, group = kernel->group;
+    size_t depth_stride = gemm->trans_b ? 1 : gemm->ldb, column_stride = gemm->trans_b ? gemm->ldb : 1;
+
+    for (size_t jr = 0; jr < columns; jr += nr)
+    {
+        size_t panel_columns = columns - jr < nr ? columns - jr : nr;
+
+        for (size_t k = 0; k < kc; k += group, packed += nr * group)
+        {
+            size_t values = kc - k < group ? kc - k : group;
+            if (panel_columns < nr || values < group)
+            {
+                for (size_t e = 0; e < nr * group; e++)
+                {
+                    packed[e] = 0;
+                }
+            }
+
+            // A row of B at a time, contiguous unless B is transposed.
+            for (size_t g = 0; g < values; g++)
+            {
+                const T *source = gemm->b + (depth + k + g) * depth_stride + (column + jr) * column_stride;
+                for (size_t j = 0; j < panel_columns; j++)
+                {
+                    packed[j * group + g] = source[j * column_stride];
+                }
+            }
+        }
+    }
+}
+
+// C = alpha tile + beta C for a rows x columns corner of a tile, C is not
+// read when beta is 0.
+template <typename acc_t>
+void StoreTypedTile(acc_t *c, size_t ldc, const acc_t *tile, size_t nr, size_t rows, size_t columns, acc_t alpha,
+                    acc_t beta)
+{
+    for (size_t i = 0; i < rows; i++)
+    {
+        acc_t *row = c + i * ldc;
+        const acc_t *values = tile + i * nr;
+
+        if (beta == 0)
+        {
+            for (size_t j = 0; j < columns; j++)
+            {
+                row[j] = alpha * values[j];
+            }
+        }
+        else
+        {
+            for (size_t j = 0; j < columns; j++)
+            {
+                row[j] = alpha * values[j] + beta * row[j];
+            }
+        }
+    }
+}
+
+// Rows [row_start, row_end) of C = alpha op(A) op(B) + beta C. Each kc deep
+// product goes through a tile buffer, the first one is scaled into C with
+// beta (C is not read when beta is 0), the others are added; with alpha 1
+// whole tiles skip the buffer.
+template <typename T>
+void TypedGemmRows(typed_workspace_t<T> *workspace, const typed_gemm_t<T> *gemm, size_t row_start, size_t row_end)
+{
+    typedef typename gemm_accumulator_t<T>::type acc_t;
+    const typed_kernel_t<T> *kernel = gemm->kernel;
+    size_t mr = kernel->mr, nr = kernel->nr, group = kernel->group;
+    acc_t tile[TYPED_GEMM_MAX_TILE];
+
+    if (gemm->n == 0)
+    {
+        for (size_t i = row_start; i < row_end; i++)
+        {
+            for (size_t j = 0; j < gemm->p; j++)
+            {
+                acc_t *cell = gemm->c + i * gemm->ldc + j;
+                *cell = gemm->beta == 0 ? 0 : gemm->beta * *cell;
+            }
+        }
+        return;
+    }
+
+    for (size_t jc = 0; jc < gemm->p; jc += GEMM_NC)
+    {
+        size_t nc = gemm->p - jc < GEMM_NC ? gemm->p - jc : GEMM_NC;
+
+        for (size_t pc = 0; pc < gemm->n; pc += GEMM_KC)
+        {
+            size_t kc = gemm->n - pc < GEMM_KC ? gemm->n - pc : GEMM_KC;
+            size_t padded_kc = (kc + group - 1) / group * group;
+            PackTypedB(gemm, pc, kc, jc, nc, workspace->packed_b);
+
+            for (size_t ic = row_start; ic < row_end; ic += GEMM_MC)
+            {
+                size_t mc = row_end - ic < GEMM_MC ? row_end - ic : GEMM_MC;
+                PackTypedA(gemm, ic, mc, pc, kc, workspace->packed_a);
+
+                for (size_t jr = 0; jr < nc; jr += nr)
+                {
+                    size_t columns = nc - jr < nr ? nc - jr : nr;
+
+                    for (size_t ir = 0; ir < mc; ir += mr)
+                    {
+                        size_t rows = mc - ir < mr ? mc - ir : mr;
+                        const T *panel_a = workspace->packed_a + ir * padded_kc;
+                        const T *panel_b = workspace->packed_b + jr * padded_kc;
+                        acc_t *block = gemm->c + (ic + ir) * gemm->ldc + jc + jr;
+
+                        // Plain C = A B and the later depth steps of it need no scaling.
+                        if (rows == mr && columns == nr && gemm->alpha == 1 && (pc > 0 || gemm->beta == 0))
+                        {
+                            kernel->run(padded_kc, panel_a, panel_b, block, gemm->ldc, pc > 0);
+                            continue;
+                        }
+
+                        kernel->run(padded_kc, panel_a, panel_b, tile, nr, false);
+                        StoreTypedTile(block, gemm->ldc, tile, nr, rows, columns, gemm->alpha,
+                                       pc > 0 ? (acc_t)1 : gemm->beta);
+                    }
+                }
+            }
+        }
+    }
+}
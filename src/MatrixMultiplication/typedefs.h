@@ -0,0 +1,40 @@
+/**
+* Program: Matrix multiplication
+**/
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(ptr, var_name) \
+    if (ptr == NULL) \
+        { \
+        printf("Assertion error: %s is NULL.\n", var_name);\
+        exit(1); \
+        }
+
+#define SUCCESS 0
+#define FAILURE 1
+
+#define CACHE_LINE 64 // bytes, matrices and packed panels are aligned to it
+
+// Dense row-major matrix, element (i, j) at data[i * stride + j]. A matrix
+// of its own has stride == columns; a view of a block of another matrix
+// keeps the stride of the matrix it points into.
+typedef struct matrix_t
+{
+    size_t rows;
+    size_t columns;
+    size_t stride;
+    double *data;
+} matrix_t;
+
+typedef enum element_type_t
+{
+    ELEMENT_DOUBLE,
+    ELEMENT_FLOAT,
+    ELEMENT_INT32,
+    ELEMENT_INT16,
+    ELEMENT_INT8
+} element_type_t;
@@ -2,31 +2,51 @@
 * Program: Calculating PI
 **/
 
-#include <pthread.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "rng.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "qmc.h"
+#include "monte_carlo.h"
+
+#define RAND_SEED 46540 // random number generator seed
+
+// Indicator of the quarter disc, its mean over the unit square is PI / 4.
+typedef struct quarter_circle_t
+{
+    static const size_t dims = 2;
 
-#ifdef _MSC_VER
-#include <random>
-#endif
-
-#define RAND_SEED 46540 // input matrix generation seed
-#define MAX_THREADS 1024
+    double operator()(const double *point) const
+    {
+        return point[0] * point[0] + point[1] * point[1] <= 1 ? 1 : 0;
+    }
+} quarter_circle_t;
 
-void * ThreadMain(void *);
-double area_value(double over, double under);
+// The quarter disc has a vectorized sampler, the indicator values are 0 or 1
+// so the sum of squares is the hit count as well.
+inline void SampleCube(const quarter_circle_t &, rng_t *, sampler_t *sampler, const double *low, double width,
+                       uint64_t count, double *sum, double *sum2)
+{
+    double hits = (double)CountQuarterCircleHits(sampler, low, width, count);
+    *sum += hits;
+    *sum2 += hits;
+}
 
-pthread_mutex_t add;
+void ParseOptions(int argc, char *argv[]);
 
-#ifndef _MSC_VER
-drand48_data status[MAX_THREADS];
-drand48_data *pts[MAX_THREADS];
-#endif
+rng_kind_t generator = RNG_XOSHIRO;
+size_t strata = 1;
+double target = 0; // half width of the 95% confidence interval of PI, 0 for a fixed sample count
+bool quasi = false;  // low discrepancy points instead of random ones
+qmc_kind_t sequence = QMC_SOBOL;
+size_t replicates = 16;
 
 size_t iterations;
 size_t num_threads;
-double total_over = 0, total_under = 0;
 
 int main(int argc, char *argv[])
 {
@@ -36,82 +56,112 @@ int main(int argc, char *argv[])
     {
         fprintf(stderr, "Required arguments:\n \
                         iterations - number of iterations\n \
-                        num_threads - number of worker threads.");
+                        num_threads - number of worker threads.\n \
+                        Optional name=value arguments:\n \
+                        generator - xoshiro (default) or philox.\n \
+                        strata - strata per axis, strata^2 cells with two samples each at least (default 1).\n \
+                        target - stop once PI is known to +-target at 95%% confidence, iterations being the limit (default 0, off).\n \
+                        sequence - sobol or halton, quasi-Monte Carlo points instead of random ones (default off).\n \
+                        replicates - independently scrambled copies of the quasi-Monte Carlo points (default 16).");
         return -1;
     }
 
     iterations = (size_t)atoi(argv[1]);
     num_threads = (size_t)atoi(argv[2]);
+    ParseOptions(argc, argv);
 
-    iterations = iterations / num_threads;
-
-    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
-
-    pthread_mutex_init(&add,NULL);
-
-    for (int i=0; i < num_threads; i++)
+    if (strata > 1 && target > 0)
     {
-        if (0 != pthread_create(threads+i, NULL, ThreadMain, (void *)i))
-        {
-            fprintf(stderr, "Error creating a thread: %i.\n", i);
-            return -1;
-        }
+        fprintf(stderr, "The target precision is not supported with strata.\n");
+        return -1;
     }
 
-    for (int i=0; i < num_threads; i++)
+    if (quasi && (strata > 1 || target > 0))
     {
-        pthread_join(*(threads+i), NULL);
+        fprintf(stderr, "Quasi-Monte Carlo supports neither strata nor a target precision.\n");
+        return -1;
     }
 
-    printf("The end.\n");
-
-    return 0;
-}
-void * ThreadMain(void *t)
-{
-    size_t tid = (size_t) t;
-    double over = 0, under = 0;
-    double x, y, *ptx, *pty;
+    if (quasi && replicates < 2)
+    {
+        fprintf(stderr, "The quasi-Monte Carlo error estimate needs two replicates at least.\n");
+        return -1;
+    }
 
-#ifndef _MSC_VER
-    pts[tid] = &status[tid];
-    srand48_r(RAND_SEED * tid, pts[tid]); // creating a local random number generator
-#else
-    srand(RAND_SEED);
-#endif
+    if (strata > 1 && iterations < 2 * strata * strata)
+    {
+        fprintf(stderr, "Every stratum needs two samples at least.\n");
+        return -1;
+    }
 
-    ptx = &x; pty = &y;
-    double count = 0;
+    thread_pool_t *pool = CreateThreadPool(num_threads);
+    mc_streams_t *streams = CreateMonteCarloStreams(generator, RAND_SEED, pool->num_threads);
 
-    for (double n = tid; n < iterations; n += num_threads)
+    quarter_circle_t quarter_circle;
+    mc_result_t result;
+    if (quasi)
     {
-        count++;
-#ifndef _MSC_VER
-        drand48_r(pts[tid], ptx);
-        drand48_r(pts[tid], pty);
-#else
-        *ptx = rand();
-        *pty = rand();
-#endif
-
-        if (y > sqrt(1. - x*x)) over++;
-        else under++;
+        result = QuasiMonteCarloIntegrate(pool, streams, quarter_circle, sequence, iterations, replicates);
+    }
+    else if (target > 0)
+    {
+        result = MonteCarloIntegrateToPrecision(pool, streams, quarter_circle, target / 4, iterations);
+    }
+    else
+    {
+        result = MonteCarloIntegrate(pool, streams, quarter_circle, iterations, strata);
     }
 
-    pthread_mutex_lock(&add);
+    printf("PI = %.10f +- %.10f (%llu samples)\n", 4 * result.estimate, 4 * result.std_error,
+           (unsigned long long)result.samples);
 
-    total_over += over;
-    total_under += under;
+    DestroyMonteCarloStreams(streams);
+    DestroyThreadPool(pool);
 
-    pthread_mutex_unlock(&add);
+    printf("The end.\n");
 
-    return NULL;
+    return 0;
 }
 
-double area_value(double over, double under)
+void ParseOptions(int argc, char *argv[])
 {
-    double value;
-    value = under / (over + under);
-    return value;
-}
+    for (int i = 3; i < argc; i++)
+    {
+        char *value = strchr(argv[i], '=');
+        if (value == NULL)
+        {
+            fprintf(stderr, "Expected name=value, got: %s.\n", argv[i]);
+            exit(1);
+        }
 
+        size_t length = (size_t)(value - argv[i]);
+        value++;
+
+        if (length == strlen("generator") && strncmp(argv[i], "generator", length) == 0)
+        {
+            generator = strcmp(value, "philox") == 0 ? RNG_PHILOX : RNG_XOSHIRO;
+        }
+        else if (length == strlen("strata") && strncmp(argv[i], "strata", length) == 0)
+        {
+            strata = atoi(value) > 1 ? (size_t)atoi(value) : 1;
+        }
+        else if (length == strlen("target") && strncmp(argv[i], "target", length) == 0)
+        {
+            target = atof(value);
+        }
+        else if (length == strlen("sequence") && strncmp(argv[i], "sequence", length) == 0)
+        {
+            quasi = true;
+            sequence = strcmp(value, "halton") == 0 ? QMC_HALTON : QMC_SOBOL;
+        }
+        else if (length == strlen("replicates") && strncmp(argv[i], "replicates", length) == 0)
+        {
+            replicates = atoi(value) > 0 ? (size_t)atoi(value) : 0;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s.\n", argv[i]);
+            exit(1);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+/**
+* Program: Calculating PI
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "typedefs.h"
+#include "monte_carlo.h"
+
+mc_streams_t * CreateMonteCarloStreams(rng_kind_t kind, uint64_t seed, size_t count)
+{
+    mc_streams_t *streams = (mc_streams_t *)calloc(1, sizeof(mc_streams_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(streams, "streams");
+
+    streams->count = count;
+    streams->rngs = CreateRngStreams(kind, seed, count);
+    streams->samplers = (sampler_t *)aligned_alloc(CACHE_LINE, (count > 0 ? count : 1) * sizeof(sampler_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(streams->samplers, "streams->samplers");
+
+    for (size_t i = 0; i < count; i++)
+    {
+        InitSampler(streams->samplers + i, streams->rngs + i);
+    }
+
+    return streams;
+}
+
+void DestroyMonteCarloStreams(mc_streams_t *streams)
+{
+    if (streams == NULL)
+    {
+        return;
+    }
+
+    free(streams->samplers);
+    DestroyRngStreams(streams->rngs);
+    free(streams);
+}
@@ -0,0 +1,415 @@
+/**
+* Program: Calculating PI
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include "typedefs.h"
+#include "rng.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "qmc.h"
+
+#define MC_MAX_DIMS 8
+#define MC_BATCH 65536        // samples a thread draws between two publications
+#define MC_MIN_SAMPLES 100000 // the error estimate is trusted from here on
+#define MC_Z95 1.959963984540054 // normal quantile of a 95% confidence interval
+
+// Monte Carlo integration of a functor over the unit cube [0, 1)^dims. An
+// integrand is any type with a static constant dims and
+//     double operator()(const double *point) const;
+// The engine is templated on it so the call inlines into the sampling loop.
+
+typedef struct mc_result_t
+{
+    double estimate;
+    double std_error;
+    uint64_t samples;
+} mc_result_t;
+
+// Partial sums of one thread, alone in its cache lines so the threads never
+// write to a shared line and the caller sums them once all are done.
+typedef struct alignas(CACHE_LINE) mc_tally_t
+{
+    uint64_t count;
+    double sum, sum2;        // of the values, without strata
+    double means, variances; // sums over finished strata of the mean and of its variance
+} mc_tally_t;
+
+// Running sums of one thread, published after every batch. The version is
+// odd while the thread updates the sums; a reader retries until it sees
+// the same even version before and after reading them.
+typedef struct alignas(CACHE_LINE) mc_slot_t
+{
+    uint64_t version;
+    uint64_t count;
+    double sum, sum2;
+} mc_slot_t;
+
+// Per-thread random state of the engine.
+typedef struct mc_streams_t
+{
+    rng_t *rngs;
+    sampler_t *samplers;
+    size_t count;
+} mc_streams_t;
+
+// One stream per pool thread, see CreateRngStreams.
+mc_streams_t * CreateMonteCarloStreams(rng_kind_t kind, uint64_t seed, size_t count);
+void DestroyMonteCarloStreams(mc_streams_t *streams);
+
+// Adds count values of the integrand at points uniform on the cube
+// low + [0, width)^dims to sum and sum2. Integrands with a faster way to
+// sample a cube provide an overload, which overload resolution prefers.
+template <typename Integrand>
+inline void SampleCube(const Integrand &integrand, rng_t *rng, sampler_t *sampler, const double *low,
+                       double width, uint64_t count, double *sum, double *sum2)
+{
+    double point[MC_MAX_DIMS];
+    double s = 0, s2 = 0;
+
+    (void)sampler;
+
+    for (uint64_t n = 0; n < count; n++)
+    {
+        for (size_t d = 0; d < Integrand::dims; d++)
+        {
+            point[d] = low[d] + width * RngNextDouble(rng);
+        }
+
+        double value = integrand(point);
+        s += value;
+        s2 += value * value;
+    }
+
+    *sum += s;
+    *sum2 += s2;
+}
+
+// Estimate and standard error of the mean from pooled sums.
+static inline mc_result_t PooledResult(uint64_t count, double sum, double sum2)
+{
+    mc_result_t result = { 0, 0, count };
+    if (count == 0)
+    {
+        return result;
+    }
+
+    double n = (double)count;
+    result.estimate = sum / n;
+    double variance = count > 1 ? (sum2 - sum * result.estimate) / (n - 1) : 0;
+    result.std_error = sqrt((variance > 0 ? variance : 0) / n);
+
+    return result;
+}
+
+template <typename Integrand>
+struct mc_job_t
+{
+    const Integrand *integrand;
+    mc_streams_t *streams;
+    uint64_t samples;
+    size_t strata;     // per axis
+    size_t num_cells;  // strata^dims
+    size_t num_threads;
+    mc_tally_t *tallies;
+};
+
+template <typename Integrand>
+void MonteCarloJob(void *args, size_t tid)
+{
+    mc_job_t<Integrand> *job = (mc_job_t<Integrand> *)args;
+    rng_t *rng = job->streams->rngs + tid;
+    sampler_t *sampler = job->streams->samplers + tid;
+    mc_tally_t tally = { 0, 0, 0, 0, 0 };
+
+    // Without strata the threads share out the samples of the whole cube.
+    if (job->num_cells == 1)
+    {
+        uint64_t first = job->samples * tid / job->num_threads;
+        uint64_t last = job->samples * (tid + 1) / job->num_threads;
+        const double origin[MC_MAX_DIMS] = { 0 };
+
+        SampleCube(*job->integrand, rng, sampler, origin, 1.0, last - first, &tally.sum, &tally.sum2);
+        tally.count = last - first;
+        job->tallies[tid] = tally;
+        return;
+    }
+
+    // With strata they share out whole cells, each with an equal part of the
+    // samples, and keep only the cell mean and its variance.
+    size_t first = job->num_cells * tid / job->num_threads;
+    size_t last = job->num_cells * (tid + 1) / job->num_threads;
+    double width = 1.0 / job->strata;
+
+    for (size_t cell = first; cell < last; cell++)
+    {
+        double low[MC_MAX_DIMS];
+        size_t index = cell;
+        for (size_t d = 0; d < Integrand::dims; d++)
+        {
+            low[d] = (double)(index % job->strata) * width;
+            index /= job->strata;
+        }
+
+        uint64_t count = job->samples / job->num_cells + (cell < job->samples % job->num_cells ? 1 : 0);
+        double sum = 0, sum2 = 0;
+        SampleCube(*job->integrand, rng, sampler, low, width, count, &sum, &sum2);
+
+        double mean = sum / count;
+        double variance = count > 1 ? (sum2 - sum * mean) / (count - 1) : 0;
+        tally.count += count;
+        tally.means += mean;
+        tally.variances += (variance > 0 ? variance : 0) / count;
+    }
+
+    job->tallies[tid] = tally;
+}
+
+// Integrates over [0, 1)^dims with samples points on the pool's threads.
+// strata > 1 splits the cube into strata^dims equal cells that get equal
+// shares of the samples, which removes the variance between cells; every
+// cell needs at least two samples for its error estimate.
+template <typename Integrand>
+mc_result_t MonteCarloIntegrate(thread_pool_t *pool, mc_streams_t *streams, const Integrand &integrand,
+                                uint64_t samples, size_t strata)
+{
+    size_t num_threads = pool->num_threads;
+    size_t num_cells = 1;
+    for (size_t d = 0; d < Integrand::dims; d++)
+    {
+        num_cells *= strata > 0 ? strata : 1;
+    }
+
+    mc_tally_t *tallies = (mc_tally_t *)aligned_alloc(CACHE_LINE, num_threads * sizeof(mc_tally_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tallies, "tallies");
+
+    mc_job_t<Integrand> job = { &integrand, streams, samples, strata, num_cells, num_threads, tallies };
+    RunOnThreadPool(pool, MonteCarloJob<Integrand>, &job);
+
+    mc_tally_t total = { 0, 0, 0, 0, 0 };
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        total.count += tallies[t].count;
+        total.sum += tallies[t].sum;
+        total.sum2 += tallies[t].sum2;
+        total.means += tallies[t].means;
+        total.variances += tallies[t].variances;
+    }
+
+    free(tallies);
+
+    if (num_cells == 1)
+    {
+        return PooledResult(total.count, total.sum, total.sum2);
+    }
+
+    mc_result_t result = { total.means / num_cells, sqrt(total.variances) / num_cells, total.count };
+    return result;
+}
+
+static inline void PublishSlot(mc_slot_t *slot, uint64_t count, double sum, double sum2)
+{
+    uint64_t version = slot->version;
+    __atomic_store_n(&slot->version, version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->count, count, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sum, &sum, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sum2, &sum2, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->version, version + 2, __ATOMIC_RELEASE);
+}
+
+static inline void ReadSlot(mc_slot_t *slot, uint64_t *count, double *sum, double *sum2)
+{
+    while (true)
+    {
+        uint64_t before = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+        *count = __atomic_load_n(&slot->count, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sum, sum, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sum2, sum2, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (before % 2 == 0 && __atomic_load_n(&slot->version, __ATOMIC_RELAXED) == before)
+        {
+            return;
+        }
+    }
+}
+
+template <typename Integrand>
+struct mc_target_job_t
+{
+    const Integrand *integrand;
+    mc_streams_t *streams;
+    double half_width;    // of the 95% confidence interval to reach
+    uint64_t max_samples;
+    size_t num_threads;
+    mc_slot_t *slots;
+    bool stop;
+};
+
+// Threads sample in batches and publish their running sums. Thread 0 also
+// coordinates: after each of its batches it pools the slots and raises the
+// stop flag once the interval is narrow enough or the budget is spent.
+template <typename Integrand>
+void MonteCarloTargetJob(void *args, size_t tid)
+{
+    mc_target_job_t<Integrand> *job = (mc_target_job_t<Integrand> *)args;
+    rng_t *rng = job->streams->rngs + tid;
+    sampler_t *sampler = job->streams->samplers + tid;
+    const double origin[MC_MAX_DIMS] = { 0 };
+    uint64_t count = 0;
+    double sum = 0, sum2 = 0;
+
+    while (!__atomic_load_n(&job->stop, __ATOMIC_RELAXED))
+    {
+        SampleCube(*job->integrand, rng, sampler, origin, 1.0, MC_BATCH, &sum, &sum2);
+        count += MC_BATCH;
+        PublishSlot(job->slots + tid, count, sum, sum2);
+
+        if (tid != 0)
+        {
+            continue;
+        }
+
+        uint64_t total_count = 0;
+        double total_sum = 0, total_sum2 = 0;
+        for (size_t t = 0; t < job->num_threads; t++)
+        {
+            uint64_t c;
+            double s, s2;
+            ReadSlot(job->slots + t, &c, &s, &s2);
+            total_count += c;
+            total_sum += s;
+            total_sum2 += s2;
+        }
+
+        mc_result_t result = PooledResult(total_count, total_sum, total_sum2);
+        if ((job->max_samples > 0 && total_count >= job->max_samples)
+            || (total_count >= MC_MIN_SAMPLES && MC_Z95 * result.std_error <= job->half_width))
+        {
+            __atomic_store_n(&job->stop, true, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Integrates over [0, 1)^dims until the 95% confidence interval of the
+// estimate is at most half_width on either side, or max_samples (0 for no
+// limit) are drawn. The threads overshoot by at most one batch each.
+template <typename Integrand>
+mc_result_t MonteCarloIntegrateToPrecision(thread_pool_t *pool, mc_streams_t *streams, const Integrand &integrand,
+                                           double half_width, uint64_t max_samples)
+{
+    size_t num_threads = pool->num_threads;
+    mc_slot_t *slots = (mc_slot_t *)aligned_alloc(CACHE_LINE, num_threads * sizeof(mc_slot_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(slots, "slots");
+    memset(slots, 0, num_threads * sizeof(mc_slot_t));
+
+    mc_target_job_t<Integrand> job = { &integrand, streams, half_width, max_samples, num_threads, slots, false };
+    RunOnThreadPool(pool, MonteCarloTargetJob<Integrand>, &job);
+
+    uint64_t count = 0;
+    double sum = 0, sum2 = 0;
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        count += slots[t].count;
+        sum += slots[t].sum;
+        sum2 += slots[t].sum2;
+    }
+
+    free(slots);
+
+    return PooledResult(count, sum, sum2);
+}
+
+template <typename Integrand>
+struct mc_qmc_job_t
+{
+    const Integrand *integrand;
+    const qmc_sequence_t *sequence;
+    uint64_t points;
+    size_t num_threads;
+    mc_tally_t *tallies;
+};
+
+// Every thread seeks to the start of its own contiguous block of the
+// sequence, so the blocks together are exactly the first points points
+// whatever the thread count.
+template <typename Integrand>
+void QuasiMonteCarloJob(void *args, size_t tid)
+{
+    mc_qmc_job_t<Integrand> *job = (mc_qmc_job_t<Integrand> *)args;
+    uint64_t first = job->points * tid / job->num_threads;
+    uint64_t last = job->points * (tid + 1) / job->num_threads;
+    double point[MC_MAX_DIMS];
+    qmc_cursor_t cursor;
+    double sum = 0;
+
+    SeekQmcSequence(job->sequence, &cursor, first);
+    for (uint64_t n = first; n < last; n++)
+    {
+        NextQmcPoint(job->sequence, &cursor, point);
+        sum += (*job->integrand)(point);
+    }
+
+    job->tallies[tid].count = last - first;
+    job->tallies[tid].sum = sum;
+}
+
+// Integrates over [0, 1)^dims with samples points shared out among
+// replicates independently scrambled copies of a low discrepancy sequence,
+// each taking the first points of it. The first samples % replicates copies
+// take one point more, copies left without points are dropped. The
+// estimate is the mean of the replicate means and the standard error comes
+// from their spread, so at least two replicates are needed for it. The
+// scrambling draws from the first stream.
+template <typename Integrand>
+mc_result_t QuasiMonteCarloIntegrate(thread_pool_t *pool, mc_streams_t *streams, const Integrand &integrand,
+                                     qmc_kind_t kind, uint64_t samples, size_t replicates)
+{
+    size_t num_threads = pool->num_threads;
+    mc_tally_t *tallies = (mc_tally_t *)aligned_alloc(CACHE_LINE, num_threads * sizeof(mc_tally_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tallies, "tallies");
+
+    qmc_sequence_t sequence;
+    InitQmcSequence(&sequence, kind, Integrand::dims);
+
+    mc_qmc_job_t<Integrand> job = { &integrand, &sequence, 0, num_threads, tallies };
+    uint64_t count = 0;
+    size_t used = 0;
+    double sum = 0, sum2 = 0;
+
+    for (size_t r = 0; r < replicates; r++)
+    {
+        uint64_t points = samples / replicates + (r < samples % replicates ? 1 : 0);
+        if (points == 0)
+        {
+            break;
+        }
+
+        job.points = points;
+        ScrambleQmcSequence(&sequence, streams->rngs);
+        RunOnThreadPool(pool, QuasiMonteCarloJob<Integrand>, &job);
+
+        double replicate_sum = 0;
+        for (size_t t = 0; t < num_threads; t++)
+        {
+            count += tallies[t].count;
+            replicate_sum += tallies[t].sum;
+        }
+
+        double mean = replicate_sum / points;
+        sum += mean;
+        sum2 += mean * mean;
+        used++;
+    }
+
+    free(tallies);
+
+    mc_result_t result = PooledResult(used, sum, sum2);
+    result.samples = count;
+    return result;
+}
@@ -0,0 +1,155 @@
+/**
+* Program: Calculating PI
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "typedefs.h"
+#include "qmc.h"
+
+typedef struct sobol_polynomial_t
+{
+    unsigned int degree;
+    unsigned int coefficients; // inner coefficients a_1 .. a_(degree - 1), a_1 highest
+    unsigned int m[5];         // initial direction numbers
+} sobol_polynomial_t;
+
+// Dimensions 2 to 8 of the new-joe-kuo-6.21201 table, dimension 1 is the
+// van der Corput sequence.
+static const sobol_polynomial_t sobol_polynomials[QMC_MAX_DIMS - 1] =
+{
+    { 1, 0, { 1 } },
+    { 2, 1, { 1, 3 } },
+    { 3, 1, { 1, 3, 1 } },
+    { 3, 2, { 1, 1, 1 } },
+    { 4, 1, { 1, 1, 3, 3 } },
+    { 4, 4, { 1, 3, 5, 13 } },
+    { 5, 2, { 1, 1, 5, 5, 17 } }
+};
+
+static const unsigned int halton_bases[QMC_MAX_DIMS] = { 2, 3, 5, 7, 11, 13, 17, 19 };
+
+static double RadicalInverse(uint64_t index, unsigned int base);
+
+void InitQmcSequence(qmc_sequence_t *sequence, qmc_kind_t kind, size_t dims)
+{
+    if (dims > QMC_MAX_DIMS)
+    {
+        fprintf(stderr, "Quasi-Monte Carlo supports up to %d dimensions.\n", QMC_MAX_DIMS);
+        exit(1);
+    }
+
+    memset(sequence, 0, sizeof(qmc_sequence_t));
+    sequence->kind = kind;
+    sequence->dims = dims;
+
+    for (size_t k = 0; k < SOBOL_BITS; k++)
+    {
+        sequence->directions[0][k] = (uint64_t)1 << (SOBOL_BITS - 1 - k);
+    }
+
+    for (size_t d = 1; d < dims; d++)
+    {
+        const sobol_polynomial_t *polynomial = sobol_polynomials + d - 1;
+        unsigned int s = polynomial->degree;
+        uint64_t *v = sequence->directions[d];
+
+        for (size_t k = 0; k < SOBOL_BITS; k++)
+        {
+            if (k < s)
+            {
+                v[k] = (uint64_t)polynomial->m[k] << (SOBOL_BITS - 1 - k);
+                continue;
+            }
+
+            v[k] = v[k - s] ^ (v[k - s] >> s);
+            for (unsigned int i = 1; i < s; i++)
+            {
+                if ((polynomial->coefficients >> (s - 1 - i)) & 1)
+                {
+                    v[k] ^= v[k - i];
+                }
+            }
+        }
+    }
+}
+
+void ScrambleQmcSequence(qmc_sequence_t *sequence, rng_t *rng)
+{
+    for (size_t d = 0; d < sequence->dims; d++)
+    {
+        sequence->shift[d] = RngNext(rng);
+        sequence->offset[d] = RngNextDouble(rng);
+    }
+}
+
+void SeekQmcSequence(const qmc_sequence_t *sequence, qmc_cursor_t *cursor, uint64_t index)
+{
+    cursor->index = index;
+
+    if (sequence->kind != QMC_SOBOL)
+    {
+        return;
+    }
+
+    // Point n is the XOR of the direction numbers at the set bits of the
+    // Gray code of n.
+    uint64_t gray = index ^ (index >> 1);
+    for (size_t d = 0; d < sequence->dims; d++)
+    {
+        uint64_t state = 0;
+        for (size_t k = 0; k < SOBOL_BITS; k++)
+        {
+            if ((gray >> k) & 1)
+            {
+                state ^= sequence->directions[d][k];
+            }
+        }
+
+        cursor->state[d] = state;
+    }
+}
+
+void NextQmcPoint(const qmc_sequence_t *sequence, qmc_cursor_t *cursor, double *point)
+{
+    if (sequence->kind == QMC_SOBOL)
+    {
+        // The Gray codes of n and n + 1 differ in the lowest zero bit of n.
+        size_t bit = (size_t)__builtin_ctzll(~cursor->index);
+
+        for (size_t d = 0; d < sequence->dims; d++)
+        {
+            point[d] = (double)((cursor->state[d] ^ sequence->shift[d]) >> 11) * (1.0 / 9007199254740992.0);
+            cursor->state[d] ^= sequence->directions[d][bit < SOBOL_BITS ? bit : 0];
+        }
+    }
+    else
+    {
+        for (size_t d = 0; d < sequence->dims; d++)
+        {
+            double x = RadicalInverse(cursor->index, halton_bases[d]) + sequence->offset[d];
+            point[d] = x < 1 ? x : x - 1;
+        }
+    }
+
+    cursor->index++;
+}
+
+// Digits of index in the given base mirrored around the radix point.
+static double RadicalInverse(uint64_t index, unsigned int base)
+{
+    double inverse_base = 1.0 / base;
+    double scale = inverse_base;
+    double result = 0;
+
+    while (index > 0)
+    {
+        result += (double)(index % base) * scale;
+        index /= base;
+        scale *= inverse_base;
+    }
+
+    return result;
+}
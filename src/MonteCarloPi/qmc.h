@@ -0,0 +1,51 @@
+/**
+* Program: Calculating PI
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include "typedefs.h"
+#include "rng.h"
+
+#define QMC_MAX_DIMS 8
+#define SOBOL_BITS 64
+
+typedef enum qmc_kind_t
+{
+    QMC_SOBOL,  // base 2 digital net, Joe-Kuo direction numbers
+    QMC_HALTON  // radical inverses in the first prime bases
+} qmc_kind_t;
+
+// A randomized low discrepancy sequence. Sobol points are shifted by a
+// random XOR mask, Halton points by a random offset modulo 1, so every
+// scrambling gives an unbiased, independent replicate of the point set.
+typedef struct qmc_sequence_t
+{
+    qmc_kind_t kind;
+    size_t dims;
+    uint64_t directions[QMC_MAX_DIMS][SOBOL_BITS];
+    uint64_t shift[QMC_MAX_DIMS];
+    double offset[QMC_MAX_DIMS];
+} qmc_sequence_t;
+
+// Position in a sequence. Sobol points are taken in Gray code order, so
+// consecutive points differ by one direction number per dimension.
+typedef struct qmc_cursor_t
+{
+    uint64_t index;
+    uint64_t state[QMC_MAX_DIMS];
+} qmc_cursor_t;
+
+// Unscrambled sequence of dims <= QMC_MAX_DIMS dimensions.
+void InitQmcSequence(qmc_sequence_t *sequence, qmc_kind_t kind, size_t dims);
+
+// Draws a new random shift, i.e. a new replicate.
+void ScrambleQmcSequence(qmc_sequence_t *sequence, rng_t *rng);
+
+// Moves the cursor to point index directly, without generating the points
+// before it, so threads can start on disjoint blocks of the sequence.
+void SeekQmcSequence(const qmc_sequence_t *sequence, qmc_cursor_t *cursor, uint64_t index);
+
+// Writes the point under the cursor to point and advances the cursor.
+void NextQmcPoint(const qmc_sequence_t *sequence, qmc_cursor_t *cursor, double *point);
@@ -0,0 +1,118 @@
+/**
+* Program: Calculating PI
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "rng.h"
+
+static uint64_t SplitMix64(uint64_t *state);
+static void Xoshiro256Polynomial(xoshiro256_t *rng, const uint64_t polynomial[4]);
+
+void SeedXoshiro256(xoshiro256_t *rng, uint64_t seed)
+{
+    // SplitMix64 never yields the all zero state from consecutive outputs.
+    for (int i = 0; i < 4; i++)
+    {
+        rng->s[i] = SplitMix64(&seed);
+    }
+}
+
+void Xoshiro256Jump(xoshiro256_t *rng)
+{
+    static const uint64_t jump[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                      0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    Xoshiro256Polynomial(rng, jump);
+}
+
+void Xoshiro256LongJump(xoshiro256_t *rng)
+{
+    static const uint64_t long_jump[4] = { 0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+                                           0x77710069854ee241ULL, 0x39109bb02acbe635ULL };
+    Xoshiro256Polynomial(rng, long_jump);
+}
+
+void SeedPhilox(philox_t *rng, uint64_t seed, uint64_t stream)
+{
+    rng->key[0] = (uint32_t)seed;
+    rng->key[1] = (uint32_t)(seed >> 32);
+    rng->counter[0] = 0;
+    rng->counter[1] = 0;
+    rng->counter[2] = (uint32_t)stream;
+    rng->counter[3] = (uint32_t)(stream >> 32);
+    rng->index = 4 * PHILOX_BATCH;
+}
+
+void PhiloxSkip(philox_t *rng, uint64_t blocks)
+{
+    uint64_t block = ((uint64_t)rng->counter[1] << 32 | rng->counter[0]) + blocks;
+    rng->counter[0] = (uint32_t)block;
+    rng->counter[1] = (uint32_t)(block >> 32);
+}
+
+rng_t * CreateRngStreams(rng_kind_t kind, uint64_t seed, size_t count)
+{
+    rng_t *rngs = (rng_t *)aligned_alloc(CACHE_LINE, (count > 0 ? count : 1) * sizeof(rng_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(rngs, "rngs");
+    memset(rngs, 0, count * sizeof(rng_t));
+
+    xoshiro256_t base;
+    SeedXoshiro256(&base, seed);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        rngs[i].kind = kind;
+
+        if (kind == RNG_PHILOX)
+        {
+            SeedPhilox(&rngs[i].philox, seed, i);
+        }
+        else
+        {
+            rngs[i].xoshiro = base;
+            Xoshiro256LongJump(&base);
+        }
+    }
+
+    return rngs;
+}
+
+void DestroyRngStreams(rng_t *rngs)
+{
+    free(rngs);
+}
+
+static uint64_t SplitMix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Replaces the state by the one a given number of outputs ahead, that
+// number being encoded by the jump polynomial.
+static void Xoshiro256Polynomial(xoshiro256_t *rng, const uint64_t polynomial[4])
+{
+    uint64_t s[4] = { 0, 0, 0, 0 };
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (polynomial[i] & ((uint64_t)1 << b))
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    s[k] ^= rng->s[k];
+                }
+            }
+
+            Xoshiro256Next(rng);
+        }
+    }
+
+    memcpy(rng->s, s, sizeof(s));
+}
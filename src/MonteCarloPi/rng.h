@@ -0,0 +1,145 @@
+/**
+* Program: Calculating PI
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include "typedefs.h"
+
+#define PHILOX_BATCH 8 // blocks generated at once, independent rounds overlap
+
+typedef enum rng_kind_t
+{
+    RNG_XOSHIRO, // xoshiro256**, streams 2^192 apart
+    RNG_PHILOX   // Philox4x32-10, counter based, one counter space per stream
+} rng_kind_t;
+
+typedef struct xoshiro256_t
+{
+    uint64_t s[4];
+} xoshiro256_t;
+
+typedef struct philox_t
+{
+    uint32_t counter[4]; // words 0, 1 count blocks, words 2, 3 hold the stream
+    uint32_t key[2];
+    uint32_t output[4 * PHILOX_BATCH];
+    unsigned int index;  // next unused output word
+} philox_t;
+
+// A generator of one thread. The alignment pads every element of an array
+// of them to whole cache lines, so threads never share one.
+typedef struct alignas(CACHE_LINE) rng_t
+{
+    rng_kind_t kind;
+    union
+    {
+        xoshiro256_t xoshiro;
+        philox_t philox;
+    };
+} rng_t;
+
+void SeedXoshiro256(xoshiro256_t *rng, uint64_t seed);
+void Xoshiro256Jump(xoshiro256_t *rng);     // advances by 2^128 outputs
+void Xoshiro256LongJump(xoshiro256_t *rng); // advances by 2^192 outputs
+
+void SeedPhilox(philox_t *rng, uint64_t seed, uint64_t stream);
+void PhiloxSkip(philox_t *rng, uint64_t blocks); // advances by 4 * blocks outputs
+
+// count independent, reproducible streams from one seed, stream i for
+// thread i. Xoshiro streams are a long jump apart, leaving room to split
+// each of them by jumps. The result is released with DestroyRngStreams.
+rng_t * CreateRngStreams(rng_kind_t kind, uint64_t seed, size_t count);
+void DestroyRngStreams(rng_t *rngs);
+
+// The generators are the hot path of the samplers, so they are kept here
+// where the compiler can inline them.
+
+static inline uint64_t RotateLeft(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t Xoshiro256Next(xoshiro256_t *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t result = RotateLeft(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = RotateLeft(s[3], 45);
+
+    return result;
+}
+
+// Ten rounds of Philox4x32 under key on PHILOX_BATCH consecutive counters,
+// the first being counter. Block b goes to output[4 b .. 4 b + 3].
+static inline void PhiloxBlocks(const uint32_t counter[4], const uint32_t key[2], uint32_t *output)
+{
+    uint32_t c0[PHILOX_BATCH], c1[PHILOX_BATCH], c2[PHILOX_BATCH], c3[PHILOX_BATCH];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int b = 0; b < PHILOX_BATCH; b++)
+    {
+        c0[b] = counter[0] + (uint32_t)b;
+        c1[b] = counter[1] + (c0[b] < counter[0] ? 1 : 0);
+        c2[b] = counter[2];
+        c3[b] = counter[3];
+    }
+
+    for (int round = 0; round < 10; round++)
+    {
+        for (int b = 0; b < PHILOX_BATCH; b++)
+        {
+            uint64_t product0 = (uint64_t)0xD2511F53 * c0[b];
+            uint64_t product1 = (uint64_t)0xCD9E8D57 * c2[b];
+
+            c0[b] = (uint32_t)(product1 >> 32) ^ c1[b] ^ k0;
+            c2[b] = (uint32_t)(product0 >> 32) ^ c3[b] ^ k1;
+            c1[b] = (uint32_t)product1;
+            c3[b] = (uint32_t)product0;
+        }
+
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+
+    for (int b = 0; b < PHILOX_BATCH; b++)
+    {
+        output[4 * b] = c0[b];
+        output[4 * b + 1] = c1[b];
+        output[4 * b + 2] = c2[b];
+        output[4 * b + 3] = c3[b];
+    }
+}
+
+static inline uint64_t PhiloxNext(philox_t *rng)
+{
+    if (rng->index >= 4 * PHILOX_BATCH)
+    {
+        PhiloxBlocks(rng->counter, rng->key, rng->output);
+        PhiloxSkip(rng, PHILOX_BATCH);
+        rng->index = 0;
+    }
+
+    uint64_t result = ((uint64_t)rng->output[rng->index] << 32) | rng->output[rng->index + 1];
+    rng->index += 2;
+
+    return result;
+}
+
+static inline uint64_t RngNext(rng_t *rng)
+{
+    return rng->kind == RNG_PHILOX ? PhiloxNext(&rng->philox) : Xoshiro256Next(&rng->xoshiro);
+}
+
+// Uniform on [0, 1) with 53 random bits.
+static inline double RngNextDouble(rng_t *rng)
+{
+    return (double)(RngNext(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
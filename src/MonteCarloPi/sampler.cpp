@@ -0,0 +1,430 @@
+/**
+* Program: Calculating PI
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "sampler.h"
+
+#define PHILOX_M0 0xD2511F53
+#define PHILOX_M1 0xCD9E8D57
+#define PHILOX_W0 0x9E3779B9
+#define PHILOX_W1 0xBB67AE85
+#define UNIT_EXPONENT 0x3FF0000000000000ULL // exponent bits of 1.0
+
+static uint64_t XoshiroHits(uint64_t state[4][SAMPLER_LANES], const double low[2], double width, uint64_t samples);
+static uint64_t PhiloxHits(philox_t *rng, const double low[2], double width, uint64_t samples);
+
+void InitSampler(sampler_t *sampler, rng_t *rng)
+{
+    sampler->rng = rng;
+
+    if (rng->kind == RNG_XOSHIRO)
+    {
+        for (size_t l = 0; l < SAMPLER_LANES; l++)
+        {
+            for (size_t k = 0; k < 4; k++)
+            {
+                sampler->xoshiro[k][l] = rng->xoshiro.s[k];
+            }
+
+            Xoshiro256Jump(&rng->xoshiro);
+        }
+    }
+}
+
+uint64_t CountQuarterCircleHits(sampler_t *sampler, const double low[2], double width, uint64_t samples)
+{
+    if (sampler->rng->kind == RNG_PHILOX)
+    {
+        return PhiloxHits(&sampler->rng->philox, low, width, samples);
+    }
+
+    return XoshiroHits(sampler->xoshiro, low, width, samples);
+}
+
+// Random words become doubles on [0, 1) by placing their top 52 bits in
+// the mantissa of a number on [1, 2) and subtracting one, which needs no
+// 64 bit integer conversion instructions.
+
+#if defined(__AVX512F__)
+
+#define VECTOR_LANES 8
+#define VECTORS (SAMPLER_LANES / VECTOR_LANES)
+
+static inline __m512i XoshiroStep(__m512i *s0, __m512i *s1, __m512i *s2, __m512i *s3)
+{
+    __m512i times5 = _mm512_add_epi64(_mm512_slli_epi64(*s1, 2), *s1);
+    __m512i rotated = _mm512_rol_epi64(times5, 7);
+    __m512i result = _mm512_add_epi64(_mm512_slli_epi64(rotated, 3), rotated);
+    __m512i t = _mm512_slli_epi64(*s1, 17);
+
+    *s2 = _mm512_xor_si512(*s2, *s0);
+    *s3 = _mm512_xor_si512(*s3, *s1);
+    *s1 = _mm512_xor_si512(*s1, *s2);
+    *s0 = _mm512_xor_si512(*s0, *s3);
+    *s2 = _mm512_xor_si512(*s2, t);
+    *s3 = _mm512_rol_epi64(*s3, 45);
+
+    return result;
+}
+
+static inline __m512d ToUnit(__m512i bits)
+{
+    __m512i mantissa = _mm512_or_si512(_mm512_srli_epi64(bits, 12), _mm512_set1_epi64((long long)UNIT_EXPONENT));
+    return _mm512_sub_pd(_mm512_castsi512_pd(mantissa), _mm512_set1_pd(1.0));
+}
+
+// Lanes of vector v that are below the remaining sample count.
+static inline __mmask8 ValidLanes(uint64_t remaining, size_t v)
+{
+    if (remaining >= SAMPLER_LANES)
+    {
+        return 0xFF;
+    }
+
+    uint64_t first = v * VECTOR_LANES;
+    uint64_t valid = remaining > first ? remaining - first : 0;
+    return valid >= VECTOR_LANES ? (__mmask8)0xFF : (__mmask8)((1u << valid) - 1);
+}
+
+static inline __m512i CountInside(__m512i hits, __m512d x, __m512d y, __mmask8 valid)
+{
+    __m512d r2 = _mm512_fmadd_pd(x, x, _mm512_mul_pd(y, y));
+    __mmask8 inside = _mm512_mask_cmp_pd_mask(valid, r2, _mm512_set1_pd(1.0), _CMP_LE_OQ);
+    return _mm512_mask_add_epi64(hits, inside, hits, _mm512_set1_epi64(1));
+}
+
+static uint64_t XoshiroHits(uint64_t state[4][SAMPLER_LANES], const double low[2], double width, uint64_t samples)
+{
+    const __m512d x0 = _mm512_set1_pd(low[0]), y0 = _mm512_set1_pd(low[1]), w = _mm512_set1_pd(width);
+    __m512i s0[VECTORS], s1[VECTORS], s2[VECTORS], s3[VECTORS], hits[VECTORS];
+
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        s0[v] = _mm512_loadu_si512(state[0] + v * VECTOR_LANES);
+        s1[v] = _mm512_loadu_si512(state[1] + v * VECTOR_LANES);
+        s2[v] = _mm512_loadu_si512(state[2] + v * VECTOR_LANES);
+        s3[v] = _mm512_loadu_si512(state[3] + v * VECTOR_LANES);
+        hits[v] = _mm512_setzero_si512();
+    }
+
+    for (uint64_t done = 0; done < samples; done += SAMPLER_LANES)
+    {
+        for (size_t v = 0; v < VECTORS; v++)
+        {
+            __m512d x = _mm512_fmadd_pd(ToUnit(XoshiroStep(s0 + v, s1 + v, s2 + v, s3 + v)), w, x0);
+            __m512d y = _mm512_fmadd_pd(ToUnit(XoshiroStep(s0 + v, s1 + v, s2 + v, s3 + v)), w, y0);
+            hits[v] = CountInside(hits[v], x, y, ValidLanes(samples - done, v));
+        }
+    }
+
+    uint64_t total = 0;
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        _mm512_storeu_si512(state[0] + v * VECTOR_LANES, s0[v]);
+        _mm512_storeu_si512(state[1] + v * VECTOR_LANES, s1[v]);
+        _mm512_storeu_si512(state[2] + v * VECTOR_LANES, s2[v]);
+        _mm512_storeu_si512(state[3] + v * VECTOR_LANES, s3[v]);
+        total += (uint64_t)_mm512_reduce_add_epi64(hits[v]);
+    }
+
+    return total;
+}
+
+// Every lane holds 32 bit Philox words in the low half of 64 bit elements,
+// so the 32 x 32 -> 64 bit multiply yields both halves of the product.
+static uint64_t PhiloxHits(philox_t *rng, const double low[2], double width, uint64_t samples)
+{
+    const __m512d x0 = _mm512_set1_pd(low[0]), y0 = _mm512_set1_pd(low[1]), w = _mm512_set1_pd(width);
+    const __m512i low_half = _mm512_set1_epi64(0xFFFFFFFF);
+    const __m512i m0 = _mm512_set1_epi64(PHILOX_M0);
+    const __m512i m1 = _mm512_set1_epi64(PHILOX_M1);
+    const __m512i c2_start = _mm512_set1_epi64(rng->counter[2]);
+    const __m512i c3_start = _mm512_set1_epi64(rng->counter[3]);
+    const __m512i lane_index = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    uint64_t base = (uint64_t)rng->counter[1] << 32 | rng->counter[0];
+    __m512i hits[VECTORS];
+
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        hits[v] = _mm512_setzero_si512();
+    }
+
+    for (uint64_t done = 0; done < samples; done += SAMPLER_LANES)
+    {
+        for (size_t v = 0; v < VECTORS; v++)
+        {
+            __m512i block = _mm512_add_epi64(_mm512_set1_epi64((long long)(base + done + v * VECTOR_LANES)),
+                                             lane_index);
+            __m512i c0 = _mm512_and_si512(block, low_half);
+            __m512i c1 = _mm512_srli_epi64(block, 32);
+            __m512i c2 = c2_start, c3 = c3_start;
+            uint32_t k0 = rng->key[0], k1 = rng->key[1];
+
+            for (int round = 0; round < 10; round++)
+            {
+                __m512i product0 = _mm512_mul_epu32(m0, c0);
+                __m512i product1 = _mm512_mul_epu32(m1, c2);
+
+                c0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_srli_epi64(product1, 32), c1), _mm512_set1_epi64(k0));
+                c2 = _mm512_xor_si512(_mm512_xor_si512(_mm512_srli_epi64(product0, 32), c3), _mm512_set1_epi64(k1));
+                c1 = _mm512_and_si512(product1, low_half);
+                c3 = _mm512_and_si512(product0, low_half);
+
+                k0 += PHILOX_W0;
+                k1 += PHILOX_W1;
+            }
+
+            __m512d x = _mm512_fmadd_pd(ToUnit(_mm512_or_si512(_mm512_slli_epi64(c0, 32), c1)), w, x0);
+            __m512d y = _mm512_fmadd_pd(ToUnit(_mm512_or_si512(_mm512_slli_epi64(c2, 32), c3)), w, y0);
+            hits[v] = CountInside(hits[v], x, y, ValidLanes(samples - done, v));
+        }
+    }
+
+    PhiloxSkip(rng, samples);
+    rng->index = 4 * PHILOX_BATCH;
+
+    uint64_t total = 0;
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        total += (uint64_t)_mm512_reduce_add_epi64(hits[v]);
+    }
+
+    return total;
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+#define VECTOR_LANES 4
+#define VECTORS (SAMPLER_LANES / VECTOR_LANES)
+
+static inline __m256i RotateLeft(__m256i x, int k)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+static inline __m256i XoshiroStep(__m256i *s0, __m256i *s1, __m256i *s2, __m256i *s3)
+{
+    __m256i times5 = _mm256_add_epi64(_mm256_slli_epi64(*s1, 2), *s1);
+    __m256i rotated = RotateLeft(times5, 7);
+    __m256i result = _mm256_add_epi64(_mm256_slli_epi64(rotated, 3), rotated);
+    __m256i t = _mm256_slli_epi64(*s1, 17);
+
+    *s2 = _mm256_xor_si256(*s2, *s0);
+    *s3 = _mm256_xor_si256(*s3, *s1);
+    *s1 = _mm256_xor_si256(*s1, *s2);
+    *s0 = _mm256_xor_si256(*s0, *s3);
+    *s2 = _mm256_xor_si256(*s2, t);
+    *s3 = RotateLeft(*s3, 45);
+
+    return result;
+}
+
+static inline __m256d ToUnit(__m256i bits)
+{
+    __m256i mantissa = _mm256_or_si256(_mm256_srli_epi64(bits, 12), _mm256_set1_epi64x((long long)UNIT_EXPONENT));
+    return _mm256_sub_pd(_mm256_castsi256_pd(mantissa), _mm256_set1_pd(1.0));
+}
+
+// All ones in the lanes of vector v that are below the remaining sample count.
+static inline __m256i ValidLanes(uint64_t remaining, size_t v)
+{
+    if (remaining >= SAMPLER_LANES)
+    {
+        return _mm256_set1_epi64x(-1);
+    }
+
+    long long first = (long long)(v * VECTOR_LANES);
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)remaining - first), _mm256_set_epi64x(3, 2, 1, 0));
+}
+
+// Inside lanes compare to all ones, i.e. -1, which is subtracted.
+static inline __m256i CountInside(__m256i hits, __m256d x, __m256d y, __m256i valid)
+{
+    __m256d r2 = _mm256_fmadd_pd(x, x, _mm256_mul_pd(y, y));
+    __m256i inside = _mm256_castpd_si256(_mm256_cmp_pd(r2, _mm256_set1_pd(1.0), _CMP_LE_OQ));
+    return _mm256_sub_epi64(hits, _mm256_and_si256(inside, valid));
+}
+
+static uint64_t HorizontalSum(__m256i v)
+{
+    uint64_t lanes[VECTOR_LANES];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static uint64_t XoshiroHits(uint64_t state[4][SAMPLER_LANES], const double low[2], double width, uint64_t samples)
+{
+    const __m256d x0 = _mm256_set1_pd(low[0]), y0 = _mm256_set1_pd(low[1]), w = _mm256_set1_pd(width);
+    __m256i s0[VECTORS], s1[VECTORS], s2[VECTORS], s3[VECTORS], hits[VECTORS];
+
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        s0[v] = _mm256_loadu_si256((__m256i *)(state[0] + v * VECTOR_LANES));
+        s1[v] = _mm256_loadu_si256((__m256i *)(state[1] + v * VECTOR_LANES));
+        s2[v] = _mm256_loadu_si256((__m256i *)(state[2] + v * VECTOR_LANES));
+        s3[v] = _mm256_loadu_si256((__m256i *)(state[3] + v * VECTOR_LANES));
+        hits[v] = _mm256_setzero_si256();
+    }
+
+    for (uint64_t done = 0; done < samples; done += SAMPLER_LANES)
+    {
+        for (size_t v = 0; v < VECTORS; v++)
+        {
+            __m256d x = _mm256_fmadd_pd(ToUnit(XoshiroStep(s0 + v, s1 + v, s2 + v, s3 + v)), w, x0);
+            __m256d y = _mm256_fmadd_pd(ToUnit(XoshiroStep(s0 + v, s1 + v, s2 + v, s3 + v)), w, y0);
+            hits[v] = CountInside(hits[v], x, y, ValidLanes(samples - done, v));
+        }
+    }
+
+    uint64_t total = 0;
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        _mm256_storeu_si256((__m256i *)(state[0] + v * VECTOR_LANES), s0[v]);
+        _mm256_storeu_si256((__m256i *)(state[1] + v * VECTOR_LANES), s1[v]);
+        _mm256_storeu_si256((__m256i *)(state[2] + v * VECTOR_LANES), s2[v]);
+        _mm256_storeu_si256((__m256i *)(state[3] + v * VECTOR_LANES), s3[v]);
+        total += HorizontalSum(hits[v]);
+    }
+
+    return total;
+}
+
+// Every lane holds 32 bit Philox words in the low half of 64 bit elements,
+// so the 32 x 32 -> 64 bit multiply yields both halves of the product.
+static uint64_t PhiloxHits(philox_t *rng, const double low[2], double width, uint64_t samples)
+{
+    const __m256d x0 = _mm256_set1_pd(low[0]), y0 = _mm256_set1_pd(low[1]), w = _mm256_set1_pd(width);
+    const __m256i low_half = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i m0 = _mm256_set1_epi64x(PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi64x(PHILOX_M1);
+    const __m256i c2_start = _mm256_set1_epi64x(rng->counter[2]);
+    const __m256i c3_start = _mm256_set1_epi64x(rng->counter[3]);
+    const __m256i lane_index = _mm256_set_epi64x(3, 2, 1, 0);
+    uint64_t base = (uint64_t)rng->counter[1] << 32 | rng->counter[0];
+    __m256i hits[VECTORS];
+
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        hits[v] = _mm256_setzero_si256();
+    }
+
+    for (uint64_t done = 0; done < samples; done += SAMPLER_LANES)
+    {
+        for (size_t v = 0; v < VECTORS; v++)
+        {
+            __m256i block = _mm256_add_epi64(_mm256_set1_epi64x((long long)(base + done + v * VECTOR_LANES)),
+                                             lane_index);
+            __m256i c0 = _mm256_and_si256(block, low_half);
+            __m256i c1 = _mm256_srli_epi64(block, 32);
+            __m256i c2 = c2_start, c3 = c3_start;
+            uint32_t k0 = rng->key[0], k1 = rng->key[1];
+
+            for (int round = 0; round < 10; round++)
+            {
+                __m256i product0 = _mm256_mul_epu32(m0, c0);
+                __m256i product1 = _mm256_mul_epu32(m1, c2);
+
+                c0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(product1, 32), c1), _mm256_set1_epi64x(k0));
+                c2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(product0, 32), c3), _mm256_set1_epi64x(k1));
+                c1 = _mm256_and_si256(product1, low_half);
+                c3 = _mm256_and_si256(product0, low_half);
+
+                k0 += PHILOX_W0;
+                k1 += PHILOX_W1;
+            }
+
+            __m256d x = _mm256_fmadd_pd(ToUnit(_mm256_or_si256(_mm256_slli_epi64(c0, 32), c1)), w, x0);
+            __m256d y = _mm256_fmadd_pd(ToUnit(_mm256_or_si256(_mm256_slli_epi64(c2, 32), c3)), w, y0);
+            hits[v] = CountInside(hits[v], x, y, ValidLanes(samples - done, v));
+        }
+    }
+
+    PhiloxSkip(rng, samples);
+    rng->index = 4 * PHILOX_BATCH;
+
+    uint64_t total = 0;
+    for (size_t v = 0; v < VECTORS; v++)
+    {
+        total += HorizontalSum(hits[v]);
+    }
+
+    return total;
+}
+
+#else
+
+static double ToUnit(uint64_t bits)
+{
+    uint64_t mantissa = (bits >> 12) | UNIT_EXPONENT;
+    double value;
+    memcpy(&value, &mantissa, sizeof(value));
+    return value - 1.0;
+}
+
+static uint64_t XoshiroHits(uint64_t state[4][SAMPLER_LANES], const double low[2], double width, uint64_t samples)
+{
+    uint64_t hits = 0;
+
+    for (uint64_t done = 0; done < samples; done += SAMPLER_LANES)
+    {
+        for (size_t l = 0; l < SAMPLER_LANES; l++)
+        {
+            xoshiro256_t lane = { { state[0][l], state[1][l], state[2][l], state[3][l] } };
+            double x = low[0] + width * ToUnit(Xoshiro256Next(&lane));
+            double y = low[1] + width * ToUnit(Xoshiro256Next(&lane));
+
+            for (size_t k = 0; k < 4; k++)
+            {
+                state[k][l] = lane.s[k];
+            }
+
+            if (done + l < samples && x * x + y * y <= 1)
+            {
+                hits++;
+            }
+        }
+    }
+
+    return hits;
+}
+
+static uint64_t PhiloxHits(philox_t *rng, const double low[2], double width, uint64_t samples)
+{
+    uint32_t counter[4] = { rng->counter[0], rng->counter[1], rng->counter[2], rng->counter[3] };
+    uint32_t output[4 * PHILOX_BATCH];
+    uint64_t hits = 0;
+
+    for (uint64_t done = 0; done < samples; done += PHILOX_BATCH)
+    {
+        PhiloxBlocks(counter, rng->key, output);
+
+        for (size_t b = 0; b < PHILOX_BATCH && done + b < samples; b++)
+        {
+            double x = low[0] + width * ToUnit((uint64_t)output[4 * b] << 32 | output[4 * b + 1]);
+            double y = low[1] + width * ToUnit((uint64_t)output[4 * b + 2] << 32 | output[4 * b + 3]);
+
+            if (x * x + y * y <= 1)
+            {
+                hits++;
+            }
+        }
+
+        uint64_t block = ((uint64_t)counter[1] << 32 | counter[0]) + PHILOX_BATCH;
+        counter[0] = (uint32_t)block;
+        counter[1] = (uint32_t)(block >> 32);
+    }
+
+    PhiloxSkip(rng, samples);
+    rng->index = 4 * PHILOX_BATCH;
+
+    return hits;
+}
+
+#endif
@@ -0,0 +1,30 @@
+/**
+* Program: Calculating PI
+**/
+
+#pragma once
+
+#include <stdint.h>
+#include "typedefs.h"
+#include "rng.h"
+
+#define SAMPLER_LANES 16 // samples drawn side by side, two AVX-512 or four AVX2 vectors
+
+// Batch sampler of one thread. A xoshiro stream is split into
+// SAMPLER_LANES sub-streams one jump (2^128 outputs) apart that advance in
+// lock step; Philox lanes simply take consecutive counters of the stream.
+typedef struct alignas(CACHE_LINE) sampler_t
+{
+    rng_t *rng;
+    uint64_t xoshiro[4][SAMPLER_LANES]; // word k of lane l at [k][l]
+} sampler_t;
+
+// Splits rng into lanes. A xoshiro rng is left SAMPLER_LANES jumps ahead.
+void InitSampler(sampler_t *sampler, rng_t *rng);
+
+// Draws samples points (x, y) uniform on the square low + [0, width)^2 and
+// returns how many have x^2 + y^2 <= 1. Uses AVX-512 or AVX2 when the
+// compiler targets them (e.g. -march=native) and a scalar loop otherwise,
+// all drawing the same points. Philox continues from the next unbuffered
+// block.
+uint64_t CountQuarterCircleHits(sampler_t *sampler, const double low[2], double width, uint64_t samples);
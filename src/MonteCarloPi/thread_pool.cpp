@@ -0,0 +1,122 @@
+/**
+* Program: Calculating PI
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "typedefs.h"
+#include "thread_pool.h"
+
+static void * PoolThreadMain(void *args);
+
+thread_pool_t * CreateThreadPool(size_t num_threads)
+{
+    thread_pool_t *pool = (thread_pool_t *)calloc(1, sizeof(thread_pool_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(pool, "pool");
+
+    pool->num_threads = num_threads > 0 ? num_threads : 1;
+    pool->threads = (pthread_t *)malloc(pool->num_threads * sizeof(pthread_t));
+    pool->workers = (pool_worker_t *)malloc(pool->num_threads * sizeof(pool_worker_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(pool->threads, "pool->threads");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(pool->workers, "pool->workers");
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (size_t i = 0; i < pool->num_threads; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].tid = i;
+
+        if (0 != pthread_create(pool->threads + i, NULL, PoolThreadMain, (void *)(pool->workers + i)))
+        {
+            fprintf(stderr, "Error creating a thread: %zu.\n", i);
+            exit(1);
+        }
+    }
+
+    return pool;
+}
+
+void DestroyThreadPool(thread_pool_t *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->job_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->num_threads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->job_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+void RunOnThreadPool(thread_pool_t *pool, pool_job_t job, void *args)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->job = job;
+    pool->args = args;
+    pool->running = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_cond);
+
+    while (pool->running > 0)
+    {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void * PoolThreadMain(void *args)
+{
+    pool_worker_t *worker = (pool_worker_t *)args;
+    thread_pool_t *pool = worker->pool;
+    size_t seen = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->stop && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->job_cond, &pool->mutex);
+        }
+
+        if (pool->stop)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+
+        seen = pool->generation;
+        pool_job_t job = pool->job;
+        void *job_args = pool->args;
+        pthread_mutex_unlock(&pool->mutex);
+
+        job(job_args, worker->tid);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->running == 0)
+        {
+            pthread_cond_signal(&pool->done_cond);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
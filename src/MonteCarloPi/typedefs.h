@@ -0,0 +1,20 @@
+/**
+* Program: Calculating PI
+**/
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(ptr, var_name) \
+    if (ptr == NULL) \
+        { \
+        printf("Assertion error: %s is NULL.\n", var_name);\
+        exit(1); \
+        }
+
+#define SUCCESS 0
+#define FAILURE 1
+
+#define CACHE_LINE 64 // bytes, per-thread state is aligned and padded to it
@@ -0,0 +1,490 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "typedefs.h"
+#include "barnes_hut.h"
+
+static void BuildSubtree(bh_tree_t *tree, bh_arena_t *arena, bh_node_t *node, body_store_t *bodies, size_t depth);
+static size_t Partition(size_t *order, size_t count, const double *coordinates, double pivot);
+static bh_node_t * ArenaAlloc(bh_arena_t *arena);
+static void ArenaReset(bh_arena_t *arena);
+
+static inline const double * Coordinates(body_store_t *bodies, size_t axis)
+{
+    return axis == 0 ? bodies->x : axis == 1 ? bodies->y : bodies->z;
+}
+
+static inline size_t TopOffset(bh_tree_t *tree, size_t level)
+{
+    return (((size_t)1 << (tree->dims * level)) - 1) / (tree->num_children - 1);
+}
+
+// Interleaves the cell coordinates so that every dims bits, most significant
+// first, select the child on the next level.
+static inline size_t CellIndex(bh_tree_t *tree, size_t *index, size_t levels)
+{
+    size_t cell = 0;
+    for (size_t b = 0; b < levels; b++)
+    {
+        for (size_t a = 0; a < tree->dims; a++)
+        {
+            cell |= ((index[a] >> b) & 1) << (tree->dims * b + a);
+        }
+    }
+
+    return cell;
+}
+
+static inline void CellBox(bh_tree_t *tree, size_t cell, size_t level, bh_node_t *node)
+{
+    size_t index[3] = { 0, 0, 0 };
+    for (size_t b = 0; b < level; b++)
+    {
+        for (size_t a = 0; a < tree->dims; a++)
+        {
+            index[a] |= ((cell >> (tree->dims * b + a)) & 1) << b;
+        }
+    }
+
+    double cell_size = tree->size / (double)((size_t)1 << level);
+    node->half = cell_size / 2;
+    for (size_t a = 0; a < 3; a++)
+    {
+        node->center[a] = a < tree->dims ? tree->min[a] + (index[a] + 0.5) * cell_size : 0;
+    }
+}
+
+bh_tree_t * CreateBarnesHutTree(size_t num_bodies, size_t num_threads, size_t dims, spin_barrier_t *barrier)
+{
+    bh_tree_t *tree = (bh_tree_t *)calloc(1, sizeof(bh_tree_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree, "tree");
+
+    tree->dims = dims;
+    tree->num_children = (size_t)1 << dims;
+
+    // Enough cells for every thread to get several subtrees to build.
+    tree->levels = 1;
+    while (tree->levels < BH_MAX_TOP_LEVELS && ((size_t)1 << (dims * tree->levels)) < 4 * num_threads)
+    {
+        tree->levels++;
+    }
+
+    tree->num_bodies = num_bodies;
+    tree->num_threads = num_threads;
+    tree->num_cells = (size_t)1 << (dims * tree->levels);
+    tree->order = (size_t *)malloc(num_bodies * sizeof(size_t));
+    tree->cell_of_body = (size_t *)malloc(num_bodies * sizeof(size_t));
+    tree->cell_counts = (size_t *)calloc(num_threads * tree->num_cells, sizeof(size_t));
+    tree->cell_offsets = (size_t *)calloc(num_threads * tree->num_cells, sizeof(size_t));
+    tree->bounds = (double *)calloc(num_threads * 6, sizeof(double));
+    tree->top = (bh_node_t *)calloc(TopOffset(tree, tree->levels + 1), sizeof(bh_node_t));
+    tree->arenas = (bh_arena_t *)calloc(num_threads, sizeof(bh_arena_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->order, "tree->order");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->cell_of_body, "tree->cell_of_body");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->cell_counts, "tree->cell_counts");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->cell_offsets, "tree->cell_offsets");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->bounds, "tree->bounds");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->top, "tree->top");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(tree->arenas, "tree->arenas");
+
+    tree->barrier = barrier;
+
+    return tree;
+}
+
+void DestroyBarnesHutTree(bh_tree_t *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < tree->num_threads; i++)
+    {
+        bh_arena_block_t *block = tree->arenas[i].first;
+        while (block != NULL)
+        {
+            bh_arena_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+    }
+
+    free(tree->arenas);
+    free(tree->top);
+    free(tree->bounds);
+    free(tree->cell_offsets);
+    free(tree->cell_counts);
+    free(tree->cell_of_body);
+    free(tree->order);
+    free(tree);
+}
+
+void BuildBarnesHutTree(bh_tree_t *tree, body_store_t *bodies, size_t tid, size_t start, size_t end)
+{
+    size_t num_threads = tree->num_threads;
+    size_t num_cells = tree->num_cells;
+    size_t levels = tree->levels;
+    size_t dims = tree->dims;
+
+    double *bounds = tree->bounds + 6 * tid;
+    for (size_t a = 0; a < dims; a++)
+    {
+        const double *coordinates = Coordinates(bodies, a);
+        bounds[a] = INFINITY;
+        bounds[3 + a] = -INFINITY;
+
+        for (size_t i = start; i < end; i++)
+        {
+            bounds[a] = fmin(bounds[a], coordinates[i]);
+            bounds[3 + a] = fmax(bounds[3 + a], coordinates[i]);
+        }
+    }
+
+    SpinBarrierWait(tree->barrier);
+
+    // Every thread reduces the bounds itself instead of waiting for one.
+    double min[3] = { 0, 0, 0 };
+    double size = 0;
+    for (size_t a = 0; a < dims; a++)
+    {
+        double max = -INFINITY;
+        min[a] = INFINITY;
+        for (size_t t = 0; t < num_threads; t++)
+        {
+            min[a] = fmin(min[a], tree->bounds[6 * t + a]);
+            max = fmax(max, tree->bounds[6 * t + 3 + a]);
+        }
+
+        size = fmax(size, max - min[a]);
+    }
+
+    size = size > 0 ? size * 1.0001 : 1; // keep the maximum inside the last cell
+    double scale = (double)((size_t)1 << levels) / size;
+    size_t max_index = ((size_t)1 << levels) - 1;
+
+    size_t *counts = tree->cell_counts + tid * num_cells;
+    memset(counts, 0, num_cells * sizeof(size_t));
+
+    for (size_t i = start; i < end; i++)
+    {
+        size_t index[3];
+        for (size_t a = 0; a < dims; a++)
+        {
+            index[a] = (size_t)((Coordinates(bodies, a)[i] - min[a]) * scale);
+            index[a] = index[a] < max_index ? index[a] : max_index;
+        }
+
+        size_t cell = CellIndex(tree, index, levels);
+        tree->cell_of_body[i] = cell;
+        counts[cell]++;
+    }
+
+    if (tid == 0)
+    {
+        memcpy(tree->min, min, sizeof(min));
+        tree->size = size;
+    }
+
+    SpinBarrierWait(tree->barrier);
+
+    // Counting sort: a thread's bodies of a cell follow the same cell's bodies
+    // of lower numbered threads.
+    size_t *offsets = tree->cell_offsets + tid * num_cells;
+    size_t cell_start = 0;
+    for (size_t c = 0; c < num_cells; c++)
+    {
+        size_t offset = cell_start;
+        for (size_t t = 0; t < num_threads; t++)
+        {
+            if (t == tid)
+            {
+                offsets[c] = offset;
+            }
+            offset += tree->cell_counts[t * num_cells + c];
+        }
+
+        if (tid == 0)
+        {
+            bh_node_t *node = tree->top + TopOffset(tree, levels) + c;
+            node->first = cell_start;
+            node->count = offset - cell_start;
+        }
+
+        cell_start = offset;
+    }
+
+    for (size_t i = start; i < end; i++)
+    {
+        tree->order[offsets[tree->cell_of_body[i]]++] = i;
+    }
+
+    SpinBarrierWait(tree->barrier);
+
+    bh_arena_t *arena = tree->arenas + tid;
+    ArenaReset(arena);
+
+    for (size_t c = tid; c < num_cells; c += num_threads)
+    {
+        bh_node_t *node = tree->top + TopOffset(tree, levels) + c;
+        CellBox(tree, c, levels, node);
+        BuildSubtree(tree, arena, node, bodies, levels);
+    }
+
+    SpinBarrierWait(tree->barrier);
+
+    if (tid == 0)
+    {
+        for (size_t level = levels; level-- > 0;)
+        {
+            for (size_t p = 0; p < ((size_t)1 << (dims * level)); p++)
+            {
+                bh_node_t *node = tree->top + TopOffset(tree, level) + p;
+                CellBox(tree, p, level, node);
+                node->leaf = false;
+                node->mass = 0;
+                node->com[0] = node->com[1] = node->com[2] = 0;
+                node->count = 0;
+                memset(node->children, 0, sizeof(node->children));
+
+                for (size_t k = 0; k < tree->num_children; k++)
+                {
+                    bh_node_t *child = tree->top + TopOffset(tree, level + 1) + tree->num_children * p + k;
+                    if (child->count == 0)
+                    {
+                        continue;
+                    }
+
+                    node->children[k] = child;
+                    if (node->count == 0)
+                    {
+                        node->first = child->first;
+                    }
+                    node->count += child->count;
+                    node->mass += child->mass;
+                    for (size_t a = 0; a < 3; a++)
+                    {
+                        node->com[a] += child->mass * child->com[a];
+                    }
+                }
+
+                if (node->mass > 0)
+                {
+                    for (size_t a = 0; a < 3; a++)
+                    {
+                        node->com[a] /= node->mass;
+                    }
+                }
+            }
+        }
+    }
+
+    SpinBarrierWait(tree->barrier);
+}
+
+static void BuildSubtree(bh_tree_t *tree, bh_arena_t *arena, bh_node_t *node, body_store_t *bodies, size_t depth)
+{
+    size_t *order = tree->order + node->first;
+
+    node->mass = 0;
+    node->com[0] = node->com[1] = node->com[2] = 0;
+    for (size_t k = 0; k < node->count; k++)
+    {
+        size_t j = order[k];
+        node->mass += bodies->w[j];
+        node->com[0] += bodies->w[j] * bodies->x[j];
+        node->com[1] += bodies->w[j] * bodies->y[j];
+        node->com[2] += bodies->w[j] * bodies->z[j];
+    }
+
+    if (node->mass > 0)
+    {
+        for (size_t a = 0; a < 3; a++)
+        {
+            node->com[a] /= node->mass;
+        }
+    }
+
+    memset(node->children, 0, sizeof(node->children));
+    node->leaf = node->count <= BH_LEAF_CAPACITY || depth >= BH_MAX_DEPTH;
+    if (node->leaf)
+    {
+        return;
+    }
+
+    // Splitting by the highest axis first and then every part by the next
+    // one leaves the children in index order.
+    size_t bounds[BH_MAX_CHILDREN + 1];
+    size_t split[BH_MAX_CHILDREN + 1];
+    size_t parts = 1;
+    bounds[0] = 0;
+    bounds[1] = node->count;
+
+    for (size_t a = tree->dims; a-- > 0;)
+    {
+        for (size_t s = 0; s < parts; s++)
+        {
+            size_t lower = Partition(order + bounds[s], bounds[s + 1] - bounds[s],
+                                     Coordinates(bodies, a), node->center[a]);
+            split[2 * s] = bounds[s];
+            split[2 * s + 1] = bounds[s] + lower;
+        }
+
+        split[2 * parts] = node->count;
+        parts *= 2;
+        memcpy(bounds, split, (parts + 1) * sizeof(size_t));
+    }
+
+    for (size_t q = 0; q < tree->num_children; q++)
+    {
+        if (bounds[q + 1] == bounds[q])
+        {
+            continue;
+        }
+
+        bh_node_t *child = ArenaAlloc(arena);
+        child->half = node->half / 2;
+        for (size_t a = 0; a < 3; a++)
+        {
+            child->center[a] = a < tree->dims ? node->center[a] + (q >> a & 1 ? child->half : -child->half) : 0;
+        }
+        child->first = node->first + bounds[q];
+        child->count = bounds[q + 1] - bounds[q];
+        node->children[q] = child;
+
+        BuildSubtree(tree, arena, child, bodies, depth + 1);
+    }
+}
+
+// Moves bodies below the pivot to the front, returns their count.
+static size_t Partition(size_t *order, size_t count, const double *coordinates, double pivot)
+{
+    size_t lower = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        if (coordinates[order[k]] < pivot)
+        {
+            size_t tmp = order[lower];
+            order[lower] = order[k];
+            order[k] = tmp;
+            lower++;
+        }
+    }
+
+    return lower;
+}
+
+static bh_node_t * ArenaAlloc(bh_arena_t *arena)
+{
+    if (arena->current->used == BH_ARENA_BLOCK)
+    {
+        if (arena->current->next == NULL)
+        {
+            bh_arena_block_t *block = (bh_arena_block_t *)malloc(sizeof(bh_arena_block_t));
+            ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(block, "block");
+            block->next = NULL;
+            arena->current->next = block;
+        }
+
+        arena->current = arena->current->next;
+        arena->current->used = 0;
+    }
+
+    return arena->current->nodes + arena->current->used++;
+}
+
+static void ArenaReset(bh_arena_t *arena)
+{
+    if (arena->first == NULL)
+    {
+        arena->first = (bh_arena_block_t *)malloc(sizeof(bh_arena_block_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(arena->first, "arena->first");
+        arena->first->next = NULL;
+    }
+
+    arena->current = arena->first;
+    arena->current->used = 0;
+}
+
+void BarnesHutAcceleration(bh_tree_t *tree, body_store_t *bodies, size_t i, double theta,
+                           const gravity_t *gravity, double *ax, double *ay, double *az)
+{
+    bh_node_t *stack[BH_MAX_CHILDREN * BH_MAX_DEPTH + BH_MAX_CHILDREN];
+    size_t top = 0;
+    double position[3] = { bodies->x[i], bodies->y[i], bodies->z[i] };
+    double softening2 = gravity->softening * gravity->softening;
+    double theta2 = theta * theta;
+    double sum[3] = { 0, 0, 0 };
+
+    if (tree->top[0].count > 0)
+    {
+        stack[top++] = tree->top;
+    }
+
+    while (top > 0)
+    {
+        bh_node_t *node = stack[--top];
+
+        if (node->leaf)
+        {
+            for (size_t k = node->first; k < node->first + node->count; k++)
+            {
+                size_t j = tree->order[k];
+                double delta[3] = { bodies->x[j] - position[0], bodies->y[j] - position[1], bodies->z[j] - position[2] };
+                double distance2 = delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2] + softening2;
+
+                if (j == i || distance2 == 0)
+                {
+                    continue;
+                }
+
+                double force = bodies->w[j] / (distance2 * sqrt(distance2));
+                for (size_t a = 0; a < 3; a++)
+                {
+                    sum[a] += force * delta[a];
+                }
+            }
+
+            continue;
+        }
+
+        double delta[3];
+        double distance2 = 0;
+        bool inside = true;
+        for (size_t a = 0; a < 3; a++)
+        {
+            delta[a] = node->com[a] - position[a];
+            distance2 += delta[a] * delta[a];
+            inside = inside && (a >= tree->dims || fabs(position[a] - node->center[a]) <= node->half);
+        }
+
+        double side = 2 * node->half;
+        if (!inside && side * side < theta2 * distance2)
+        {
+            distance2 += softening2;
+            double force = node->mass / (distance2 * sqrt(distance2));
+            for (size_t a = 0; a < 3; a++)
+            {
+                sum[a] += force * delta[a];
+            }
+            continue;
+        }
+
+        for (size_t q = 0; q < tree->num_children; q++)
+        {
+            if (node->children[q] != NULL)
+            {
+                stack[top++] = node->children[q];
+            }
+        }
+    }
+
+    *ax = gravity->g * sum[0];
+    *ay = gravity->g * sum[1];
+    *az = gravity->g * sum[2];
+}
@@ -0,0 +1,72 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "barrier.h"
+
+#define BH_LEAF_CAPACITY 8  // bodies kept in a leaf before it is split
+#define BH_MAX_DEPTH 48     // deeper cells become leaves regardless of size
+#define BH_MAX_TOP_LEVELS 4 // tree levels split by the parallel counting sort
+#define BH_ARENA_BLOCK 4096 // nodes allocated at once by a thread
+#define BH_MAX_CHILDREN 8
+
+typedef struct bh_node_t
+{
+    double center[3];
+    double half;           // half of the cell side
+    double mass;
+    double com[3];         // center of mass
+    size_t first, count;   // bodies order[first .. first + count)
+    bool leaf;
+    bh_node_t *children[BH_MAX_CHILDREN]; // child bit a - coordinate a >= center[a]
+} bh_node_t;
+
+typedef struct bh_arena_block_t
+{
+    bh_node_t nodes[BH_ARENA_BLOCK];
+    size_t used;
+    bh_arena_block_t *next;
+} bh_arena_block_t;
+
+typedef struct bh_arena_t
+{
+    bh_arena_block_t *first;
+    bh_arena_block_t *current;
+} bh_arena_t;
+
+// Quadtree (2D) or octree (3D) rebuilt every step. The top levels form a
+// fixed grid of cells filled by a parallel counting sort of the bodies; the
+// subtrees below the cells are built by the threads in parallel, each in its
+// own arena.
+typedef struct bh_tree_t
+{
+    size_t num_bodies;
+    size_t num_threads;
+    size_t dims;
+    size_t num_children;  // 2^dims
+    size_t levels;
+    size_t num_cells;
+    size_t *order;        // body indices grouped by cell and then by subtree
+    size_t *cell_of_body;
+    size_t *cell_counts;  // [thread][cell]
+    size_t *cell_offsets; // [thread][cell]
+    double *bounds;       // [thread][min x, y, z, max x, y, z]
+    bh_node_t *top;       // top levels, level l starts at (2^(dims l) - 1) / (2^dims - 1)
+    bh_arena_t *arenas;   // one per thread
+    double min[3], size;
+    spin_barrier_t *barrier; // shared with the simulation threads
+} bh_tree_t;
+
+bh_tree_t * CreateBarnesHutTree(size_t num_bodies, size_t num_threads, size_t dims, spin_barrier_t *barrier);
+void DestroyBarnesHutTree(bh_tree_t *tree);
+
+// Collective: every thread calls it with its own [start, end) body range.
+void BuildBarnesHutTree(bh_tree_t *tree, body_store_t *bodies, size_t tid, size_t start, size_t end);
+
+// Field at body i, cells seen under an angle below theta are treated as
+// point masses.
+void BarnesHutAcceleration(bh_tree_t *tree, body_store_t *bodies, size_t i, double theta,
+                           const gravity_t *gravity, double *ax, double *ay, double *az);
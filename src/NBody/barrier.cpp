@@ -0,0 +1,64 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "barrier.h"
+
+static inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+void InitSpinBarrier(spin_barrier_t *barrier, unsigned int count, unsigned int spin_limit)
+{
+    barrier->count = count;
+    barrier->spin_limit = spin_limit;
+    barrier->arrived = 0;
+    barrier->sense = 0;
+    barrier->sleepers = 0;
+}
+
+void SpinBarrierWait(spin_barrier_t *barrier)
+{
+    // Must be read before arriving, the last thread flips it right away.
+    unsigned int sense = __atomic_load_n(&barrier->sense, __ATOMIC_ACQUIRE);
+
+    if (__atomic_add_fetch(&barrier->arrived, 1, __ATOMIC_ACQ_REL) == barrier->count)
+    {
+        // Reset before the flip, a released thread may arrive again at once.
+        __atomic_store_n(&barrier->arrived, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&barrier->sense, sense + 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&barrier->sleepers, __ATOMIC_SEQ_CST) > 0)
+        {
+            syscall(SYS_futex, &barrier->sense, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+        }
+
+        return;
+    }
+
+    for (unsigned int i = 0; i < barrier->spin_limit; i++)
+    {
+        if (__atomic_load_n(&barrier->sense, __ATOMIC_ACQUIRE) != sense)
+        {
+            return;
+        }
+
+        CpuRelax();
+    }
+
+    // The sleeper count and the sense word are both sequentially consistent,
+    // so either the last thread sees us or we see its flip.
+    __atomic_add_fetch(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&barrier->sense, __ATOMIC_SEQ_CST) == sense)
+    {
+        syscall(SYS_futex, &barrier->sense, FUTEX_WAIT_PRIVATE, sense, NULL, NULL, 0);
+    }
+    __atomic_sub_fetch(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+}
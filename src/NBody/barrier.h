@@ -0,0 +1,23 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#define DEFAULT_BARRIER_SPIN 2000 // polls before a waiting thread goes to sleep
+
+// Reusable barrier. Threads poll for a while and then sleep on a futex; the
+// last thread to arrive only enters the kernel when someone is asleep. The
+// sense word is bumped once per phase, so the barrier needs no
+// re-initialisation between phases.
+typedef struct spin_barrier_t
+{
+    unsigned int count;
+    unsigned int spin_limit;
+    unsigned int arrived;
+    unsigned int sense;    // futex word
+    unsigned int sleepers;
+} spin_barrier_t;
+
+void InitSpinBarrier(spin_barrier_t *barrier, unsigned int count, unsigned int spin_limit);
+void SpinBarrierWait(spin_barrier_t *barrier);
@@ -0,0 +1,80 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "bodies.h"
+
+static void * AllocateArray(size_t bytes, const char *name);
+
+body_store_t * CreateBodyStore(size_t count)
+{
+    body_store_t *bodies = (body_store_t *)calloc(1, sizeof(body_store_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(bodies, "bodies");
+
+    bodies->count = count;
+    bodies->capacity = (count + BODY_PADDING - 1) / BODY_PADDING * BODY_PADDING;
+    if (bodies->capacity == 0)
+    {
+        bodies->capacity = BODY_PADDING;
+    }
+
+    bodies->x = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->x");
+    bodies->y = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->y");
+    bodies->z = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->z");
+    bodies->vx = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->vx");
+    bodies->vy = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->vy");
+    bodies->vz = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->vz");
+    bodies->w = (double *)AllocateArray(bodies->capacity * sizeof(double), "bodies->w");
+    bodies->xf = (float *)AllocateArray(bodies->capacity * sizeof(float), "bodies->xf");
+    bodies->yf = (float *)AllocateArray(bodies->capacity * sizeof(float), "bodies->yf");
+    bodies->zf = (float *)AllocateArray(bodies->capacity * sizeof(float), "bodies->zf");
+    bodies->wf = (float *)AllocateArray(bodies->capacity * sizeof(float), "bodies->wf");
+
+    return bodies;
+}
+
+void DestroyBodyStore(body_store_t *bodies)
+{
+    if (bodies == NULL)
+    {
+        return;
+    }
+
+    free(bodies->x);
+    free(bodies->y);
+    free(bodies->z);
+    free(bodies->vx);
+    free(bodies->vy);
+    free(bodies->vz);
+    free(bodies->w);
+    free(bodies->xf);
+    free(bodies->yf);
+    free(bodies->zf);
+    free(bodies->wf);
+    free(bodies);
+}
+
+void SyncFloatBodies(body_store_t *bodies, size_t start, size_t end)
+{
+    for (size_t i = start; i < end; i++)
+    {
+        bodies->xf[i] = (float)bodies->x[i];
+        bodies->yf[i] = (float)bodies->y[i];
+        bodies->zf[i] = (float)bodies->z[i];
+        bodies->wf[i] = (float)bodies->w[i];
+    }
+}
+
+// Zero filled, so padding slots are massless bodies at the origin.
+static void * AllocateArray(size_t bytes, const char *name)
+{
+    void *ptr = aligned_alloc(BODY_ALIGNMENT, (bytes + BODY_ALIGNMENT - 1) / BODY_ALIGNMENT * BODY_ALIGNMENT);
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(ptr, name);
+    memset(ptr, 0, bytes);
+
+    return ptr;
+}
@@ -0,0 +1,13 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#include "typedefs.h"
+
+body_store_t * CreateBodyStore(size_t count);
+void DestroyBodyStore(body_store_t *bodies);
+
+// Refreshes the single precision copy of bodies [start, end).
+void SyncFloatBodies(body_store_t *bodies, size_t start, size_t end);
@@ -0,0 +1,214 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "typedefs.h"
+#include "cell_list.h"
+
+static void CellOf(cell_list_t *cells, double x, double y, double z, long long cell[3]);
+static size_t BucketOf(cell_list_t *cells, const long long cell[3]);
+
+cell_list_t * CreateCellList(size_t num_bodies, size_t num_threads, size_t dims, double cutoff,
+                             spin_barrier_t *barrier)
+{
+    cell_list_t *cells = (cell_list_t *)calloc(1, sizeof(cell_list_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells, "cells");
+
+    cells->num_bodies = num_bodies;
+    cells->num_threads = num_threads;
+    cells->dims = dims;
+    cells->cutoff = cutoff;
+    cells->num_buckets = 1;
+    while (cells->num_buckets < CELL_LIST_BUCKETS_PER_BODY * num_bodies)
+    {
+        cells->num_buckets *= 2;
+    }
+
+    size_t buckets = cells->num_buckets;
+    cells->bucket_of_body = (size_t *)malloc(num_bodies * sizeof(size_t));
+    cells->bucket_counts = (size_t *)calloc(num_threads * buckets, sizeof(size_t));
+    cells->bucket_offsets = (size_t *)calloc(num_threads * buckets, sizeof(size_t));
+    cells->bucket_starts = (size_t *)calloc(buckets + 1, sizeof(size_t));
+    cells->sorted_x = (double *)malloc(num_bodies * sizeof(double));
+    cells->sorted_y = (double *)malloc(num_bodies * sizeof(double));
+    cells->sorted_z = (double *)malloc(num_bodies * sizeof(double));
+    cells->sorted_w = (double *)malloc(num_bodies * sizeof(double));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->bucket_of_body, "cells->bucket_of_body");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->bucket_counts, "cells->bucket_counts");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->bucket_offsets, "cells->bucket_offsets");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->bucket_starts, "cells->bucket_starts");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->sorted_x, "cells->sorted_x");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->sorted_y, "cells->sorted_y");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->sorted_z, "cells->sorted_z");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(cells->sorted_w, "cells->sorted_w");
+
+    cells->barrier = barrier;
+
+    return cells;
+}
+
+void DestroyCellList(cell_list_t *cells)
+{
+    if (cells == NULL)
+    {
+        return;
+    }
+
+    free(cells->sorted_w);
+    free(cells->sorted_z);
+    free(cells->sorted_y);
+    free(cells->sorted_x);
+    free(cells->bucket_starts);
+    free(cells->bucket_offsets);
+    free(cells->bucket_counts);
+    free(cells->bucket_of_body);
+    free(cells);
+}
+
+void BuildCellList(cell_list_t *cells, body_store_t *bodies, size_t tid, size_t start, size_t end)
+{
+    size_t num_threads = cells->num_threads;
+    size_t num_buckets = cells->num_buckets;
+    size_t *counts = cells->bucket_counts + tid * num_buckets;
+    size_t *offsets = cells->bucket_offsets + tid * num_buckets;
+
+    memset(counts, 0, num_buckets * sizeof(size_t));
+
+    for (size_t i = start; i < end; i++)
+    {
+        long long cell[3];
+        CellOf(cells, bodies->x[i], bodies->y[i], bodies->z[i], cell);
+
+        size_t bucket = BucketOf(cells, cell);
+        cells->bucket_of_body[i] = bucket;
+        counts[bucket]++;
+    }
+
+    SpinBarrierWait(cells->barrier);
+
+    // Counting sort: a thread's bodies of a bucket follow the same bucket's
+    // bodies of lower numbered threads.
+    size_t bucket_start = 0;
+    for (size_t b = 0; b < num_buckets; b++)
+    {
+        size_t offset = bucket_start;
+        for (size_t t = 0; t < num_threads; t++)
+        {
+            if (t == tid)
+            {
+                offsets[b] = offset;
+            }
+            offset += cells->bucket_counts[t * num_buckets + b];
+        }
+
+        if (tid == 0)
+        {
+            cells->bucket_starts[b] = bucket_start;
+        }
+
+        bucket_start = offset;
+    }
+
+    if (tid == 0)
+    {
+        cells->bucket_starts[num_buckets] = bucket_start;
+    }
+
+    for (size_t i = start; i < end; i++)
+    {
+        size_t slot = offsets[cells->bucket_of_body[i]]++;
+        cells->sorted_x[slot] = bodies->x[i];
+        cells->sorted_y[slot] = bodies->y[i];
+        cells->sorted_z[slot] = bodies->z[i];
+        cells->sorted_w[slot] = bodies->w[i];
+    }
+
+    SpinBarrierWait(cells->barrier);
+}
+
+void CellListAcceleration(cell_list_t *cells, body_store_t *bodies, size_t i, const gravity_t *gravity,
+                          double *ax, double *ay, double *az)
+{
+    double cutoff2 = cells->cutoff * cells->cutoff;
+    double softening2 = gravity->softening * gravity->softening;
+    long long reach_z = cells->dims == 3 ? 1 : 0;
+    double x = bodies->x[i], y = bodies->y[i], z = bodies->z[i];
+    double sum_x = 0, sum_y = 0, sum_z = 0;
+
+    long long cell[3];
+    CellOf(cells, x, y, z, cell);
+
+    // Neighbouring cells may share a bucket, which must be visited once.
+    size_t visited[27];
+    size_t num_visited = 0;
+
+    for (long long dz = -reach_z; dz <= reach_z; dz++)
+    {
+        for (long long dy = -1; dy <= 1; dy++)
+        {
+            for (long long dx = -1; dx <= 1; dx++)
+            {
+                long long neighbour[3] = { cell[0] + dx, cell[1] + dy, cell[2] + dz };
+                size_t bucket = BucketOf(cells, neighbour);
+
+                bool seen = false;
+                for (size_t v = 0; v < num_visited && !seen; v++)
+                {
+                    seen = visited[v] == bucket;
+                }
+
+                if (seen)
+                {
+                    continue;
+                }
+
+                visited[num_visited++] = bucket;
+
+                for (size_t j = cells->bucket_starts[bucket]; j < cells->bucket_starts[bucket + 1]; j++)
+                {
+                    double delta_x = cells->sorted_x[j] - x;
+                    double delta_y = cells->sorted_y[j] - y;
+                    double delta_z = cells->sorted_z[j] - z;
+                    double r2 = delta_x * delta_x + delta_y * delta_y + delta_z * delta_z;
+
+                    if (r2 >= cutoff2 || r2 + softening2 == 0)
+                    {
+                        continue;
+                    }
+
+                    double distance2 = r2 + softening2;
+                    double force = cells->sorted_w[j] / (distance2 * sqrt(distance2));
+                    sum_x += force * delta_x;
+                    sum_y += force * delta_y;
+                    sum_z += force * delta_z;
+                }
+            }
+        }
+    }
+
+    *ax = gravity->g * sum_x;
+    *ay = gravity->g * sum_y;
+    *az = gravity->g * sum_z;
+}
+
+static void CellOf(cell_list_t *cells, double x, double y, double z, long long cell[3])
+{
+    cell[0] = (long long)floor(x / cells->cutoff);
+    cell[1] = (long long)floor(y / cells->cutoff);
+    cell[2] = (long long)floor(z / cells->cutoff);
+}
+
+static size_t BucketOf(cell_list_t *cells, const long long cell[3])
+{
+    unsigned long long hash = (unsigned long long)cell[0] * 73856093ULL
+                            ^ (unsigned long long)cell[1] * 19349663ULL
+                            ^ (unsigned long long)cell[2] * 83492791ULL;
+
+    // Fold the high bits in, the table mask keeps only the low ones.
+    hash ^= hash >> 29;
+    return (size_t)(hash & (cells->num_buckets - 1));
+}
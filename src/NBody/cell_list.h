@@ -0,0 +1,41 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "barrier.h"
+
+#define CELL_LIST_BUCKETS_PER_BODY 2 // hash table size relative to the body count
+
+// Spatial hash of cells one cutoff wide, rebuilt every step. Cells are
+// unbounded, so escaping bodies do not coarsen the grid; distinct cells
+// sharing a bucket only add candidates that fail the cutoff test. A parallel
+// counting sort groups the bodies by bucket and copies their positions and
+// masses into bucket order, so every bucket is contiguous in memory.
+typedef struct cell_list_t
+{
+    size_t num_bodies;
+    size_t num_threads;
+    size_t dims;
+    double cutoff;
+    size_t num_buckets;     // power of two
+    size_t *bucket_of_body;
+    size_t *bucket_counts;  // [thread][bucket]
+    size_t *bucket_offsets; // [thread][bucket]
+    size_t *bucket_starts;  // [bucket], first sorted body of every bucket
+    double *sorted_x, *sorted_y, *sorted_z, *sorted_w;
+    spin_barrier_t *barrier; // shared with the simulation threads
+} cell_list_t;
+
+cell_list_t * CreateCellList(size_t num_bodies, size_t num_threads, size_t dims, double cutoff,
+                             spin_barrier_t *barrier);
+void DestroyCellList(cell_list_t *cells);
+
+// Collective: every thread calls it with its own [start, end) body range.
+void BuildCellList(cell_list_t *cells, body_store_t *bodies, size_t tid, size_t start, size_t end);
+
+// Field at body i from the bodies closer than the cutoff.
+void CellListAcceleration(cell_list_t *cells, body_store_t *bodies, size_t i, const gravity_t *gravity,
+                          double *ax, double *ay, double *az);
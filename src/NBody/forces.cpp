@@ -0,0 +1,569 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "typedefs.h"
+#include "forces.h"
+
+static void DirectAccelerationsDouble(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                      double softening2, double *ax, double *ay, double *az);
+static void DirectAccelerationsFloat(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                     double softening2, double *ax, double *ay, double *az);
+static void TilePair(body_store_t *bodies, size_t i_first, size_t i_last, size_t j_first, size_t j_last,
+                     double softening2, double *sum_x, double *sum_y, double *sum_z);
+static void ScaledAccelerations(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                const gravity_t *gravity, precision_t precision, double *ax, double *ay, double *az);
+
+void DirectAccelerations(body_store_t *bodies, size_t start, size_t end, const gravity_t *gravity,
+                         precision_t precision, double *ax, double *ay, double *az)
+{
+    ScaledAccelerations(bodies, NULL, start, end, gravity, precision, ax, ay, az);
+}
+
+void DirectAccelerationsOf(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                           const gravity_t *gravity, precision_t precision, double *ax, double *ay, double *az)
+{
+    ScaledAccelerations(bodies, indices, start, end, gravity, precision, ax, ay, az);
+}
+
+// Bodies indices[start, end), or [start, end) without indices.
+static void ScaledAccelerations(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                const gravity_t *gravity, precision_t precision, double *ax, double *ay, double *az)
+{
+    double softening2 = gravity->softening * gravity->softening;
+
+    if (precision == PRECISION_FLOAT)
+    {
+        DirectAccelerationsFloat(bodies, indices, start, end, softening2, ax, ay, az);
+    }
+    else
+    {
+        DirectAccelerationsDouble(bodies, indices, start, end, softening2, ax, ay, az);
+    }
+
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        ax[i] *= gravity->g;
+        ay[i] *= gravity->g;
+        az[i] *= gravity->g;
+    }
+}
+
+tiled_forces_t * CreateTiledForces(size_t capacity, size_t num_threads, spin_barrier_t *barrier)
+{
+    tiled_forces_t *forces = (tiled_forces_t *)calloc(1, sizeof(tiled_forces_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(forces, "forces");
+
+    forces->num_threads = num_threads;
+    forces->capacity = capacity;
+    forces->sum_x = (double *)aligned_alloc(BODY_ALIGNMENT, num_threads * capacity * sizeof(double));
+    forces->sum_y = (double *)aligned_alloc(BODY_ALIGNMENT, num_threads * capacity * sizeof(double));
+    forces->sum_z = (double *)aligned_alloc(BODY_ALIGNMENT, num_threads * capacity * sizeof(double));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(forces->sum_x, "forces->sum_x");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(forces->sum_y, "forces->sum_y");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(forces->sum_z, "forces->sum_z");
+
+    forces->barrier = barrier;
+
+    return forces;
+}
+
+void DestroyTiledForces(tiled_forces_t *forces)
+{
+    if (forces == NULL)
+    {
+        return;
+    }
+
+    free(forces->sum_x);
+    free(forces->sum_y);
+    free(forces->sum_z);
+    free(forces);
+}
+
+void TiledAccelerations(tiled_forces_t *forces, body_store_t *bodies, size_t tid, size_t start, size_t end,
+                        const gravity_t *gravity, double *ax, double *ay, double *az)
+{
+    size_t capacity = forces->capacity;
+    double softening2 = gravity->softening * gravity->softening;
+    double *sum_x = forces->sum_x + tid * capacity;
+    double *sum_y = forces->sum_y + tid * capacity;
+    double *sum_z = forces->sum_z + tid * capacity;
+
+    memset(sum_x, 0, capacity * sizeof(double));
+    memset(sum_y, 0, capacity * sizeof(double));
+    memset(sum_z, 0, capacity * sizeof(double));
+
+    size_t tiles = (capacity + FORCE_TILE - 1) / FORCE_TILE;
+    size_t pair = 0;
+    for (size_t tile_i = 0; tile_i < tiles; tile_i++)
+    {
+        size_t i_first = tile_i * FORCE_TILE;
+        size_t i_last = i_first + FORCE_TILE < bodies->count ? i_first + FORCE_TILE : bodies->count;
+
+        for (size_t tile_j = tile_i; tile_j < tiles; tile_j++, pair++)
+        {
+            if (pair % forces->num_threads != tid || i_first >= i_last)
+            {
+                continue;
+            }
+
+            size_t j_first = tile_j * FORCE_TILE;
+            size_t j_last = j_first + FORCE_TILE < capacity ? j_first + FORCE_TILE : capacity;
+            TilePair(bodies, i_first, i_last, j_first, j_last, softening2, sum_x, sum_y, sum_z);
+        }
+    }
+
+    SpinBarrierWait(forces->barrier);
+
+    for (size_t i = start; i < end; i++)
+    {
+        double total_x = 0, total_y = 0, total_z = 0;
+        for (size_t t = 0; t < forces->num_threads; t++)
+        {
+            total_x += forces->sum_x[t * capacity + i];
+            total_y += forces->sum_y[t * capacity + i];
+            total_z += forces->sum_z[t * capacity + i];
+        }
+
+        ax[i] = gravity->g * total_x;
+        ay[i] = gravity->g * total_y;
+        az[i] = gravity->g * total_z;
+    }
+}
+
+// The kernels leave out the gravity constant. Every kernel computes
+// 1 / (r^2 + e^2)^1.5 as rsqrt(r^2 + e^2)^3. The hardware estimate is
+// refined by Newton steps y' = y * (1.5 - 0.5 * d * y^2), each of which
+// doubles the number of correct bits. Without softening the pairs at zero
+// distance (the body itself, coincident bodies and the zero mass padding)
+// are masked out; with it their delta is zero anyway. TilePair adds the
+// field of tile J to the bodies of tile I and the opposite field to the
+// bodies of J; on a diagonal tile only the pairs with j > i are taken.
+
+#if defined(__AVX512F__)
+
+static void DirectAccelerationsDouble(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                      double softening2, double *ax, double *ay, double *az)
+{
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d epsilon2 = _mm512_set1_pd(softening2);
+
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        __m512d xi = _mm512_set1_pd(bodies->x[i]);
+        __m512d yi = _mm512_set1_pd(bodies->y[i]);
+        __m512d zi = _mm512_set1_pd(bodies->z[i]);
+        __m512d sum_x = zero, sum_y = zero, sum_z = zero;
+
+        for (size_t j = 0; j < bodies->capacity; j += 8)
+        {
+            __m512d delta_x = _mm512_sub_pd(_mm512_load_pd(bodies->x + j), xi);
+            __m512d delta_y = _mm512_sub_pd(_mm512_load_pd(bodies->y + j), yi);
+            __m512d delta_z = _mm512_sub_pd(_mm512_load_pd(bodies->z + j), zi);
+            __m512d distance2 = _mm512_fmadd_pd(delta_x, delta_x, epsilon2);
+            distance2 = _mm512_fmadd_pd(delta_y, delta_y, distance2);
+            distance2 = _mm512_fmadd_pd(delta_z, delta_z, distance2);
+            __mmask8 valid = _mm512_cmp_pd_mask(distance2, zero, _CMP_GT_OQ);
+
+            // 14 bit estimate, two steps reach full double precision.
+            __m512d inv = _mm512_rsqrt14_pd(distance2);
+            __m512d half_distance2 = _mm512_mul_pd(half, distance2);
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(half_distance2, _mm512_mul_pd(inv, inv), three_halves));
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(half_distance2, _mm512_mul_pd(inv, inv), three_halves));
+
+            __m512d inv3 = _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv));
+            __m512d force = _mm512_maskz_mul_pd(valid, _mm512_load_pd(bodies->w + j), inv3);
+            sum_x = _mm512_fmadd_pd(force, delta_x, sum_x);
+            sum_y = _mm512_fmadd_pd(force, delta_y, sum_y);
+            sum_z = _mm512_fmadd_pd(force, delta_z, sum_z);
+        }
+
+        ax[i] = _mm512_reduce_add_pd(sum_x);
+        ay[i] = _mm512_reduce_add_pd(sum_y);
+        az[i] = _mm512_reduce_add_pd(sum_z);
+    }
+}
+
+static void DirectAccelerationsFloat(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                     double softening2, double *ax, double *ay, double *az)
+{
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 three_halves = _mm512_set1_ps(1.5f);
+    const __m512 epsilon2 = _mm512_set1_ps((float)softening2);
+
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        __m512 xi = _mm512_set1_ps(bodies->xf[i]);
+        __m512 yi = _mm512_set1_ps(bodies->yf[i]);
+        __m512 zi = _mm512_set1_ps(bodies->zf[i]);
+        __m512 sum_x = zero, sum_y = zero, sum_z = zero;
+
+        for (size_t j = 0; j < bodies->capacity; j += 16)
+        {
+            __m512 delta_x = _mm512_sub_ps(_mm512_load_ps(bodies->xf + j), xi);
+            __m512 delta_y = _mm512_sub_ps(_mm512_load_ps(bodies->yf + j), yi);
+            __m512 delta_z = _mm512_sub_ps(_mm512_load_ps(bodies->zf + j), zi);
+            __m512 distance2 = _mm512_fmadd_ps(delta_x, delta_x, epsilon2);
+            distance2 = _mm512_fmadd_ps(delta_y, delta_y, distance2);
+            distance2 = _mm512_fmadd_ps(delta_z, delta_z, distance2);
+            __mmask16 valid = _mm512_cmp_ps_mask(distance2, zero, _CMP_GT_OQ);
+
+            // 14 bit estimate, one step reaches full single precision.
+            __m512 inv = _mm512_rsqrt14_ps(distance2);
+            __m512 half_distance2 = _mm512_mul_ps(half, distance2);
+            inv = _mm512_mul_ps(inv, _mm512_fnmadd_ps(half_distance2, _mm512_mul_ps(inv, inv), three_halves));
+
+            __m512 inv3 = _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv));
+            __m512 force = _mm512_maskz_mul_ps(valid, _mm512_load_ps(bodies->wf + j), inv3);
+            sum_x = _mm512_fmadd_ps(force, delta_x, sum_x);
+            sum_y = _mm512_fmadd_ps(force, delta_y, sum_y);
+            sum_z = _mm512_fmadd_ps(force, delta_z, sum_z);
+        }
+
+        ax[i] = _mm512_reduce_add_ps(sum_x);
+        ay[i] = _mm512_reduce_add_ps(sum_y);
+        az[i] = _mm512_reduce_add_ps(sum_z);
+    }
+}
+
+static void TilePair(body_store_t *bodies, size_t i_first, size_t i_last, size_t j_first, size_t j_last,
+                     double softening2, double *sum_x, double *sum_y, double *sum_z)
+{
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d epsilon2 = _mm512_set1_pd(softening2);
+    const __m512d lanes = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+    bool diagonal = i_first == j_first;
+
+    for (size_t i = i_first; i < i_last; i++)
+    {
+        __m512d xi = _mm512_set1_pd(bodies->x[i]);
+        __m512d yi = _mm512_set1_pd(bodies->y[i]);
+        __m512d zi = _mm512_set1_pd(bodies->z[i]);
+        __m512d wi = _mm512_set1_pd(bodies->w[i]);
+        __m512d index_i = _mm512_set1_pd((double)i);
+        __m512d acc_x = zero, acc_y = zero, acc_z = zero;
+
+        for (size_t j = diagonal ? (i + 1) / 8 * 8 : j_first; j < j_last; j += 8)
+        {
+            __m512d delta_x = _mm512_sub_pd(_mm512_load_pd(bodies->x + j), xi);
+            __m512d delta_y = _mm512_sub_pd(_mm512_load_pd(bodies->y + j), yi);
+            __m512d delta_z = _mm512_sub_pd(_mm512_load_pd(bodies->z + j), zi);
+            __m512d distance2 = _mm512_fmadd_pd(delta_x, delta_x, epsilon2);
+            distance2 = _mm512_fmadd_pd(delta_y, delta_y, distance2);
+            distance2 = _mm512_fmadd_pd(delta_z, delta_z, distance2);
+            __mmask8 valid = _mm512_cmp_pd_mask(distance2, zero, _CMP_GT_OQ);
+            if (diagonal)
+            {
+                __m512d index_j = _mm512_add_pd(_mm512_set1_pd((double)j), lanes);
+                valid &= _mm512_cmp_pd_mask(index_j, index_i, _CMP_GT_OQ);
+            }
+
+            __m512d inv = _mm512_rsqrt14_pd(distance2);
+            __m512d half_distance2 = _mm512_mul_pd(half, distance2);
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(half_distance2, _mm512_mul_pd(inv, inv), three_halves));
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(half_distance2, _mm512_mul_pd(inv, inv), three_halves));
+
+            __m512d inv3 = _mm512_maskz_mul_pd(valid, inv, _mm512_mul_pd(inv, inv));
+            __m512d force_i = _mm512_mul_pd(_mm512_load_pd(bodies->w + j), inv3);
+            __m512d force_j = _mm512_mul_pd(wi, inv3);
+            acc_x = _mm512_fmadd_pd(force_i, delta_x, acc_x);
+            acc_y = _mm512_fmadd_pd(force_i, delta_y, acc_y);
+            acc_z = _mm512_fmadd_pd(force_i, delta_z, acc_z);
+            _mm512_store_pd(sum_x + j, _mm512_fnmadd_pd(force_j, delta_x, _mm512_load_pd(sum_x + j)));
+            _mm512_store_pd(sum_y + j, _mm512_fnmadd_pd(force_j, delta_y, _mm512_load_pd(sum_y + j)));
+            _mm512_store_pd(sum_z + j, _mm512_fnmadd_pd(force_j, delta_z, _mm512_load_pd(sum_z + j)));
+        }
+
+        sum_x[i] += _mm512_reduce_add_pd(acc_x);
+        sum_y[i] += _mm512_reduce_add_pd(acc_y);
+        sum_z[i] += _mm512_reduce_add_pd(acc_z);
+    }
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+static double HorizontalSum(__m256d v)
+{
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+static float HorizontalSum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    return _mm_cvtss_f32(_mm_add_ss(sum, _mm_movehdup_ps(sum)));
+}
+
+static void DirectAccelerationsDouble(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                      double softening2, double *ax, double *ay, double *az)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    const __m256d epsilon2 = _mm256_set1_pd(softening2);
+
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        __m256d xi = _mm256_set1_pd(bodies->x[i]);
+        __m256d yi = _mm256_set1_pd(bodies->y[i]);
+        __m256d zi = _mm256_set1_pd(bodies->z[i]);
+        __m256d sum_x = zero, sum_y = zero, sum_z = zero;
+
+        for (size_t j = 0; j < bodies->capacity; j += 4)
+        {
+            __m256d delta_x = _mm256_sub_pd(_mm256_load_pd(bodies->x + j), xi);
+            __m256d delta_y = _mm256_sub_pd(_mm256_load_pd(bodies->y + j), yi);
+            __m256d delta_z = _mm256_sub_pd(_mm256_load_pd(bodies->z + j), zi);
+            __m256d distance2 = _mm256_fmadd_pd(delta_x, delta_x, epsilon2);
+            distance2 = _mm256_fmadd_pd(delta_y, delta_y, distance2);
+            distance2 = _mm256_fmadd_pd(delta_z, delta_z, distance2);
+            __m256d valid = _mm256_cmp_pd(distance2, zero, _CMP_GT_OQ);
+
+            // AVX2 has no double rsqrt: 12 bit single precision estimate,
+            // three steps reach full double precision.
+            __m256d inv = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(distance2)));
+            __m256d half_distance2 = _mm256_mul_pd(half, distance2);
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(half_distance2, _mm256_mul_pd(inv, inv), three_halves));
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(half_distance2, _mm256_mul_pd(inv, inv), three_halves));
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(half_distance2, _mm256_mul_pd(inv, inv), three_halves));
+
+            __m256d inv3 = _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv));
+            __m256d force = _mm256_and_pd(valid, _mm256_mul_pd(_mm256_load_pd(bodies->w + j), inv3));
+            sum_x = _mm256_fmadd_pd(force, delta_x, sum_x);
+            sum_y = _mm256_fmadd_pd(force, delta_y, sum_y);
+            sum_z = _mm256_fmadd_pd(force, delta_z, sum_z);
+        }
+
+        ax[i] = HorizontalSum(sum_x);
+        ay[i] = HorizontalSum(sum_y);
+        az[i] = HorizontalSum(sum_z);
+    }
+}
+
+static void DirectAccelerationsFloat(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                     double softening2, double *ax, double *ay, double *az)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 three_halves = _mm256_set1_ps(1.5f);
+    const __m256 epsilon2 = _mm256_set1_ps((float)softening2);
+
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        __m256 xi = _mm256_set1_ps(bodies->xf[i]);
+        __m256 yi = _mm256_set1_ps(bodies->yf[i]);
+        __m256 zi = _mm256_set1_ps(bodies->zf[i]);
+        __m256 sum_x = zero, sum_y = zero, sum_z = zero;
+
+        for (size_t j = 0; j < bodies->capacity; j += 8)
+        {
+            __m256 delta_x = _mm256_sub_ps(_mm256_load_ps(bodies->xf + j), xi);
+            __m256 delta_y = _mm256_sub_ps(_mm256_load_ps(bodies->yf + j), yi);
+            __m256 delta_z = _mm256_sub_ps(_mm256_load_ps(bodies->zf + j), zi);
+            __m256 distance2 = _mm256_fmadd_ps(delta_x, delta_x, epsilon2);
+            distance2 = _mm256_fmadd_ps(delta_y, delta_y, distance2);
+            distance2 = _mm256_fmadd_ps(delta_z, delta_z, distance2);
+            __m256 valid = _mm256_cmp_ps(distance2, zero, _CMP_GT_OQ);
+
+            // 12 bit estimate, one step is enough for single precision.
+            __m256 inv = _mm256_rsqrt_ps(distance2);
+            __m256 half_distance2 = _mm256_mul_ps(half, distance2);
+            inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(half_distance2, _mm256_mul_ps(inv, inv), three_halves));
+
+            __m256 inv3 = _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv));
+            __m256 force = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_load_ps(bodies->wf + j), inv3));
+            sum_x = _mm256_fmadd_ps(force, delta_x, sum_x);
+            sum_y = _mm256_fmadd_ps(force, delta_y, sum_y);
+            sum_z = _mm256_fmadd_ps(force, delta_z, sum_z);
+        }
+
+        ax[i] = HorizontalSum(sum_x);
+        ay[i] = HorizontalSum(sum_y);
+        az[i] = HorizontalSum(sum_z);
+    }
+}
+
+static void TilePair(body_store_t *bodies, size_t i_first, size_t i_last, size_t j_first, size_t j_last,
+                     double softening2, double *sum_x, double *sum_y, double *sum_z)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    const __m256d epsilon2 = _mm256_set1_pd(softening2);
+    const __m256d lanes = _mm256_set_pd(3, 2, 1, 0);
+    bool diagonal = i_first == j_first;
+
+    for (size_t i = i_first; i < i_last; i++)
+    {
+        __m256d xi = _mm256_set1_pd(bodies->x[i]);
+        __m256d yi = _mm256_set1_pd(bodies->y[i]);
+        __m256d zi = _mm256_set1_pd(bodies->z[i]);
+        __m256d wi = _mm256_set1_pd(bodies->w[i]);
+        __m256d index_i = _mm256_set1_pd((double)i);
+        __m256d acc_x = zero, acc_y = zero, acc_z = zero;
+
+        for (size_t j = diagonal ? (i + 1) / 4 * 4 : j_first; j < j_last; j += 4)
+        {
+            __m256d delta_x = _mm256_sub_pd(_mm256_load_pd(bodies->x + j), xi);
+            __m256d delta_y = _mm256_sub_pd(_mm256_load_pd(bodies->y + j), yi);
+            __m256d delta_z = _mm256_sub_pd(_mm256_load_pd(bodies->z + j), zi);
+            __m256d distance2 = _mm256_fmadd_pd(delta_x, delta_x, epsilon2);
+            distance2 = _mm256_fmadd_pd(delta_y, delta_y, distance2);
+            distance2 = _mm256_fmadd_pd(delta_z, delta_z, distance2);
+            __m256d valid = _mm256_cmp_pd(distance2, zero, _CMP_GT_OQ);
+            if (diagonal)
+            {
+                __m256d index_j = _mm256_add_pd(_mm256_set1_pd((double)j), lanes);
+                valid = _mm256_and_pd(valid, _mm256_cmp_pd(index_j, index_i, _CMP_GT_OQ));
+            }
+
+            __m256d inv = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(distance2)));
+            __m256d half_distance2 = _mm256_mul_pd(half, distance2);
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(half_distance2, _mm256_mul_pd(inv, inv), three_halves));
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(half_distance2, _mm256_mul_pd(inv, inv), three_halves));
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(half_distance2, _mm256_mul_pd(inv, inv), three_halves));
+
+            __m256d inv3 = _mm256_and_pd(valid, _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+            __m256d force_i = _mm256_mul_pd(_mm256_load_pd(bodies->w + j), inv3);
+            __m256d force_j = _mm256_mul_pd(wi, inv3);
+            acc_x = _mm256_fmadd_pd(force_i, delta_x, acc_x);
+            acc_y = _mm256_fmadd_pd(force_i, delta_y, acc_y);
+            acc_z = _mm256_fmadd_pd(force_i, delta_z, acc_z);
+            _mm256_store_pd(sum_x + j, _mm256_fnmadd_pd(force_j, delta_x, _mm256_load_pd(sum_x + j)));
+            _mm256_store_pd(sum_y + j, _mm256_fnmadd_pd(force_j, delta_y, _mm256_load_pd(sum_y + j)));
+            _mm256_store_pd(sum_z + j, _mm256_fnmadd_pd(force_j, delta_z, _mm256_load_pd(sum_z + j)));
+        }
+
+        sum_x[i] += HorizontalSum(acc_x);
+        sum_y[i] += HorizontalSum(acc_y);
+        sum_z[i] += HorizontalSum(acc_z);
+    }
+}
+
+#else
+
+static void DirectAccelerationsDouble(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                      double softening2, double *ax, double *ay, double *az)
+{
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        double sum_x = 0, sum_y = 0, sum_z = 0;
+
+        for (size_t j = 0; j < bodies->count; j++)
+        {
+            double delta_x = bodies->x[j] - bodies->x[i];
+            double delta_y = bodies->y[j] - bodies->y[i];
+            double delta_z = bodies->z[j] - bodies->z[i];
+            double distance2 = delta_x * delta_x + delta_y * delta_y + delta_z * delta_z + softening2;
+
+            if (distance2 == 0)
+            {
+                continue;
+            }
+
+            double inv = 1 / sqrt(distance2);
+            double force = bodies->w[j] * inv * inv * inv;
+            sum_x += force * delta_x;
+            sum_y += force * delta_y;
+            sum_z += force * delta_z;
+        }
+
+        ax[i] = sum_x;
+        ay[i] = sum_y;
+        az[i] = sum_z;
+    }
+}
+
+static void DirectAccelerationsFloat(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                                     double softening2, double *ax, double *ay, double *az)
+{
+    float epsilon2 = (float)softening2;
+
+    for (size_t k = start; k < end; k++)
+    {
+        size_t i = indices != NULL ? indices[k] : k;
+        float sum_x = 0, sum_y = 0, sum_z = 0;
+
+        for (size_t j = 0; j < bodies->count; j++)
+        {
+            float delta_x = bodies->xf[j] - bodies->xf[i];
+            float delta_y = bodies->yf[j] - bodies->yf[i];
+            float delta_z = bodies->zf[j] - bodies->zf[i];
+            float distance2 = delta_x * delta_x + delta_y * delta_y + delta_z * delta_z + epsilon2;
+
+            if (distance2 == 0)
+            {
+                continue;
+            }
+
+            float inv = 1 / sqrtf(distance2);
+            float force = bodies->wf[j] * inv * inv * inv;
+            sum_x += force * delta_x;
+            sum_y += force * delta_y;
+            sum_z += force * delta_z;
+        }
+
+        ax[i] = sum_x;
+        ay[i] = sum_y;
+        az[i] = sum_z;
+    }
+}
+
+static void TilePair(body_store_t *bodies, size_t i_first, size_t i_last, size_t j_first, size_t j_last,
+                     double softening2, double *sum_x, double *sum_y, double *sum_z)
+{
+    bool diagonal = i_first == j_first;
+
+    for (size_t i = i_first; i < i_last; i++)
+    {
+        double acc_x = 0, acc_y = 0, acc_z = 0;
+
+        for (size_t j = diagonal ? i + 1 : j_first; j < j_last; j++)
+        {
+            double delta_x = bodies->x[j] - bodies->x[i];
+            double delta_y = bodies->y[j] - bodies->y[i];
+            double delta_z = bodies->z[j] - bodies->z[i];
+            double distance2 = delta_x * delta_x + delta_y * delta_y + delta_z * delta_z + softening2;
+
+            if (distance2 == 0)
+            {
+                continue;
+            }
+
+            double inv = 1 / sqrt(distance2);
+            double inv3 = inv * inv * inv;
+            acc_x += bodies->w[j] * inv3 * delta_x;
+            acc_y += bodies->w[j] * inv3 * delta_y;
+            acc_z += bodies->w[j] * inv3 * delta_z;
+            sum_x[j] -= bodies->w[i] * inv3 * delta_x;
+            sum_y[j] -= bodies->w[i] * inv3 * delta_y;
+            sum_z[j] -= bodies->w[i] * inv3 * delta_z;
+        }
+
+        sum_x[i] += acc_x;
+        sum_y[i] += acc_y;
+        sum_z[i] += acc_z;
+    }
+}
+
+#endif
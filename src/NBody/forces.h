@@ -0,0 +1,41 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#include "typedefs.h"
+#include "barrier.h"
+
+#define FORCE_TILE 256 // bodies per tile, a pair of tiles stays in L1/L2
+
+// Field at bodies [start, end) from every body. Uses AVX-512 or AVX2 with
+// FMA when the compiler targets them (e.g. -march=native) and a scalar loop
+// otherwise. The float kernel reads the single precision copy kept by
+// SyncFloatBodies.
+void DirectAccelerations(body_store_t *bodies, size_t start, size_t end, const gravity_t *gravity,
+                         precision_t precision, double *ax, double *ay, double *az);
+
+// Same for the bodies indices[start, end), e.g. those due for a new force.
+void DirectAccelerationsOf(body_store_t *bodies, const size_t *indices, size_t start, size_t end,
+                           const gravity_t *gravity, precision_t precision, double *ax, double *ay, double *az);
+
+// Per-thread accumulators of the tiled kernel.
+typedef struct tiled_forces_t
+{
+    size_t num_threads;
+    size_t capacity;
+    double *sum_x, *sum_y, *sum_z; // [thread][body]
+    spin_barrier_t *barrier; // shared with the simulation threads
+} tiled_forces_t;
+
+tiled_forces_t * CreateTiledForces(size_t capacity, size_t num_threads, spin_barrier_t *barrier);
+void DestroyTiledForces(tiled_forces_t *forces);
+
+// Collective double precision version of DirectAccelerations. The threads
+// share out the pairs of tiles (I, J) with I <= J and compute every pair of
+// bodies once, adding the force to one body and subtracting it from the
+// other in their own accumulators. After a barrier each thread sums the
+// accumulators of its [start, end) range.
+void TiledAccelerations(tiled_forces_t *forces, body_store_t *bodies, size_t tid, size_t start, size_t end,
+                        const gravity_t *gravity, double *ax, double *ay, double *az);
@@ -0,0 +1,177 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "typedefs.h"
+#include "initial_conditions.h"
+
+#define PLUMMER_CUTOFF 10 // Plummer radii, farther bodies are drawn again
+
+static void GenerateUniform(body_store_t *bodies, const init_params_t *params);
+static void GeneratePlummer(body_store_t *bodies, const init_params_t *params, const gravity_t *gravity);
+static void GenerateDisk(body_store_t *bodies, const init_params_t *params, const gravity_t *gravity);
+static void RemoveDrift(body_store_t *bodies);
+
+static inline double Uniform()
+{
+    return (double)rand() / ((double)RAND_MAX + 1);
+}
+
+static void RandomDirection(size_t dims, double *x, double *y, double *z)
+{
+    double phi = 2 * M_PI * Uniform();
+    double cos_theta = dims == 3 ? 2 * Uniform() - 1 : 0;
+    double sin_theta = sqrt(1 - cos_theta * cos_theta);
+
+    *x = sin_theta * cos(phi);
+    *y = sin_theta * sin(phi);
+    *z = cos_theta;
+}
+
+void GenerateBodies(body_store_t *bodies, const init_params_t *params, const gravity_t *gravity)
+{
+    srand(params->seed);
+
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        bodies->w[i] = params->min_mass + (params->max_mass - params->min_mass) * Uniform();
+    }
+
+    if (params->distribution == DISTRIBUTION_PLUMMER)
+    {
+        GeneratePlummer(bodies, params, gravity);
+    }
+    else if (params->distribution == DISTRIBUTION_DISK)
+    {
+        GenerateDisk(bodies, params, gravity);
+    }
+    else
+    {
+        GenerateUniform(bodies, params);
+    }
+}
+
+static void GenerateUniform(body_store_t *bodies, const init_params_t *params)
+{
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        bodies->x[i] = params->size * Uniform();
+        bodies->y[i] = params->size * Uniform();
+        bodies->vx[i] = params->max_speed * (Uniform() - 0.5);
+        bodies->vy[i] = params->max_speed * (Uniform() - 0.5);
+
+        if (params->dims == 3)
+        {
+            bodies->z[i] = params->size * Uniform();
+            bodies->vz[i] = params->max_speed * (Uniform() - 0.5);
+        }
+    }
+}
+
+// Aarseth, Henon and Wielen (1974): radii from the inverted cumulative mass
+// profile, speeds by rejection from the isotropic distribution function. The
+// scale radius is a tenth of the box side.
+static void GeneratePlummer(body_store_t *bodies, const init_params_t *params, const gravity_t *gravity)
+{
+    double total_mass = 0;
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        total_mass += bodies->w[i];
+    }
+
+    double scale = params->size / 10;
+    double center = params->size / 2;
+
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        double radius;
+        do
+        {
+            double mass_fraction = Uniform();
+            radius = mass_fraction > 0 ? scale / sqrt(pow(mass_fraction, -2.0 / 3) - 1) : 0;
+        } while (radius > PLUMMER_CUTOFF * scale);
+
+        double q, y;
+        do
+        {
+            q = Uniform();
+            y = 0.1 * Uniform();
+        } while (y > q * q * pow(1 - q * q, 3.5));
+
+        double escape = sqrt(2 * gravity->g * total_mass / sqrt(radius * radius + scale * scale));
+        double dx, dy, dz;
+
+        RandomDirection(3, &dx, &dy, &dz);
+        bodies->x[i] = center + radius * dx;
+        bodies->y[i] = center + radius * dy;
+        bodies->z[i] = params->dims == 3 ? center + radius * dz : 0;
+
+        RandomDirection(3, &dx, &dy, &dz);
+        bodies->vx[i] = q * escape * dx;
+        bodies->vy[i] = q * escape * dy;
+        bodies->vz[i] = params->dims == 3 ? q * escape * dz : 0;
+    }
+
+    RemoveDrift(bodies);
+}
+
+// Uniform density disk in the xy plane turning counterclockwise. The speed
+// balances the pull of the mass inside the orbit taken as a point mass.
+static void GenerateDisk(body_store_t *bodies, const init_params_t *params, const gravity_t *gravity)
+{
+    double total_mass = 0;
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        total_mass += bodies->w[i];
+    }
+
+    double disk_radius = params->size / 2;
+    double center = params->size / 2;
+    double softening2 = gravity->softening * gravity->softening;
+
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        double radius = disk_radius * sqrt(Uniform());
+        double angle = 2 * M_PI * Uniform();
+        double inner_mass = total_mass * radius * radius / (disk_radius * disk_radius);
+        double distance2 = radius * radius + softening2;
+        double speed = distance2 > 0 ? radius * sqrt(gravity->g * inner_mass / (distance2 * sqrt(distance2))) : 0;
+
+        bodies->x[i] = center + radius * cos(angle);
+        bodies->y[i] = center + radius * sin(angle);
+        bodies->z[i] = params->dims == 3 ? center : 0;
+        bodies->vx[i] = -speed * sin(angle);
+        bodies->vy[i] = speed * cos(angle);
+        bodies->vz[i] = 0;
+    }
+
+    RemoveDrift(bodies);
+}
+
+// Moves to the center of mass frame so that the system stays in the box.
+static void RemoveDrift(body_store_t *bodies)
+{
+    double total_mass = 0, px = 0, py = 0, pz = 0;
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        total_mass += bodies->w[i];
+        px += bodies->w[i] * bodies->vx[i];
+        py += bodies->w[i] * bodies->vy[i];
+        pz += bodies->w[i] * bodies->vz[i];
+    }
+
+    if (total_mass == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < bodies->count; i++)
+    {
+        bodies->vx[i] -= px / total_mass;
+        bodies->vy[i] -= py / total_mass;
+        bodies->vz[i] -= pz / total_mass;
+    }
+}
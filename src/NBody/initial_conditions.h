@@ -0,0 +1,28 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#include "typedefs.h"
+
+typedef enum distribution_t
+{
+    DISTRIBUTION_UNIFORM, // random positions in a box, random velocities
+    DISTRIBUTION_PLUMMER, // Plummer sphere in equilibrium
+    DISTRIBUTION_DISK     // rotating disk on roughly circular orbits
+} distribution_t;
+
+typedef struct init_params_t
+{
+    distribution_t distribution;
+    size_t dims;
+    double size;      // box side; the sphere and the disk are centered in the box
+    double min_mass, max_mass;
+    double max_speed; // uniform only, velocity components in [-max_speed / 2, max_speed / 2)
+    unsigned int seed;
+} init_params_t;
+
+// Fills positions, velocities and masses. In two dimensions z and vz are
+// left at zero and the Plummer sphere is projected onto the plane.
+void GenerateBodies(body_store_t *bodies, const init_params_t *params, const gravity_t *gravity);
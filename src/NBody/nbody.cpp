@@ -7,36 +7,90 @@
 #include <math.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 #include "typedefs.h"
-
-#define RAND_SEED 46540
-
-#define MAX_X 1000
-#define MIN_X 0
-#define MAX_Y 1000 
-#define MIN_Y 0
-#define MAX_W 1000
-#define MIN_W 100
-#define MAX_V 50
-#define MIN_V 0
+#include "bodies.h"
+#include "forces.h"
+#include "barnes_hut.h"
+#include "cell_list.h"
+#include "barrier.h"
+#include "initial_conditions.h"
+#include "trajectory.h"
+
+#define DEFAULT_SEED 46540
+#define DEFAULT_SIZE 1000     // side of the box the bodies start in
+#define DEFAULT_MIN_MASS 100
+#define DEFAULT_MAX_MASS 1000
+#define DEFAULT_MAX_SPEED 50
+#define DEFAULT_G 6.67259     // gravity constant
 #define DELTA_T 1
+#define DEFAULT_THETA 0.5 // Barnes-Hut opening angle
+#define DEFAULT_CUTOFF 100 // interaction range of the cell list mode
+#define DEFAULT_OUTPUT_EVERY 10 // steps between trajectory snapshots
+#define DEFAULT_BLOCK_LEVELS 6 // block steps go down to dt / 2^levels
+#define MAX_BLOCK_LEVELS 30
+#define DEFAULT_ETA 0.025 // block step accuracy, dt_i = sqrt(2 eta softening / |a_i|)
+
+typedef enum force_mode_t
+{
+    FORCE_DIRECT,
+    FORCE_TILED,
+    FORCE_BARNES_HUT,
+    FORCE_CELL_LIST
+} force_mode_t;
 
-const double G = 6.67259; // Gravity constant
+typedef enum integrator_t
+{
+    INTEGRATOR_EULER,    // semi-implicit Euler
+    INTEGRATOR_LEAPFROG, // drift-kick-drift
+    INTEGRATOR_VERLET,   // velocity Verlet, kick-drift-kick
+    INTEGRATOR_RK4,
+    INTEGRATOR_BLOCK     // kick-drift-kick with per body power of two steps
+} integrator_t;
 
 size_t num_bodies, num_threads, iterations;
-Body *current_bodies;
-Body *new_bodies;
+body_store_t *body_buffers[2]; // step i reads buffer i % 2 and writes the other
+body_store_t *stage_bodies; // intermediate positions of leapfrog and RK4
+double *acc_x, *acc_y, *acc_z;
+force_mode_t mode = FORCE_DIRECT;
+integrator_t integrator = INTEGRATOR_LEAPFROG;
+double delta_t = DELTA_T;
+double theta = DEFAULT_THETA;
+double cutoff = DEFAULT_CUTOFF;
+precision_t precision = PRECISION_DOUBLE;
+gravity_t gravity = { DEFAULT_G, 0 };
+init_params_t init_params = { DISTRIBUTION_UNIFORM, 2, DEFAULT_SIZE, DEFAULT_MIN_MASS, DEFAULT_MAX_MASS,
+                              DEFAULT_MAX_SPEED, DEFAULT_SEED };
+const char *output_path = NULL;
+size_t output_every = DEFAULT_OUTPUT_EVERY;
+bool output_float = false;
+bh_tree_t *tree;
+tiled_forces_t *tiled_forces;
+cell_list_t *cell_list;
+trajectory_t *trajectory;
+size_t block_levels = DEFAULT_BLOCK_LEVELS;
+double eta = DEFAULT_ETA;
+unsigned int *body_levels;  // body i steps by delta_t / 2^body_levels[i]
+size_t *level_order;        // body indices, highest level first
+size_t *level_counts;       // [thread][level]
 
 // Synchronization variables
-pthread_mutex_t barrier_init_mutex;
-pthread_barrier_t calc_iter_barrier;
-bool calc_iter_barrier_initialized = false;
-pthread_barrier_t update_iter_barrier;
-bool update_iter_barrier_initialized = false;
+spin_barrier_t phase_barrier;
+unsigned int barrier_spin = DEFAULT_BARRIER_SPIN;
 
+void ParseOptions(int argc, char *argv[]);
 void * ThreadMain(void *args);
-void CalculateNewInfo(size_t start, size_t end);
-void UpdateNewInfo(size_t start, size_t end);
+void CalculateAccelerations(size_t tid, size_t start, size_t end, body_store_t *bodies);
+void CalculateActiveAccelerations(size_t tid, size_t start, size_t end, size_t first, size_t last,
+                                  body_store_t *bodies);
+void PositionsChanged(body_store_t *bodies, size_t start, size_t end);
+void EulerStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next);
+void LeapfrogStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next);
+void VerletStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next);
+void RungeKuttaStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next);
+void BlockStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next);
+unsigned int BlockLevel(size_t i, size_t substeps_done);
+void SortByLevel(size_t tid, size_t start, size_t end);
 
 int main(int argc, char *argv[])
 {
@@ -47,31 +101,88 @@ int main(int argc, char *argv[])
         fprintf(stderr, "Required arguments:\n \
                         num_bodies - number of bodies\n \
                         iterations - number of iterations\n \
-                        num_threads - number of worker threads.");
+                        num_threads - number of worker threads.\n \
+                        Optional name=value arguments:\n \
+                        mode - direct (default), tiled, barnes-hut or cells.\n \
+                        theta - Barnes-Hut opening angle (default 0.5).\n \
+                        cutoff - interaction range of the cells mode (default 100).\n \
+                        precision - double (default) or float for the direct mode.\n \
+                        integrator - leapfrog (default), verlet, rk4, euler or block.\n \
+                        dt - timestep (default 1).\n \
+                        levels - block step levels, the shortest step is dt / 2^levels (default 6).\n \
+                        eta - block step accuracy, needs softening (default 0.025).\n \
+                        spin - barrier polls before sleeping (default 2000, 0 with more threads than cores).\n \
+                        dims - 2 (default) or 3.\n \
+                        g - gravity constant (default 6.67259).\n \
+                        softening - Plummer softening length (default 0).\n \
+                        init - uniform (default), plummer or disk.\n \
+                        size - side of the starting box (default 1000).\n \
+                        min_mass, max_mass - mass range (default 100 and 1000).\n \
+                        max_speed - uniform velocity range (default 50).\n \
+                        seed - random seed (default 46540).\n \
+                        output - trajectory file, none by default.\n \
+                        output_every - steps between snapshots (default 10).\n \
+                        output_precision - double (default) or float.");
         return -1;
     }
 
     num_bodies = (size_t)atoi(argv[1]);
     iterations = (size_t)atoi(argv[2]);
     num_threads = (size_t)atoi(argv[3]);
+    ParseOptions(argc, argv);
 
-    current_bodies = (Body *)calloc(num_bodies, sizeof(Body));
-    new_bodies = (Body *)calloc(num_bodies, sizeof(Body));
+    InitSpinBarrier(&phase_barrier, (unsigned int)num_threads, barrier_spin);
 
-    srand(RAND_SEED);
+    if (mode == FORCE_BARNES_HUT)
+    {
+        tree = CreateBarnesHutTree(num_bodies, num_threads, init_params.dims, &phase_barrier);
+    }
 
-    for (int i = 0; i < num_bodies; i++)
+    if (mode == FORCE_CELL_LIST)
     {
-        current_bodies[i].x = rand() % (MAX_X - MIN_X) + MIN_X;
-        current_bodies[i].y = rand() % (MAX_Y - MIN_Y) + MIN_Y;
-        current_bodies[i].vx = rand() % (MAX_V - MIN_V) - (MAX_V + MIN_V) / 2;
-        current_bodies[i].vy = rand() % (MAX_V - MIN_V) - (MAX_V + MIN_V) / 2;
-        current_bodies[i].w = rand() % (MAX_W - MIN_W) + MIN_W;
+        cell_list = CreateCellList(num_bodies, num_threads, init_params.dims, cutoff, &phase_barrier);
     }
 
-    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+    body_buffers[0] = CreateBodyStore(num_bodies);
+    body_buffers[1] = CreateBodyStore(num_bodies);
+    stage_bodies = CreateBodyStore(num_bodies);
+    if (mode == FORCE_TILED)
+    {
+        tiled_forces = CreateTiledForces(body_buffers[0]->capacity, num_threads, &phase_barrier);
+    }
+
+    acc_x = (double *)malloc(num_bodies * sizeof(double));
+    acc_y = (double *)malloc(num_bodies * sizeof(double));
+    acc_z = (double *)malloc(num_bodies * sizeof(double));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(acc_x, "acc_x");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(acc_y, "acc_y");
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(acc_z, "acc_z");
 
-    pthread_mutex_init(&barrier_init_mutex, NULL);
+    if (integrator == INTEGRATOR_BLOCK)
+    {
+        body_levels = (unsigned int *)calloc(num_bodies, sizeof(unsigned int));
+        level_order = (size_t *)malloc(num_bodies * sizeof(size_t));
+        level_counts = (size_t *)calloc(num_threads * (MAX_BLOCK_LEVELS + 1), sizeof(size_t));
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(body_levels, "body_levels");
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(level_order, "level_order");
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(level_counts, "level_counts");
+    }
+
+    GenerateBodies(body_buffers[0], &init_params, &gravity);
+
+    // Masses never change, the other stores only need them once.
+    memcpy(body_buffers[1]->w, body_buffers[0]->w, num_bodies * sizeof(double));
+    memcpy(stage_bodies->w, body_buffers[0]->w, num_bodies * sizeof(double));
+    SyncFloatBodies(body_buffers[0], 0, num_bodies);
+    SyncFloatBodies(body_buffers[1], 0, num_bodies);
+    SyncFloatBodies(stage_bodies, 0, num_bodies);
+
+    if (output_path != NULL)
+    {
+        trajectory = CreateTrajectory(output_path, body_buffers[0], num_threads, init_params.dims, output_float);
+    }
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
 
     for (int i = 0; i < num_threads; i++)
     {
@@ -87,13 +198,170 @@ int main(int argc, char *argv[])
         pthread_join(*(threads+i), NULL);
     }
 
-    pthread_mutex_destroy(&barrier_init_mutex);
+    DestroyTrajectory(trajectory);
+    DestroyBarnesHutTree(tree);
+    DestroyTiledForces(tiled_forces);
+    DestroyCellList(cell_list);
+    DestroyBodyStore(body_buffers[0]);
+    DestroyBodyStore(body_buffers[1]);
+    DestroyBodyStore(stage_bodies);
+    free(acc_x);
+    free(acc_y);
+    free(acc_z);
+    free(body_levels);
+    free(level_order);
+    free(level_counts);
 
     printf("The end.\n");
 
     return 0;
 }
 
+static bool IsOption(const char *arg, size_t length, const char *name)
+{
+    return length == strlen(name) && strncmp(arg, name, length) == 0;
+}
+
+void ParseOptions(int argc, char *argv[])
+{
+    bool spin_given = false;
+
+    for (int i = 4; i < argc; i++)
+    {
+        char *value = strchr(argv[i], '=');
+        if (value == NULL)
+        {
+            fprintf(stderr, "Expected name=value, got: %s.\n", argv[i]);
+            exit(1);
+        }
+
+        size_t length = (size_t)(value - argv[i]);
+        value++;
+
+        if (IsOption(argv[i], length, "mode"))
+        {
+            mode = strcmp(value, "tiled") == 0 ? FORCE_TILED
+                 : strcmp(value, "barnes-hut") == 0 ? FORCE_BARNES_HUT
+                 : strcmp(value, "cells") == 0 ? FORCE_CELL_LIST : FORCE_DIRECT;
+        }
+        else if (IsOption(argv[i], length, "theta"))
+        {
+            theta = atof(value);
+        }
+        else if (IsOption(argv[i], length, "cutoff"))
+        {
+            cutoff = atof(value);
+            if (cutoff <= 0)
+            {
+                fprintf(stderr, "The cutoff must be positive.\n");
+                exit(1);
+            }
+        }
+        else if (IsOption(argv[i], length, "precision"))
+        {
+            precision = strcmp(value, "float") == 0 ? PRECISION_FLOAT : PRECISION_DOUBLE;
+        }
+        else if (IsOption(argv[i], length, "integrator"))
+        {
+            integrator = strcmp(value, "verlet") == 0 ? INTEGRATOR_VERLET
+                       : strcmp(value, "rk4") == 0 ? INTEGRATOR_RK4
+                       : strcmp(value, "euler") == 0 ? INTEGRATOR_EULER
+                       : strcmp(value, "block") == 0 ? INTEGRATOR_BLOCK : INTEGRATOR_LEAPFROG;
+        }
+        else if (IsOption(argv[i], length, "levels"))
+        {
+            block_levels = (size_t)atoi(value) < MAX_BLOCK_LEVELS ? (size_t)atoi(value) : MAX_BLOCK_LEVELS;
+        }
+        else if (IsOption(argv[i], length, "eta"))
+        {
+            eta = atof(value);
+        }
+        else if (IsOption(argv[i], length, "dt"))
+        {
+            delta_t = atof(value);
+        }
+        else if (IsOption(argv[i], length, "spin"))
+        {
+            barrier_spin = (unsigned int)atoi(value);
+            spin_given = true;
+        }
+        else if (IsOption(argv[i], length, "dims"))
+        {
+            init_params.dims = atoi(value) == 3 ? 3 : 2;
+        }
+        else if (IsOption(argv[i], length, "g"))
+        {
+            gravity.g = atof(value);
+        }
+        else if (IsOption(argv[i], length, "softening"))
+        {
+            gravity.softening = atof(value);
+        }
+        else if (IsOption(argv[i], length, "init"))
+        {
+            init_params.distribution = strcmp(value, "plummer") == 0 ? DISTRIBUTION_PLUMMER
+                                     : strcmp(value, "disk") == 0 ? DISTRIBUTION_DISK : DISTRIBUTION_UNIFORM;
+        }
+        else if (IsOption(argv[i], length, "size"))
+        {
+            init_params.size = atof(value);
+        }
+        else if (IsOption(argv[i], length, "min_mass"))
+        {
+            init_params.min_mass = atof(value);
+        }
+        else if (IsOption(argv[i], length, "max_mass"))
+        {
+            init_params.max_mass = atof(value);
+        }
+        else if (IsOption(argv[i], length, "max_speed"))
+        {
+            init_params.max_speed = atof(value);
+        }
+        else if (IsOption(argv[i], length, "seed"))
+        {
+            init_params.seed = (unsigned int)atoi(value);
+        }
+        else if (IsOption(argv[i], length, "output"))
+        {
+            output_path = value;
+        }
+        else if (IsOption(argv[i], length, "output_every"))
+        {
+            output_every = (size_t)atoi(value) > 0 ? (size_t)atoi(value) : 1;
+        }
+        else if (IsOption(argv[i], length, "output_precision"))
+        {
+            output_float = strcmp(value, "float") == 0;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s.\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (integrator == INTEGRATOR_BLOCK && gravity.softening <= 0)
+    {
+        fprintf(stderr, "The block integrator needs a positive softening.\n");
+        exit(1);
+    }
+
+    // The tiled kernel computes every pair at once and cannot skip the
+    // bodies that are not due for a force.
+    if (integrator == INTEGRATOR_BLOCK && mode == FORCE_TILED)
+    {
+        fprintf(stderr, "The block integrator does not support the tiled mode.\n");
+        exit(1);
+    }
+
+    // Spinning only delays the thread being waited for when cores are shared.
+    if (!spin_given && (long)num_threads > sysconf(_SC_NPROCESSORS_ONLN))
+    {
+        barrier_spin = 0;
+    }
+}
+
 void * ThreadMain(void *args)
 {
     size_t tid = (size_t)args;
@@ -103,100 +371,398 @@ void * ThreadMain(void *args)
     size_t start = tid * parts + (tid >= remainder ? remainder : tid);
     size_t end = start + parts + (tid >= remainder ? 0 : 1);
 
-    for (int i = 0; i < iterations; i++)
+    // Velocity Verlet and the block steps reuse the accelerations of the
+    // previous step.
+    if (integrator == INTEGRATOR_VERLET || integrator == INTEGRATOR_BLOCK)
     {
-        pthread_mutex_lock(&barrier_init_mutex);
-        if (!calc_iter_barrier_initialized)
+        CalculateAccelerations(tid, start, end, body_buffers[0]);
+    }
+
+    if (integrator == INTEGRATOR_BLOCK)
+    {
+        for (size_t i = start; i < end; i++)
         {
-            if (update_iter_barrier_initialized)
-            {
-                pthread_barrier_destroy(&update_iter_barrier);
-            }
+            body_levels[i] = BlockLevel(i, (size_t)1 << block_levels);
+        }
+
+        SortByLevel(tid, start, end);
+    }
+
+    if (trajectory != NULL)
+    {
+        StageSnapshot(trajectory, 0, 0, 0, body_buffers[0], start, end);
+    }
+
+    for (size_t i = 0; i < iterations; i++)
+    {
+        body_store_t *current = body_buffers[i % 2];
+        body_store_t *next = body_buffers[(i + 1) % 2];
 
-            pthread_barrier_init(&calc_iter_barrier, NULL, (unsigned int)num_threads);
-            calc_iter_barrier_initialized = true;
-            update_iter_barrier_initialized = false;
+        if (integrator == INTEGRATOR_LEAPFROG)
+        {
+            LeapfrogStep(tid, start, end, current, next);
+        }
+        else if (integrator == INTEGRATOR_VERLET)
+        {
+            VerletStep(tid, start, end, current, next);
+        }
+        else if (integrator == INTEGRATOR_RK4)
+        {
+            RungeKuttaStep(tid, start, end, current, next);
+        }
+        else if (integrator == INTEGRATOR_BLOCK)
+        {
+            BlockStep(tid, start, end, current, next);
+        }
+        else
+        {
+            EulerStep(tid, start, end, current, next);
         }
-        pthread_mutex_unlock(&barrier_init_mutex);
 
-        CalculateNewInfo(start, end);
+        if (trajectory != NULL && (i + 1) % output_every == 0)
+        {
+            StageSnapshot(trajectory, (i + 1) / output_every, i + 1, (i + 1) * delta_t, next, start, end);
+        }
 
-        pthread_barrier_wait(&calc_iter_barrier);
+        // Once every thread is past this point next becomes the current
+        // buffer, no copy back is needed.
+        PositionsChanged(next, start, end);
+        SpinBarrierWait(&phase_barrier);
+    }
 
-        pthread_mutex_lock(&barrier_init_mutex);
-        if (!update_iter_barrier_initialized)
+    return NULL;
+}
+
+// Force phase: accelerations of bodies [start, end) at the given positions.
+// Every thread must call it, and every position must be final beforehand.
+void CalculateAccelerations(size_t tid, size_t start, size_t end, body_store_t *bodies)
+{
+    if (mode == FORCE_DIRECT)
+    {
+        DirectAccelerations(bodies, start, end, &gravity, precision, acc_x, acc_y, acc_z);
+        return;
+    }
+
+    if (mode == FORCE_TILED)
+    {
+        TiledAccelerations(tiled_forces, bodies, tid, start, end, &gravity, acc_x, acc_y, acc_z);
+        return;
+    }
+
+    if (mode == FORCE_CELL_LIST)
+    {
+        BuildCellList(cell_list, bodies, tid, start, end);
+
+        for (size_t i = start; i < end; i++)
         {
-            if (calc_iter_barrier_initialized)
-            {
-                pthread_barrier_destroy(&calc_iter_barrier);
-            }
+            CellListAcceleration(cell_list, bodies, i, &gravity, acc_x + i, acc_y + i, acc_z + i);
+        }
+        return;
+    }
+
+    BuildBarnesHutTree(tree, bodies, tid, start, end);
+
+    for (size_t i = start; i < end; i++)
+    {
+        BarnesHutAcceleration(tree, bodies, i, theta, &gravity, acc_x + i, acc_y + i, acc_z + i);
+    }
+}
+
+// Force phase for the bodies level_order[first, last). Collective like
+// CalculateAccelerations, [start, end) is the thread's own range.
+void CalculateActiveAccelerations(size_t tid, size_t start, size_t end, size_t first, size_t last,
+                                  body_store_t *bodies)
+{
+    if (mode == FORCE_DIRECT)
+    {
+        DirectAccelerationsOf(bodies, level_order, first, last, &gravity, precision, acc_x, acc_y, acc_z);
+        return;
+    }
 
-            pthread_barrier_init(&update_iter_barrier, NULL, (unsigned int)num_threads);
-            update_iter_barrier_initialized = true;
-            calc_iter_barrier_initialized = false;
+    if (mode == FORCE_CELL_LIST)
+    {
+        BuildCellList(cell_list, bodies, tid, start, end);
+
+        for (size_t k = first; k < last; k++)
+        {
+            size_t i = level_order[k];
+            CellListAcceleration(cell_list, bodies, i, &gravity, acc_x + i, acc_y + i, acc_z + i);
         }
-        pthread_mutex_unlock(&barrier_init_mutex);
+        return;
+    }
 
-        UpdateNewInfo(start, end);
+    BuildBarnesHutTree(tree, bodies, tid, start, end);
 
-        pthread_barrier_wait(&update_iter_barrier);
+    for (size_t k = first; k < last; k++)
+    {
+        size_t i = level_order[k];
+        BarnesHutAcceleration(tree, bodies, i, theta, &gravity, acc_x + i, acc_y + i, acc_z + i);
     }
+}
 
-    return NULL;
+// Must follow every write of positions that a force phase will read.
+void PositionsChanged(body_store_t *bodies, size_t start, size_t end)
+{
+    if (precision == PRECISION_FLOAT)
+    {
+        SyncFloatBodies(bodies, start, end);
+    }
+}
+
+void EulerStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next)
+{
+    CalculateAccelerations(tid, start, end, current);
+
+    for (size_t i = start; i < end; i++)
+    {
+        next->vx[i] = current->vx[i] + delta_t * acc_x[i];
+        next->vy[i] = current->vy[i] + delta_t * acc_y[i];
+        next->vz[i] = current->vz[i] + delta_t * acc_z[i];
+        next->x[i] = current->x[i] + next->vx[i] * delta_t;
+        next->y[i] = current->y[i] + next->vy[i] * delta_t;
+        next->z[i] = current->z[i] + next->vz[i] * delta_t;
+    }
+}
+
+void LeapfrogStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next)
+{
+    double half_t = delta_t / 2;
+
+    for (size_t i = start; i < end; i++)
+    {
+        stage_bodies->x[i] = current->x[i] + current->vx[i] * half_t;
+        stage_bodies->y[i] = current->y[i] + current->vy[i] * half_t;
+        stage_bodies->z[i] = current->z[i] + current->vz[i] * half_t;
+    }
+
+    PositionsChanged(stage_bodies, start, end);
+    SpinBarrierWait(&phase_barrier);
+
+    CalculateAccelerations(tid, start, end, stage_bodies);
+
+    for (size_t i = start; i < end; i++)
+    {
+        next->vx[i] = current->vx[i] + delta_t * acc_x[i];
+        next->vy[i] = current->vy[i] + delta_t * acc_y[i];
+        next->vz[i] = current->vz[i] + delta_t * acc_z[i];
+        next->x[i] = stage_bodies->x[i] + next->vx[i] * half_t;
+        next->y[i] = stage_bodies->y[i] + next->vy[i] * half_t;
+        next->z[i] = stage_bodies->z[i] + next->vz[i] * half_t;
+    }
+}
+
+// Expects the accelerations at the current positions and leaves them at the new ones.
+void VerletStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next)
+{
+    double half_t = delta_t / 2;
+
+    for (size_t i = start; i < end; i++)
+    {
+        next->vx[i] = current->vx[i] + half_t * acc_x[i];
+        next->vy[i] = current->vy[i] + half_t * acc_y[i];
+        next->vz[i] = current->vz[i] + half_t * acc_z[i];
+        next->x[i] = current->x[i] + next->vx[i] * delta_t;
+        next->y[i] = current->y[i] + next->vy[i] * delta_t;
+        next->z[i] = current->z[i] + next->vz[i] * delta_t;
+    }
+
+    PositionsChanged(next, start, end);
+    SpinBarrierWait(&phase_barrier);
+
+    CalculateAccelerations(tid, start, end, next);
+
+    for (size_t i = start; i < end; i++)
+    {
+        next->vx[i] += half_t * acc_x[i];
+        next->vy[i] += half_t * acc_y[i];
+        next->vz[i] += half_t * acc_z[i];
+    }
 }
 
-void CalculateNewInfo(size_t start, size_t end)
+// Classic fourth order Runge-Kutta. The weighted slopes are summed straight
+// into next, the intermediate stage is kept in stage_bodies.
+void RungeKuttaStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next)
 {
-    for(size_t i = start; i < end; i++)
+    const double weights[4] = { 1.0 / 6, 1.0 / 3, 1.0 / 3, 1.0 / 6 };
+    const double offsets[3] = { 0.5, 0.5, 1 };
+
+    for (size_t k = 0; k < 4; k++)
     {
-        Body *current_body = current_bodies+i;
-        Body *new_body = new_bodies+i;
+        body_store_t *slope_bodies = k == 0 ? current : stage_bodies;
 
-        new_body->w = current_body->w;
-        new_body->vx = current_body->vx;
-        new_body->vy = current_body->vy;
-        new_body->x = current_body->x;
-        new_body->y = current_body->y;
+        CalculateAccelerations(tid, start, end, slope_bodies);
+        if (k > 0)
+        {
+            // Other threads may still read the stage positions.
+            SpinBarrierWait(&phase_barrier);
+        }
 
-        for (int j = 0; j < num_bodies; j++)
+        for (size_t i = start; i < end; i++)
         {
-            if (j == i)
+            double vx = slope_bodies->vx[i];
+            double vy = slope_bodies->vy[i];
+            double vz = slope_bodies->vz[i];
+
+            if (k == 0)
             {
-                continue;
+                next->x[i] = current->x[i];
+                next->y[i] = current->y[i];
+                next->z[i] = current->z[i];
+                next->vx[i] = current->vx[i];
+                next->vy[i] = current->vy[i];
+                next->vz[i] = current->vz[i];
             }
 
-            Body *current_other_body = current_bodies+j;
-
-            double delta_x = new_body->x - current_other_body->x;
-            double delta_y = new_body->y - current_other_body->y;
-            double distance = sqrt(pow(delta_x,2) + pow(delta_y,2));
+            next->x[i] += weights[k] * delta_t * vx;
+            next->y[i] += weights[k] * delta_t * vy;
+            next->z[i] += weights[k] * delta_t * vz;
+            next->vx[i] += weights[k] * delta_t * acc_x[i];
+            next->vy[i] += weights[k] * delta_t * acc_y[i];
+            next->vz[i] += weights[k] * delta_t * acc_z[i];
 
-            if (distance == 0)
+            if (k < 3)
             {
-                continue;
+                stage_bodies->x[i] = current->x[i] + offsets[k] * delta_t * vx;
+                stage_bodies->y[i] = current->y[i] + offsets[k] * delta_t * vy;
+                stage_bodies->z[i] = current->z[i] + offsets[k] * delta_t * vz;
+                stage_bodies->vx[i] = current->vx[i] + offsets[k] * delta_t * acc_x[i];
+                stage_bodies->vy[i] = current->vy[i] + offsets[k] * delta_t * acc_y[i];
+                stage_bodies->vz[i] = current->vz[i] + offsets[k] * delta_t * acc_z[i];
             }
+        }
 
-            double force = G * current_other_body->w / (distance * distance);
-            new_body->vx = new_body->vx + DELTA_T * force * delta_x / distance;
-            new_body->vy = new_body->vy + DELTA_T * force * delta_y / distance;
-            new_body->x = new_body->x + new_body->vx * DELTA_T;
-            new_body->y = new_body->y + new_body->vy * DELTA_T;
+        if (k < 3)
+        {
+            PositionsChanged(stage_bodies, start, end);
+            SpinBarrierWait(&phase_barrier);
         }
     }
 }
 
-void UpdateNewInfo(size_t start, size_t end)
+// Hierarchical block steps: body i steps by delta_t / 2^level, the step
+// is split into 2^block_levels substeps of the shortest length. Every body
+// drifts each substep, but only the bodies whose own step ends get a new
+// force (kick-drift-kick), so bodies in quiet regions cost one force per
+// delta_t. The bodies due at a substep are a prefix of level_order and are
+// shared out evenly, whichever thread owns them.
+void BlockStep(size_t tid, size_t start, size_t end, body_store_t *current, body_store_t *next)
 {
-    for(size_t i = start; i < end; i++)
+    size_t substeps = (size_t)1 << block_levels;
+    double min_t = delta_t / substeps;
+
+    // Every step starts and ends with all bodies in sync, open all steps.
+    for (size_t i = start; i < end; i++)
     {
-        Body *current_body = current_bodies+i;
-        Body *new_body = new_bodies+i;
+        double half_t = delta_t / ((size_t)1 << body_levels[i]) / 2;
+        next->vx[i] = current->vx[i] + half_t * acc_x[i];
+        next->vy[i] = current->vy[i] + half_t * acc_y[i];
+        next->vz[i] = current->vz[i] + half_t * acc_z[i];
+        next->x[i] = current->x[i];
+        next->y[i] = current->y[i];
+        next->z[i] = current->z[i];
+    }
+
+    for (size_t s = 1; s <= substeps; s++)
+    {
+        for (size_t i = start; i < end; i++)
+        {
+            next->x[i] += next->vx[i] * min_t;
+            next->y[i] += next->vy[i] * min_t;
+            next->z[i] += next->vz[i] * min_t;
+        }
+
+        PositionsChanged(next, start, end);
+        SpinBarrierWait(&phase_barrier);
+
+        // Steps of level k end after multiples of 2^(block_levels - k) substeps.
+        size_t lowest_due = block_levels - (size_t)__builtin_ctzll(s);
+        size_t due = 0;
+        for (size_t t = 0; t < num_threads; t++)
+        {
+            for (size_t k = lowest_due; k <= block_levels; k++)
+            {
+                due += level_counts[t * (MAX_BLOCK_LEVELS + 1) + k];
+            }
+        }
+
+        size_t first = due * tid / num_threads;
+        size_t last = due * (tid + 1) / num_threads;
+        CalculateActiveAccelerations(tid, start, end, first, last, next);
+
+        for (size_t k = first; k < last; k++)
+        {
+            size_t i = level_order[k];
+            double half_t = delta_t / ((size_t)1 << body_levels[i]) / 2;
+            next->vx[i] += half_t * acc_x[i];
+            next->vy[i] += half_t * acc_y[i];
+            next->vz[i] += half_t * acc_z[i];
+
+            body_levels[i] = BlockLevel(i, s);
+            if (s < substeps)
+            {
+                half_t = delta_t / ((size_t)1 << body_levels[i]) / 2;
+                next->vx[i] += half_t * acc_x[i];
+                next->vy[i] += half_t * acc_y[i];
+                next->vz[i] += half_t * acc_z[i];
+            }
+        }
+
+        SpinBarrierWait(&phase_barrier);
+        SortByLevel(tid, start, end);
+    }
+}
+
+// Level of body i from its acceleration once substeps_done substeps have
+// passed. A new step must start on a multiple of its own length, so the
+// level can only drop as far as the substep count allows.
+unsigned int BlockLevel(size_t i, size_t substeps_done)
+{
+    double acceleration = sqrt(acc_x[i] * acc_x[i] + acc_y[i] * acc_y[i] + acc_z[i] * acc_z[i]);
+    size_t level = 0;
 
-        current_body->w = new_body->w;
-        current_body->vx = new_body->vx;
-        current_body->vy = new_body->vx;
-        current_body->x = new_body->x;
-        current_body->y = new_body->y;
+    if (acceleration > 0)
+    {
+        double step = sqrt(2 * eta * gravity.softening / acceleration);
+        while (level < block_levels && delta_t / ((size_t)1 << level) > step)
+        {
+            level++;
+        }
     }
+
+    size_t lowest = block_levels - (size_t)__builtin_ctzll(substeps_done);
+    return (unsigned int)(level > lowest ? level : lowest);
 }
 
+// Parallel counting sort of the bodies by level into level_order. The
+// counts stay behind for the next substep to size its set of due bodies.
+void SortByLevel(size_t tid, size_t start, size_t end)
+{
+    size_t *counts = level_counts + tid * (MAX_BLOCK_LEVELS + 1);
+    memset(counts, 0, (MAX_BLOCK_LEVELS + 1) * sizeof(size_t));
+
+    for (size_t i = start; i < end; i++)
+    {
+        counts[body_levels[i]]++;
+    }
+
+    SpinBarrierWait(&phase_barrier);
+
+    size_t offsets[MAX_BLOCK_LEVELS + 1];
+    size_t offset = 0;
+    for (size_t k = block_levels + 1; k-- > 0;)
+    {
+        for (size_t t = 0; t < num_threads; t++)
+        {
+            if (t == tid)
+            {
+                offsets[k] = offset;
+            }
+            offset += level_counts[t * (MAX_BLOCK_LEVELS + 1) + k];
+        }
+    }
+
+    for (size_t i = start; i < end; i++)
+    {
+        level_order[offsets[body_levels[i]]++] = i;
+    }
+}
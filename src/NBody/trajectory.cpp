@@ -0,0 +1,184 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "trajectory.h"
+
+static void * WriterMain(void *args);
+
+trajectory_t * CreateTrajectory(const char *path, body_store_t *bodies, size_t num_threads, size_t dims,
+                                bool quantize)
+{
+    trajectory_t *trajectory = (trajectory_t *)calloc(1, sizeof(trajectory_t));
+    ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(trajectory, "trajectory");
+
+    trajectory->file = fopen(path, "wb");
+    if (trajectory->file == NULL)
+    {
+        fprintf(stderr, "Cannot create trajectory file %s.\n", path);
+        exit(1);
+    }
+
+    trajectory->path = path;
+    trajectory->num_bodies = bodies->count;
+    trajectory->num_threads = num_threads;
+    trajectory->dims = dims;
+    trajectory->quantize = quantize;
+    trajectory->record_size = sizeof(trajectory_snapshot_header_t) +
+        2 * dims * bodies->count * (quantize ? sizeof(float) : sizeof(double));
+
+    for (size_t r = 0; r < 2; r++)
+    {
+        trajectory->records[r] = (unsigned char *)malloc(trajectory->record_size);
+        ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(trajectory->records[r], "trajectory->records[r]");
+    }
+
+    trajectory_file_header_t header;
+    memcpy(header.magic, TRAJECTORY_FILE_MAGIC, sizeof(header.magic));
+    header.body_count = bodies->count;
+    header.dims = (uint32_t)dims;
+    header.flags = quantize ? TRAJECTORY_FLOAT : 0;
+
+    if (fwrite(&header, sizeof(header), 1, trajectory->file) != 1 ||
+        fwrite(bodies->w, sizeof(double), bodies->count, trajectory->file) != bodies->count)
+    {
+        fprintf(stderr, "Error writing trajectory file %s.\n", path);
+        exit(1);
+    }
+
+    pthread_mutex_init(&trajectory->mutex, NULL);
+    pthread_cond_init(&trajectory->staged_cond, NULL);
+    pthread_cond_init(&trajectory->written_cond, NULL);
+
+    if (0 != pthread_create(&trajectory->writer, NULL, WriterMain, trajectory))
+    {
+        fprintf(stderr, "Error creating the trajectory writer thread.\n");
+        exit(1);
+    }
+
+    return trajectory;
+}
+
+void DestroyTrajectory(trajectory_t *trajectory)
+{
+    if (trajectory == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&trajectory->mutex);
+    trajectory->done = true;
+    pthread_cond_signal(&trajectory->staged_cond);
+    pthread_mutex_unlock(&trajectory->mutex);
+
+    pthread_join(trajectory->writer, NULL);
+
+    if (fclose(trajectory->file) != 0)
+    {
+        fprintf(stderr, "Error writing trajectory file %s.\n", trajectory->path);
+        exit(1);
+    }
+
+    pthread_cond_destroy(&trajectory->written_cond);
+    pthread_cond_destroy(&trajectory->staged_cond);
+    pthread_mutex_destroy(&trajectory->mutex);
+    free(trajectory->records[0]);
+    free(trajectory->records[1]);
+    free(trajectory);
+}
+
+void StageSnapshot(trajectory_t *trajectory, size_t snapshot, size_t step, double time,
+                   body_store_t *bodies, size_t start, size_t end)
+{
+    size_t r = snapshot % 2;
+    unsigned char *record = trajectory->records[r];
+
+    // Usually free already: the record was handed over two snapshots ago.
+    pthread_mutex_lock(&trajectory->mutex);
+    while (trajectory->full[r])
+    {
+        pthread_cond_wait(&trajectory->written_cond, &trajectory->mutex);
+    }
+    pthread_mutex_unlock(&trajectory->mutex);
+
+    size_t n = trajectory->num_bodies;
+    const double *columns[6] = { bodies->x, bodies->y, bodies->z, bodies->vx, bodies->vy, bodies->vz };
+    unsigned char *data = record + sizeof(trajectory_snapshot_header_t);
+
+    for (size_t c = 0; c < 2 * trajectory->dims; c++)
+    {
+        const double *column = columns[c < trajectory->dims ? c : 3 + c - trajectory->dims];
+
+        if (trajectory->quantize)
+        {
+            float *values = (float *)data + c * n;
+            for (size_t i = start; i < end; i++)
+            {
+                values[i] = (float)column[i];
+            }
+        }
+        else
+        {
+            memcpy((double *)data + c * n + start, column + start, (end - start) * sizeof(double));
+        }
+    }
+
+    if (__atomic_add_fetch(&trajectory->copied[r], 1, __ATOMIC_ACQ_REL) < trajectory->num_threads)
+    {
+        return;
+    }
+
+    trajectory->copied[r] = 0;
+
+    trajectory_snapshot_header_t header;
+    header.step = step;
+    header.time = time;
+    memcpy(record, &header, sizeof(header));
+
+    pthread_mutex_lock(&trajectory->mutex);
+    trajectory->full[r] = true;
+    pthread_cond_signal(&trajectory->staged_cond);
+    pthread_mutex_unlock(&trajectory->mutex);
+}
+
+static void * WriterMain(void *args)
+{
+    trajectory_t *trajectory = (trajectory_t *)args;
+
+    while (true)
+    {
+        size_t r = trajectory->written % 2;
+
+        pthread_mutex_lock(&trajectory->mutex);
+        while (!trajectory->full[r] && !trajectory->done)
+        {
+            pthread_cond_wait(&trajectory->staged_cond, &trajectory->mutex);
+        }
+
+        bool full = trajectory->full[r];
+        pthread_mutex_unlock(&trajectory->mutex);
+
+        if (!full)
+        {
+            break;
+        }
+
+        if (fwrite(trajectory->records[r], trajectory->record_size, 1, trajectory->file) != 1)
+        {
+            fprintf(stderr, "Error writing trajectory file %s.\n", trajectory->path);
+            exit(1);
+        }
+
+        pthread_mutex_lock(&trajectory->mutex);
+        trajectory->full[r] = false;
+        trajectory->written++;
+        pthread_cond_broadcast(&trajectory->written_cond);
+        pthread_mutex_unlock(&trajectory->mutex);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,70 @@
+/**
+* Program: Body movement in space simulation
+**/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "typedefs.h"
+
+#define TRAJECTORY_FILE_MAGIC "PTTRAJ01"
+#define TRAJECTORY_FLOAT 1 // flags bit: values stored as float instead of double
+
+// Trajectory file layout, native byte order:
+//   header
+//   double masses[body_count]
+//   snapshots, each:
+//     snapshot header
+//     positions  [dims][body_count] (x of every body, then y, then z)
+//     velocities [dims][body_count]
+//   positions and velocities are float with TRAJECTORY_FLOAT, double otherwise.
+typedef struct trajectory_file_header_t
+{
+    char magic[8];
+    uint64_t body_count;
+    uint32_t dims;
+    uint32_t flags;
+} trajectory_file_header_t;
+
+typedef struct trajectory_snapshot_header_t
+{
+    uint64_t step;
+    double time;
+} trajectory_snapshot_header_t;
+
+// Snapshots are copied by the simulation threads into one of two staging
+// records and written out by a dedicated thread, so the file I/O overlaps
+// with the following steps. The threads only wait when the writer is still
+// busy with the record staged two snapshots earlier.
+typedef struct trajectory_t
+{
+    FILE *file;
+    const char *path;
+    size_t num_bodies;
+    size_t num_threads;
+    size_t dims;
+    bool quantize;
+    size_t record_size;
+    unsigned char *records[2];
+    bool full[2];
+    size_t copied[2];  // threads done copying into the record
+    size_t written;    // snapshots written so far, selects the record
+    bool done;
+    pthread_mutex_t mutex;
+    pthread_cond_t staged_cond;
+    pthread_cond_t written_cond;
+    pthread_t writer;
+} trajectory_t;
+
+// Writes the header and the masses and starts the writer thread.
+trajectory_t * CreateTrajectory(const char *path, body_store_t *bodies, size_t num_threads, size_t dims,
+                                bool quantize);
+// Waits for the staged snapshots to be written and closes the file.
+void DestroyTrajectory(trajectory_t *trajectory);
+
+// Collective: every thread calls it with its own [start, end) range of the
+// same snapshot; the last one hands the record to the writer.
+void StageSnapshot(trajectory_t *trajectory, size_t snapshot, size_t step, double time,
+                   body_store_t *bodies, size_t start, size_t end);
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stddef.h>
 
 #define ASSERT_PTR_OR_RETURN_EXIT_WITH_ERROR(ptr, var_name) \
     if (ptr == NULL) \
@@ -16,10 +17,32 @@
 #define SUCCESS 0
 #define FAILURE 1
 
-typedef struct Body
+#define BODY_ALIGNMENT 64 // bytes, one cache line and one AVX-512 register
+#define BODY_PADDING 16   // arrays are padded to a multiple of the widest vector
+
+typedef enum precision_t
+{
+    PRECISION_DOUBLE,
+    PRECISION_FLOAT
+} precision_t;
+
+// Gravity between two bodies at distance r is g * m1 * m2 / (r^2 + softening^2),
+// Plummer softening keeps close encounters finite.
+typedef struct gravity_t
 {
-    double x, y;   // position
-    double vx, vy; // velocity
-    double w;      // mass
-} Body;
+    double g;
+    double softening;
+} gravity_t;
 
+// Bodies stored as separate aligned arrays. Padding slots have zero mass, so
+// the force kernels may run over whole vectors without a remainder loop. In
+// two dimensions z and vz stay zero.
+typedef struct body_store_t
+{
+    size_t count;
+    size_t capacity;     // count rounded up to BODY_PADDING
+    double *x, *y, *z;   // position
+    double *vx, *vy, *vz; // velocity
+    double *w;           // mass
+    float *xf, *yf, *zf, *wf; // single precision copy read by the float kernel
+} body_store_t;